@@ -5,6 +5,14 @@
 QT+=opengl
 QT+=openglwidgets
 QMAKE_CXXFLAGS+=-DGL_SILENCE_DEPRECATION
+# qmake CONFIG+=avx2 enables the AVX2 terrain kernels on x86-64 machines that support them
+avx2 {
+	QMAKE_CXXFLAGS+=-mavx2 -mfma
+}
+# the headless benchmark (--headless) uses an EGL pbuffer on Linux, and Qt's offscreen surface elsewhere
+unix:!macx {
+	LIBS+=-lEGL
+}
 TEMPLATE = app
 TARGET = A1_handout
 INCLUDEPATH += .
@@ -17,29 +25,73 @@ INCLUDEPATH += .
 #DEFINES += QT_DISABLE_DEPRECATED_UP_TO=0x060000 # disables all APIs deprecated in Qt 6.0.0 and earlier
 
 # Input
-HEADERS += Camera.h \
+HEADERS += Benchmarks.h \
+           Camera.h \
            Cartesian3.h \
            FlightSimulatorWidget.h \
+           FrameCapture.h \
+           FrameSnapshot.h \
+           Frustum.h \
+           GLStateCache.h \
+           Heightfield.h \
+           HeightfieldFile.h \
+           HeightPyramid.h \
            Homogeneous4.h \
            HomogeneousFaceSurface.h \
+           IndexedFaceSurface.h \
+           InstanceBatch.h \
            Matrix4.h \
+           MeshCache.h \
+           MeshOptimiser.h \
+           OffscreenContext.h \
            Particle.h \
+           ParticleSystem.h \
            Plane.h \
            Quaternion.h \
            Random.h \
+           RenderQueue.h \
            SceneModel.h \
+           SpatialHash.h \
            Terrain.h \
-           Utils.h
-SOURCES += Camera.cpp \
+           TerrainQuadtree.h \
+           TerrainStreamer.h \
+           ThreadPool.h \
+           TrailEmitter.h \
+           TransformKernels.h \
+           TripleBuffer.h \
+           Utils.h \
+           VertexBuffer.h
+SOURCES += Benchmarks.cpp \
+           Camera.cpp \
            Cartesian3.cpp \
            FlightSimulatorWidget.cpp \
+           FrameCapture.cpp \
+           Frustum.cpp \
+           GLStateCache.cpp \
+           Heightfield.cpp \
+           HeightfieldFile.cpp \
+           HeightPyramid.cpp \
            Homogeneous4.cpp \
            HomogeneousFaceSurface.cpp \
+           IndexedFaceSurface.cpp \
+           InstanceBatch.cpp \
            main.cpp \
            Matrix4.cpp \
+           MeshCache.cpp \
+           MeshOptimiser.cpp \
+           OffscreenContext.cpp \
            Particle.cpp \
+           ParticleSystem.cpp \
            Plane.cpp \
            Quaternion.cpp \
            Random.cpp \
+           RenderQueue.cpp \
            SceneModel.cpp \
-           Terrain.cpp
+           SpatialHash.cpp \
+           Terrain.cpp \
+           TerrainQuadtree.cpp \
+           TerrainStreamer.cpp \
+           ThreadPool.cpp \
+           TrailEmitter.cpp \
+           TransformKernels.cpp \
+           VertexBuffer.cpp
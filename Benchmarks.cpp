@@ -0,0 +1,1180 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	Benchmarks.cpp
+//	------------------------
+//
+//	Command-line benchmarks for the performance
+//	sensitive parts of the simulator.  These run
+//	without a window and print their timings.
+//
+///////////////////////////////////////////////////
+
+#include "Benchmarks.h"
+#include "Terrain.h"
+#include "HeightfieldFile.h"
+#include "TerrainStreamer.h"
+#include "ThreadPool.h"
+#include "TransformKernels.h"
+#include "OffscreenContext.h"
+#include "FrameCapture.h"
+#include "MeshOptimiser.h"
+#include "Particle.h"
+#include "ParticleSystem.h"
+#include "SpatialHash.h"
+#include "TrailEmitter.h"
+#include "SceneModel.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <math.h>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// milliseconds elapsed since a given start time
+static double MillisecondsSince(std::chrono::steady_clock::time_point start)
+	{ // MillisecondsSince()
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	} // MillisecondsSince()
+
+// a small deterministic generator, so runs are comparable
+static unsigned int benchmarkSeed = 12345;
+static float BenchmarkRandom()
+	{ // BenchmarkRandom()
+	benchmarkSeed = benchmarkSeed * 1664525u + 1013904223u;
+	return (benchmarkSeed >> 8) / 16777216.0f;
+	} // BenchmarkRandom()
+
+// writes a synthetic rolling landscape of the given size as a binary heightfield
+static bool WriteSyntheticTerrain(const char *fileName, long gridSize)
+	{ // WriteSyntheticTerrain()
+	std::vector<float> values((size_t) gridSize * gridSize);
+	for (long row = 0; row < gridSize; row++)
+		for (long col = 0; col < gridSize; col++)
+			values[(size_t) row * gridSize + col] = 1000.0f + 800.0f * sin(row * 0.05f) * cos(col * 0.03f) + 50.0f * BenchmarkRandom();
+	return WriteHeightfieldFile(fileName, gridSize, gridSize, 500.0f, values.data());
+	} // WriteSyntheticTerrain()
+
+// the getHeight() used with vector-of-rows storage, kept for comparison
+static __attribute__((noinline)) float VectorOfRowsGetHeight(const std::vector<std::vector<float>> &heightValues, float xyScale, float x, float y)
+	{ // VectorOfRowsGetHeight()
+	long nRows = heightValues.size(), nColumns = heightValues[0].size();
+	long arrayOrigin_i = nRows / 2;
+	long arrayOrigin_j = nColumns / 2;
+	// rows run downwards from the origin row, as in the mesh
+	x = x + arrayOrigin_j * xyScale;
+	y = arrayOrigin_i * xyScale - y;
+	long x_integer	=	x / xyScale;
+	long y_integer 	= 	y / xyScale;
+	float x_remainder	=	(float)(x - (xyScale * x_integer))/xyScale;
+	float y_remainder	=	(float)(y - (xyScale * y_integer))/xyScale;
+	long row	=	y_integer;
+	long column	=	x_integer; 
+	if (x_remainder < y_remainder)
+		{ // LL triangle
+		float alpha = y_remainder;
+		float beta = (1.0 - y_remainder) * x_remainder;
+		float gamma = 1.0 - alpha - beta;
+		return alpha * heightValues[row][column] + beta * heightValues[row+1][column+1] + gamma * heightValues[row+1][column];
+		} // LL triangle
+	else
+		{ // UR triangle
+		float alpha = 1.0 - y_remainder;
+		float beta = x_remainder * y_remainder;
+		float gamma = 1.0 - alpha - beta;
+		return alpha * heightValues[row][column] + beta * heightValues[row+1][column+1] + gamma * heightValues[row][column+1];
+		} // UR triangle
+	} // VectorOfRowsGetHeight()
+
+// compares getHeight on the contiguous grid against the old vector-of-rows
+// storage, for random and spatially coherent queries
+int BenchmarkTerrainHeight(long gridSize, long queries)
+	{ // BenchmarkTerrainHeight()
+	std::string fileName = "./terrain-height.bench.hfb";
+	Terrain terrain;
+	if (!WriteSyntheticTerrain(fileName.c_str(), gridSize) || !terrain.ReadHeightValues(fileName.c_str(), 500))
+		{ // setup failed
+		std::cout << "Unable to create a " << gridSize << " x " << gridSize << " terrain" << std::endl;
+		return 1;
+		} // setup failed
+	std::remove(fileName.c_str());
+
+	// the same values in the old layout
+	std::vector<std::vector<float>> vectorOfRows(gridSize, std::vector<float>(gridSize));
+	for (long row = 0; row < gridSize; row++)
+		terrain.heightValues.GetRow(row, vectorOfRows[row].data());
+
+	// stay inside the edges so every query is valid: the origin is at sample gridSize / 2,
+	// so the far edges are gridSize / 2 - 1 cells away, and the path may step past the extent
+	float halfExtent = (gridSize / 2 - 2) * terrain.xyScale;
+	std::vector<float> randomX(queries), randomY(queries), pathX(queries), pathY(queries);
+	float walkX = 0.0f, walkY = 0.0f, heading = 0.0f;
+	for (long query = 0; query < queries; query++)
+		{ // generate queries
+		randomX[query] = (2.0f * BenchmarkRandom() - 1.0f) * halfExtent;
+		randomY[query] = (2.0f * BenchmarkRandom() - 1.0f) * halfExtent;
+		// the coherent path wanders a fraction of a cell per query
+		heading += (BenchmarkRandom() - 0.5f) * 0.2f;
+		walkX += cos(heading) * terrain.xyScale * 0.3f;
+		walkY += sin(heading) * terrain.xyScale * 0.3f;
+		if (fabs(walkX) > halfExtent) { walkX = 0.0f; }
+		if (fabs(walkY) > halfExtent) { walkY = 0.0f; }
+		pathX[query] = walkX;
+		pathY[query] = walkY;
+		} // generate queries
+
+	std::cout << "Terrain getHeight: " << gridSize << " x " << gridSize << " samples, " << queries << " queries" << std::endl;
+
+	const char *patterns[2] = { "random", "coherent" };
+	const std::vector<float> *xs[2] = { &randomX, &pathX };
+	const std::vector<float> *ys[2] = { &randomY, &pathY };
+	for (int pattern = 0; pattern < 2; pattern++)
+		{ // per query pattern
+		// the checksums keep the loops alive and show the layouts agree
+		// to within rounding
+		// each layout gets an untimed warm-up pass, then the best of three is kept
+		double vectorSum = 0.0, gridSum = 0.0;
+		double vectorTime = 1.0e30, gridTime = 1.0e30;
+		for (int pass = 0; pass < 4; pass++)
+			{ // per pass
+			vectorSum = 0.0;
+			auto start = std::chrono::steady_clock::now();
+			for (long query = 0; query < queries; query++)
+				vectorSum += VectorOfRowsGetHeight(vectorOfRows, terrain.xyScale, (*xs[pattern])[query], (*ys[pattern])[query]);
+			if (pass > 0)
+				vectorTime = std::min(vectorTime, MillisecondsSince(start));
+
+			gridSum = 0.0;
+			start = std::chrono::steady_clock::now();
+			for (long query = 0; query < queries; query++)
+				gridSum += terrain.getHeight((*xs[pattern])[query], (*ys[pattern])[query]);
+			if (pass > 0)
+				gridTime = std::min(gridTime, MillisecondsSince(start));
+			} // per pass
+
+		std::cout << std::fixed << std::setprecision(2)
+			<< std::setw(10) << patterns[pattern]
+			<< "  vector of rows " << std::setw(8) << vectorTime * 1.0e6 / queries << " ns/query"
+			<< "  row-major grid " << std::setw(8) << gridTime * 1.0e6 / queries << " ns/query"
+			<< (fabs(vectorSum - gridSum) <= 1.0e-4 * fabs(vectorSum) ? "" : "  MISMATCH") << std::endl;
+		} // per query pattern
+
+	return 0;
+	} // BenchmarkTerrainHeight()
+
+// compares getHeightBatch against one getHeight call per point
+int BenchmarkTerrainBatch(const char *demFileName, long points)
+	{ // BenchmarkTerrainBatch()
+	Terrain terrain;
+	if (!terrain.ReadHeightValues(demFileName, 500))
+		{ // load failed
+		std::cout << "Unable to read " << demFileName << std::endl;
+		return 1;
+		} // load failed
+
+	// points scattered over the terrain and a little beyond its edges
+	float halfWidth = 0.55f * terrain.m_width * terrain.xyScale;
+	float halfHeight = 0.55f * terrain.m_height * terrain.xyScale;
+	std::vector<float> xs(points), ys(points), scalarHeights(points), batchHeights(points);
+	for (long point = 0; point < points; point++)
+		{ // generate points
+		xs[point] = (2.0f * BenchmarkRandom() - 1.0f) * halfWidth;
+		ys[point] = (2.0f * BenchmarkRandom() - 1.0f) * halfHeight;
+		} // generate points
+
+	// best of several runs of each
+	double scalarTime = 1.0e30, batchTime = 1.0e30;
+	for (int pass = 0; pass < 20; pass++)
+		{ // per pass
+		auto start = std::chrono::steady_clock::now();
+		for (long point = 0; point < points; point++)
+			scalarHeights[point] = terrain.getHeight(xs[point], ys[point]);
+		scalarTime = std::min(scalarTime, MillisecondsSince(start));
+
+		start = std::chrono::steady_clock::now();
+		terrain.getHeightBatch(xs.data(), ys.data(), batchHeights.data(), points);
+		batchTime = std::min(batchTime, MillisecondsSince(start));
+		} // per pass
+
+	// the two paths should agree to within rounding
+	float maxDifference = 0.0f;
+	for (long point = 0; point < points; point++)
+		maxDifference = std::max(maxDifference, (float) fabs(scalarHeights[point] - batchHeights[point]));
+
+#if defined(__AVX2__)
+	const char *kernel = "AVX2";
+#elif defined(__SSE2__)
+	const char *kernel = "SSE2";
+#else
+	const char *kernel = "scalar";
+#endif
+	std::cout << "Terrain height batch: " << points << " points, " << kernel << " kernel" << std::endl;
+	std::cout << std::fixed << std::setprecision(2)
+		<< "  getHeight loop  " << std::setw(10) << scalarTime * 1000.0 << " us" << std::endl
+		<< "  getHeightBatch  " << std::setw(10) << batchTime * 1000.0 << " us" << std::endl
+		<< "  max difference  " << std::setw(10) << maxDifference << std::endl;
+	return 0;
+	} // BenchmarkTerrainBatch()
+
+// compares loading a text .dem against the binary heightfield format
+// returns a process exit code
+int BenchmarkTerrainLoad(const char *demFileName, int repeats)
+	{ // BenchmarkTerrainLoad()
+	// convert the text file once so that both paths read the same data
+	std::string binaryFileName = std::string(demFileName) + ".bench.hfb";
+	Terrain source;
+	if (!source.ReadHeightValues(demFileName, 500) || !source.WriteFileTerrainBinary(binaryFileName.c_str()))
+		{ // conversion failed
+		std::cout << "Unable to convert " << demFileName << std::endl;
+		return 1;
+		} // conversion failed
+
+	std::cout << "Terrain load: " << source.m_height << " x " << source.m_width << " samples, " << repeats << " repeats" << std::endl;
+
+	const char *fileNames[2] = { demFileName, binaryFileName.c_str() };
+	const char *labels[2] = { "text .dem", "binary mmap" };
+	for (int format = 0; format < 2; format++)
+		{ // per format
+		double heightsTime = 0.0, totalTime = 0.0;
+		for (int repeat = 0; repeat < repeats; repeat++)
+			{ // per repeat
+			// the height values alone show the cost of parsing
+			Terrain heightsOnly;
+			auto start = std::chrono::steady_clock::now();
+			heightsOnly.ReadHeightValues(fileNames[format], 500);
+			heightsTime += MillisecondsSince(start);
+
+			// and the full load includes building the mesh
+			Terrain full;
+			start = std::chrono::steady_clock::now();
+			full.ReadFileTerrainData(fileNames[format], 500);
+			totalTime += MillisecondsSince(start);
+			} // per repeat
+
+		std::cout << std::fixed << std::setprecision(3)
+			<< std::setw(14) << labels[format]
+			<< "  heights " << std::setw(10) << heightsTime / repeats << " ms"
+			<< "  full load " << std::setw(10) << totalTime / repeats << " ms" << std::endl;
+		} // per format
+
+	std::remove(binaryFileName.c_str());
+	return 0;
+	} // BenchmarkTerrainLoad()
+
+// flies across a synthetic streamed world, timing the frame thread's share
+// of the streaming and counting the height queries that found no tile
+int BenchmarkTerrainStreaming(long gridSize, long tileSize, long frames)
+	{ // BenchmarkTerrainStreaming()
+	std::string fileName = "./terrain-stream.bench.hfb";
+	std::string directory = "./terrain-stream.bench.tiles";
+	bool written = WriteSyntheticTerrain(fileName.c_str(), gridSize)
+				&& TerrainStreamer::WriteTiles(fileName.c_str(), 500.0f, directory.c_str(), tileSize);
+	std::remove(fileName.c_str());
+	TerrainStreamer streamer;
+	// a small budget, so that tiles behind the flight are evicted
+	streamer.byteBudget = 32 << 20;
+	if (!written || !streamer.Open(directory.c_str()))
+		{ // setup failed
+		std::cout << "Unable to create a " << gridSize << " x " << gridSize << " streamed terrain with " << tileSize << " cell tiles" << std::endl;
+		return 1;
+		} // setup failed
+
+	// fly corner to corner, a little inside the edges
+	float halfExtent = 0.45f * gridSize * 500.0f;
+	Cartesian3 start(-halfExtent, 4000.0f, halfExtent), end(halfExtent, 4000.0f, -halfExtent);
+	Cartesian3 heading = (end - start).unit();
+	streamer.Prime(start);
+
+	// the frame thread's work is the update plus a few ground queries;
+	// the sleep stands in for the rest of a 60Hz frame
+	double totalTime = 0.0, worstTime = 0.0, heightSum = 0.0;
+	long queries = 0;
+	for (long frame = 0; frame < frames; frame++)
+		{ // per frame
+		Cartesian3 position = start + (end - start) * ((float) frame / frames);
+		auto frameStart = std::chrono::steady_clock::now();
+		streamer.Update(position, heading);
+		for (int query = 0; query < 64; query++, queries++)
+			heightSum += streamer.getHeight(position.x + (BenchmarkRandom() - 0.5f) * 4000.0f, position.z + (BenchmarkRandom() - 0.5f) * 4000.0f);
+		double frameTime = MillisecondsSince(frameStart);
+		totalTime += frameTime;
+		worstTime = std::max(worstTime, frameTime);
+		std::this_thread::sleep_for(std::chrono::milliseconds(4));
+		} // per frame
+
+	std::cout << "Terrain streaming: " << gridSize << " x " << gridSize << " samples in " << tileSize << " cell tiles, " << frames << " frames" << std::endl;
+	std::cout << std::fixed << std::setprecision(3)
+		<< "  frame thread     mean " << totalTime / frames << " ms  worst " << worstTime << " ms" << std::endl
+		<< "  tiles            loaded " << streamer.tilesLoaded << "  evicted " << streamer.tilesEvicted
+		<< "  resident " << streamer.ResidentTileCount() << " (" << streamer.residentBytes / 1048576.0 << " MB)" << std::endl
+		<< "  height misses    " << streamer.heightMisses << " of " << queries << std::endl;
+	if (heightSum != heightSum)
+		std::cout << "  NaN heights" << std::endl;
+
+	// remove the tile directory
+	long tilesX = std::max(1L, (gridSize - 1 + tileSize - 1) / tileSize);
+	streamer.Close();
+	for (long tileRow = 0; tileRow < tilesX; tileRow++)
+		for (long tileColumn = 0; tileColumn < tilesX; tileColumn++)
+			std::remove(TerrainStreamer::TilePath(directory, tileRow, tileColumn).c_str());
+	std::remove((directory + "/" + TERRAIN_TILE_MANIFEST).c_str());
+	std::remove(directory.c_str());
+	return 0;
+	} // BenchmarkTerrainStreaming()
+
+// loads a synthetic terrain on one thread and on the whole pool, printing
+// the time of each load phase
+int BenchmarkTerrainBuild(long gridSize, int threads)
+	{ // BenchmarkTerrainBuild()
+	std::string fileName = "./terrain-build.bench.hfb";
+	if (!WriteSyntheticTerrain(fileName.c_str(), gridSize))
+		{ // setup failed
+		std::cout << "Unable to create a " << gridSize << " x " << gridSize << " terrain" << std::endl;
+		return 1;
+		} // setup failed
+
+	ThreadPool &threadPool = ThreadPool::Shared();
+	int threadCounts[2] = { 1, threads };
+	Terrain terrains[2];
+	std::cout << "Terrain build: " << gridSize << " x " << gridSize << " samples" << std::endl;
+	for (int run = 0; run < 2; run++)
+		{ // per thread count
+		threadPool.Resize(threadCounts[run]);
+		// the best of three loads, phase by phase
+		TerrainLoadTimes best = { 1.0e30, 1.0e30, 1.0e30, 1.0e30, 1.0e30 };
+		for (int pass = 0; pass < 3; pass++)
+			{ // per pass
+			terrains[run] = Terrain();
+			terrains[run].ReadFileTerrainData(fileName.c_str(), 500);
+			const TerrainLoadTimes &times = terrains[run].loadTimes;
+			best.heights = std::min(best.heights, times.heights);
+			best.vertices = std::min(best.vertices, times.vertices);
+			best.triangles = std::min(best.triangles, times.triangles);
+			best.normals = std::min(best.normals, times.normals);
+			best.quadtree = std::min(best.quadtree, times.quadtree);
+			} // per pass
+
+		std::cout << std::fixed << std::setprecision(2)
+			<< std::setw(4) << threadPool.ThreadCount() << " threads"
+			<< "  heights " << std::setw(8) << best.heights
+			<< "  vertices " << std::setw(8) << best.vertices
+			<< "  triangles " << std::setw(8) << best.triangles
+			<< "  normals " << std::setw(8) << best.normals
+			<< "  quadtree " << std::setw(8) << best.quadtree
+			<< "  total " << std::setw(8) << best.heights + best.vertices + best.triangles + best.normals + best.quadtree << " ms" << std::endl;
+		} // per thread count
+	std::remove(fileName.c_str());
+
+	// both runs must build exactly the same mesh
+	bool same = terrains[0].indices == terrains[1].indices
+		&& terrains[0].vertices.size() == terrains[1].vertices.size()
+		&& terrains[0].normals.size() == terrains[1].normals.size();
+	for (size_t vertex = 0; same && vertex < terrains[0].vertices.size(); vertex++)
+		same = terrains[0].vertices[vertex].Point() == terrains[1].vertices[vertex].Point();
+	for (size_t normal = 0; same && normal < terrains[0].normals.size(); normal++)
+		same = terrains[0].normals[normal].Vector() == terrains[1].normals[normal].Vector();
+	if (!same)
+		std::cout << "  MISMATCH between the serial and parallel meshes" << std::endl;
+	return same ? 0 : 1;
+	} // BenchmarkTerrainBuild()
+
+// ray / triangle test for the cell walk below
+static inline bool WalkRayTriangle(const float o[3], const float d[3], const float a[3], const float b[3], const float c[3], float &best)
+	{ // WalkRayTriangle()
+	float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] }, e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+	float p[3] = { d[1] * e2[2] - d[2] * e2[1], d[2] * e2[0] - d[0] * e2[2], d[0] * e2[1] - d[1] * e2[0] };
+	float det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+	if (fabs(det) < 1.0e-12f)
+		return false;
+	float inv = 1.0f / det, s[3] = { o[0] - a[0], o[1] - a[1], o[2] - a[2] };
+	float alpha = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inv;
+	if (alpha < 0.0f || alpha > 1.0f)
+		return false;
+	float q[3] = { s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0] };
+	float beta = (d[0] * q[0] + d[1] * q[1] + d[2] * q[2]) * inv;
+	if (beta < 0.0f || alpha + beta > 1.0f)
+		return false;
+	float t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inv;
+	if (t < 0.0f || t > best)
+		return false;
+	best = t;
+	return true;
+	} // WalkRayTriangle()
+
+// segment / terrain intersection without the pyramid, kept for comparison:
+// walks every cell under the segment in order, testing both triangles of each
+static __attribute__((noinline)) bool CellWalkIntersect(const Terrain &terrain, const Cartesian3 &start, const Cartesian3 &end, float &hitParameter)
+	{ // CellWalkIntersect()
+	float o[3] = { start.x * terrain.inverseXYScale + terrain.columnOffset, terrain.rowOffset - start.z * terrain.inverseXYScale, start.y };
+	float d[3] = { (end.x - start.x) * terrain.inverseXYScale, -(end.z - start.z) * terrain.inverseXYScale, end.y - start.y };
+	long cellsWide = terrain.m_width - 1, cellsHigh = terrain.m_height - 1;
+
+	// clip the segment to the grid
+	float entry = 0.0f, exit = 1.0f;
+	float limits[2] = { (float) cellsWide, (float) cellsHigh };
+	for (int axis = 0; axis < 2; axis++)
+		{ // per axis
+		if (fabs(d[axis]) < FLT_MIN)
+			{ // parallel
+			if (o[axis] < 0.0f || o[axis] > limits[axis])
+				return false;
+			continue;
+			} // parallel
+		float t0 = -o[axis] / d[axis], t1 = (limits[axis] - o[axis]) / d[axis];
+		entry = std::max(entry, std::min(t0, t1));
+		exit = std::min(exit, std::max(t0, t1));
+		} // per axis
+	if (entry > exit)
+		return false;
+
+	// the first cell, and how far along the segment each cell boundary is
+	float u = o[0] + d[0] * entry, v = o[1] + d[1] * entry;
+	long col = std::min(std::max((long) floor(u), 0L), cellsWide - 1);
+	long row = std::min(std::max((long) floor(v), 0L), cellsHigh - 1);
+	long stepCol = d[0] > 0.0f ? 1 : -1, stepRow = d[1] > 0.0f ? 1 : -1;
+	float deltaU = fabs(d[0]) < FLT_MIN ? FLT_MAX : fabs(1.0f / d[0]);
+	float deltaV = fabs(d[1]) < FLT_MIN ? FLT_MAX : fabs(1.0f / d[1]);
+	float nextU = fabs(d[0]) < FLT_MIN ? FLT_MAX : entry + (d[0] > 0.0f ? col + 1 - u : u - col) * deltaU;
+	float nextV = fabs(d[1]) < FLT_MIN ? FLT_MAX : entry + (d[1] > 0.0f ? row + 1 - v : v - row) * deltaV;
+
+	while (true)
+		{ // per cell
+		float upperLeftHeight, upperRightHeight, lowerLeftHeight, lowerRightHeight;
+		terrain.heightValues.CellCorners(row, col, upperLeftHeight, upperRightHeight, lowerLeftHeight, lowerRightHeight);
+		float ul[3] = { (float) col, (float) row, upperLeftHeight }, ur[3] = { (float) col + 1, (float) row, upperRightHeight };
+		float ll[3] = { (float) col, (float) row + 1, lowerLeftHeight }, lr[3] = { (float) col + 1, (float) row + 1, lowerRightHeight };
+		float best = exit;
+		bool hit = WalkRayTriangle(o, d, ul, lr, ur, best);
+		hit = WalkRayTriangle(o, d, ul, ll, lr, best) || hit;
+		if (hit)
+			{ // cells are visited in order, so this is the first hit
+			hitParameter = best;
+			return true;
+			} // cells are visited in order
+
+		// on to the next cell the segment crosses
+		if (nextU < nextV)
+			{ // cross a column boundary
+			if (nextU > exit)
+				return false;
+			col += stepCol;
+			nextU += deltaU;
+			} // cross a column boundary
+		else
+			{ // cross a row boundary
+			if (nextV > exit)
+				return false;
+			row += stepRow;
+			nextV += deltaV;
+			} // cross a row boundary
+		if (col < 0 || col >= cellsWide || row < 0 || row >= cellsHigh)
+			return false;
+		} // per cell
+	} // CellWalkIntersect()
+
+// compares segment queries through the height pyramid against walking the
+// cells under each segment, for falling objects and long sight lines
+int BenchmarkTerrainRays(long gridSize, long rays)
+	{ // BenchmarkTerrainRays()
+	std::string fileName = "/tmp/benchmark_terrain_rays.hfb";
+	Terrain terrain;
+	if (!WriteSyntheticTerrain(fileName.c_str(), gridSize) || !terrain.ReadHeightValues(fileName.c_str(), 500))
+		{ // setup failed
+		std::cout << "Unable to write or read " << fileName << std::endl;
+		return 1;
+		} // setup failed
+
+	float halfWidth = 0.5f * (terrain.m_width - 1) * terrain.xyScale;
+	float halfHeight = 0.5f * (terrain.m_height - 1) * terrain.xyScale;
+	std::cout << "Terrain rays: " << terrain.m_height << " x " << terrain.m_width << " samples, " << rays << " segments per pattern" << std::endl;
+
+	const char *patterns[3] = { "falling", "ground-ground", "ground-air" };
+	for (int pattern = 0; pattern < 3; pattern++)
+		{ // per pattern
+		std::vector<Cartesian3> starts(rays), ends(rays), hitPoints(rays);
+		std::vector<unsigned char> hits(rays);
+		for (long ray = 0; ray < rays; ray++)
+			{ // generate segments
+			Cartesian3 a((2.0f * BenchmarkRandom() - 1.0f) * halfWidth, 0.0f, (2.0f * BenchmarkRandom() - 1.0f) * halfHeight);
+			if (pattern == 0)
+				{ // a short drop, like a lava bomb over a frame or two
+				starts[ray] = Cartesian3(a.x, 3000.0f * BenchmarkRandom(), a.z);
+				ends[ray] = starts[ray] + Cartesian3((BenchmarkRandom() - 0.5f) * 2000.0f, -1500.0f, (BenchmarkRandom() - 0.5f) * 2000.0f);
+				} // a short drop
+			else
+				{ // from a little above the ground to another point anywhere on the map,
+				// either also near the ground or up at flying height
+				Cartesian3 b((2.0f * BenchmarkRandom() - 1.0f) * halfWidth, 0.0f, (2.0f * BenchmarkRandom() - 1.0f) * halfHeight);
+				starts[ray] = Cartesian3(a.x, terrain.getHeight(a.x, a.z) + 50.0f, a.z);
+				ends[ray] = Cartesian3(b.x, pattern == 1 ? terrain.getHeight(b.x, b.z) + 50.0f : 2500.0f, b.z);
+				} // from a little above the ground
+			} // generate segments
+
+		// best of three of each
+		double walkTime = 1.0e30, pyramidTime = 1.0e30, batchTime = 1.0e30;
+		long walkHits = 0, pyramidHits = 0, disagreements = 0;
+		std::vector<float> walkParameters(rays), pyramidParameters(rays);
+		for (int pass = 0; pass < 3; pass++)
+			{ // per pass
+			walkHits = 0;
+			auto start = std::chrono::steady_clock::now();
+			for (long ray = 0; ray < rays; ray++)
+				{ // per segment
+				walkParameters[ray] = -1.0f;
+				walkHits += CellWalkIntersect(terrain, starts[ray], ends[ray], walkParameters[ray]);
+				} // per segment
+			walkTime = std::min(walkTime, MillisecondsSince(start));
+
+			pyramidHits = 0;
+			start = std::chrono::steady_clock::now();
+			for (long ray = 0; ray < rays; ray++)
+				{ // per segment
+				pyramidParameters[ray] = -1.0f;
+				pyramidHits += terrain.IntersectRay(starts[ray], ends[ray] - starts[ray], 1.0f, pyramidParameters[ray]);
+				} // per segment
+			pyramidTime = std::min(pyramidTime, MillisecondsSince(start));
+
+			start = std::chrono::steady_clock::now();
+			terrain.IntersectSegments(starts.data(), ends.data(), hitPoints.data(), hits.data(), rays);
+			batchTime = std::min(batchTime, MillisecondsSince(start));
+			} // per pass
+
+		// the two methods should find the same hits, up to rounding on cell edges
+		for (long ray = 0; ray < rays; ray++)
+			if (fabs(walkParameters[ray] - pyramidParameters[ray]) > 1.0e-3f)
+				disagreements++;
+
+		std::cout << std::fixed << std::setprecision(2)
+			<< std::setw(14) << patterns[pattern]
+			<< "  cell walk " << std::setw(9) << walkTime * 1.0e6 / rays << " ns/ray"
+			<< "  pyramid " << std::setw(9) << pyramidTime * 1.0e6 / rays << " ns/ray"
+			<< "  pyramid on " << ThreadPool::Shared().ThreadCount() << " threads " << std::setw(9) << batchTime * 1.0e6 / rays << " ns/ray"
+			<< "  hits " << pyramidHits << "/" << rays
+			<< (disagreements ? "  disagreements " + std::to_string(disagreements) : std::string()) << std::endl;
+		} // per pattern
+	std::remove(fileName.c_str());
+	return 0;
+	} // BenchmarkTerrainRays()
+
+// compares the batched vertex transform kernels against one
+// columnMajorMatrix::operator* per vertex, in vertices per second
+int BenchmarkTransform(long vertices)
+	{ // BenchmarkTransform()
+	// a view of a scaled model, as the renderer uses
+	columnMajorMatrix matrix = columnMajorMatrix::Translate(Cartesian3(120.0f, -4000.0f, 300.0f))
+		* columnMajorMatrix::RotateX(25.0f) * columnMajorMatrix::RotateZ(40.0f) * columnMajorMatrix::Scale(Cartesian3(2.0f, 2.0f, 2.0f));
+
+	// points and unit normals, in both layouts
+	std::vector<Homogeneous4> points(vertices), normals(vertices), scalarOut(vertices), batchOut(vertices);
+	std::vector<float> xs(vertices), ys(vertices), zs(vertices), outXs(vertices), outYs(vertices), outZs(vertices);
+	for (long vertex = 0; vertex < vertices; vertex++)
+		{ // generate vertices
+		points[vertex] = Homogeneous4(1000.0f * (BenchmarkRandom() - 0.5f), 1000.0f * (BenchmarkRandom() - 0.5f), 1000.0f * (BenchmarkRandom() - 0.5f), 1.0f);
+		Cartesian3 normal = Cartesian3(BenchmarkRandom() - 0.5f, BenchmarkRandom() - 0.5f, BenchmarkRandom() - 0.5f).unit();
+		normals[vertex] = Homogeneous4(normal.x, normal.y, normal.z, 0.0f);
+		xs[vertex] = points[vertex].x;
+		ys[vertex] = points[vertex].y;
+		zs[vertex] = points[vertex].z;
+		} // generate vertices
+
+	std::cout << "Vertex transform: " << vertices << " vertices, " << TransformKernelName() << " kernels" << std::endl;
+
+	// each batched kernel follows the operator* loop it is compared against
+	const char *names[5] = { "operator*", "AoS points", "operator* normals", "AoS normals", "SoA points" };
+	double scalarTimes[2] = { 1.0e30, 1.0e30 };
+	for (int kernel = 0; kernel < 5; kernel++)
+		{ // per kernel
+		bool normalKernel = kernel == 2 || kernel == 3;
+		const std::vector<Homogeneous4> &in = normalKernel ? normals : points;
+
+		// best of several runs
+		double time = 1.0e30;
+		for (int pass = 0; pass < 10; pass++)
+			{ // per pass
+			auto start = std::chrono::steady_clock::now();
+			switch (kernel)
+				{ // kernel
+				case 0: case 2:
+					for (long vertex = 0; vertex < vertices; vertex++)
+						scalarOut[vertex] = matrix * in[vertex];
+					break;
+				case 1:
+					TransformHomogeneous(matrix, in.data(), batchOut.data(), vertices);
+					break;
+				case 3:
+					TransformNormals(matrix, in.data(), batchOut.data(), vertices);
+					break;
+				case 4:
+					TransformPointsSoA(matrix, xs.data(), ys.data(), zs.data(), outXs.data(), outYs.data(), outZs.data(), vertices);
+					break;
+				} // kernel
+			time = std::min(time, MillisecondsSince(start));
+			} // per pass
+		if (kernel == 0 || kernel == 2)
+			scalarTimes[normalKernel] = time;
+
+		// and the results should agree to within rounding
+		float maxDifference = 0.0f;
+		for (long vertex = 0; vertex < vertices && kernel != 0 && kernel != 2; vertex++)
+			{ // per vertex
+			Homogeneous4 result = kernel == 4 ? Homogeneous4(outXs[vertex], outYs[vertex], outZs[vertex], 1.0f) : batchOut[vertex];
+			Homogeneous4 expected = kernel == 4 ? matrix * points[vertex] : scalarOut[vertex];
+			maxDifference = std::max(maxDifference, (float) fabs(result.x - expected.x));
+			maxDifference = std::max(maxDifference, (float) fabs(result.y - expected.y));
+			maxDifference = std::max(maxDifference, (float) fabs(result.z - expected.z));
+			} // per vertex
+
+		std::cout << std::fixed << std::setprecision(1)
+			<< "  " << std::left << std::setw(18) << names[kernel] << std::right
+			<< std::setw(9) << vertices / (time * 1000.0) << " Mvertices/s"
+			<< std::setw(7) << std::setprecision(2) << scalarTimes[normalKernel] / time << "x";
+		if (kernel != 0 && kernel != 2)
+			std::cout << "  max difference " << std::setprecision(5) << maxDifference;
+		std::cout << std::endl;
+		} // per kernel
+	return 0;
+	} // BenchmarkTransform()
+
+// steps ballistic lava bombs with one Particle object each, as the scene used to, and with
+// the structure-of-arrays system, printing the time per frame and the particles per second,
+// then times landing and launching bombs each frame with both, and trailing smoke behind them
+int BenchmarkParticles(long particles, long frames)
+	{ // BenchmarkParticles()
+	const float deltaTime = 1.0f / 60.0f;
+	columnMajorMatrix worldMatrix = columnMajorMatrix::RotateX(90.0f);
+	columnMajorMatrix viewMatrix = columnMajorMatrix::Translate(Cartesian3(0.0f, -2000.0f, -6000.0f)) * columnMajorMatrix::RotateY(30.0f);
+	static const float colour[4] = { 0.5f, 0.3f, 0.0f, 1.0f };
+
+	// the same bombs in both: thrown upwards from scattered points
+	std::vector<Particle *> objects(particles);
+	ParticleSystem system(particles);
+	for (long particle = 0; particle < particles; particle++)
+		{ // per particle
+		Cartesian3 position(20000.0f * (BenchmarkRandom() - 0.5f), 1000.0f + 2000.0f * BenchmarkRandom(), 20000.0f * (BenchmarkRandom() - 0.5f));
+		Cartesian3 velocity(200.0f * (BenchmarkRandom() - 0.5f), 300.0f * BenchmarkRandom(), 200.0f * (BenchmarkRandom() - 0.5f));
+		objects[particle] = new Particle(MeshHandle(), velocity, 2.0f, 1.0f);
+		objects[particle]->SetPosition(position);
+		objects[particle]->SetScale(1.0f);
+		system.Add(position, velocity, velocity, 1.0f, colour);
+		} // per particle
+
+	std::cout << "Particles: " << particles << " lava bombs, " << frames << " frames, " << TransformKernelName() << " kernels" << std::endl;
+
+	// the object loop does the integration and the model matrix together, so the arrays are timed both ways
+	double objectTime = 0.0, integrateTime = 0.0, matrixTime = 0.0;
+	std::vector<columnMajorMatrix> matrices;
+	for (long frame = 0; frame < frames; frame++)
+		{ // per frame
+		auto start = std::chrono::steady_clock::now();
+		for (Particle *particle : objects)
+			particle->Update(deltaTime, worldMatrix, viewMatrix);
+		objectTime += MillisecondsSince(start);
+
+		start = std::chrono::steady_clock::now();
+		system.Integrate(deltaTime);
+		integrateTime += MillisecondsSince(start);
+
+		start = std::chrono::steady_clock::now();
+		system.ModelViewMatrices(viewMatrix, worldMatrix, matrices);
+		matrixTime += MillisecondsSince(start);
+		} // per frame
+
+	// both should have the bombs in the same places, to within float rounding over the frames
+	float maxPositionDifference = 0.0f, maxMatrixDifference = 0.0f;
+	for (long particle = 0; particle < particles; particle++)
+		{ // per particle
+		Cartesian3 difference = objects[particle]->GetPosition() - system.Position(particle);
+		maxPositionDifference = std::max(maxPositionDifference, std::max(fabsf(difference.x), std::max(fabsf(difference.y), fabsf(difference.z))));
+		for (int entry = 0; entry < 16; entry++)
+			maxMatrixDifference = std::max(maxMatrixDifference, fabsf(objects[particle]->modelMatrix.coordinates[entry] - matrices[particle].coordinates[entry]));
+		} // per particle
+
+	const char *labels[3] = { "Particle objects", "SoA integrate", "SoA + matrices" };
+	double times[3] = { objectTime / frames, integrateTime / frames, (integrateTime + matrixTime) / frames };
+	for (int method = 0; method < 3; method++)
+		std::cout << std::fixed << std::setprecision(3)
+			<< "  " << std::left << std::setw(18) << labels[method] << std::right
+			<< std::setw(10) << times[method] << " ms per frame"
+			<< std::setw(10) << std::setprecision(1) << particles / (times[method] * 1000.0) << " Mparticles/s"
+			<< std::setw(8) << std::setprecision(2) << times[0] / times[method] << "x" << std::endl;
+	std::cout << std::setprecision(4) << "  max difference: position " << maxPositionDifference
+		<< ", modelview matrix " << maxMatrixDifference << std::endl;
+
+	// each frame a fiftieth of the bombs land and as many are launched: the objects are deleted
+	// and erased one at a time and made with new, as the scene used to, and the pool removes
+	// them by swap-and-pop and adds into the space it already has
+	long churn = std::max(1L, particles / 50), stride = particles / churn;
+	const float *poolData = system.positionX.data();
+	double objectChurnTime = 0.0, poolChurnTime = 0.0;
+	for (long frame = 0; frame < frames; frame++)
+		{ // per frame
+		// the same number of bombs land in both, spread evenly from a random start
+		long first = (long) (BenchmarkRandom() * stride) % stride;
+
+		auto start = std::chrono::steady_clock::now();
+		for (long landed = churn - 1; landed >= 0; landed--)
+			{ // per bomb landed
+			long particle = first + landed * stride;
+			delete objects[particle];
+			objects.erase(objects.begin() + particle);
+			} // per bomb landed
+		for (long launched = 0; launched < churn; launched++)
+			{ // per bomb launched
+			objects.push_back(new Particle(MeshHandle(), Cartesian3(0.0f, 300.0f, 0.0f), 2.0f, 1.0f));
+			objects.back()->SetScale(1.0f);
+			} // per bomb launched
+		objectChurnTime += MillisecondsSince(start);
+
+		start = std::chrono::steady_clock::now();
+		for (long landed = 0; landed < churn; landed++)
+			system.flags[first + landed * stride] |= PARTICLE_EXPIRED;
+		system.RemoveExpired();
+		for (long launched = 0; launched < churn; launched++)
+			system.Add(Cartesian3(0.0f, 1000.0f, 0.0f), Cartesian3(0.0f, 300.0f, 0.0f), Cartesian3(0.0f, 1.0f, 0.0f), 1.0f, colour);
+		poolChurnTime += MillisecondsSince(start);
+		} // per frame
+
+	for (Particle *particle : objects)
+		delete particle;
+
+	std::cout << "  " << churn << " bombs landing and launched per frame:" << std::endl;
+	const char *churnLabels[2] = { "delete + erase", "pool swap-and-pop" };
+	double churnTimes[2] = { objectChurnTime / frames, poolChurnTime / frames };
+	for (int method = 0; method < 2; method++)
+		std::cout << std::fixed << std::setprecision(3)
+			<< "  " << std::left << std::setw(18) << churnLabels[method] << std::right
+			<< std::setw(10) << churnTimes[method] << " ms per frame"
+			<< std::setw(8) << std::setprecision(2) << churnTimes[0] / churnTimes[method] << "x" << std::endl;
+	std::cout << "  pool arrays reallocated: " << (system.positionX.data() == poolData ? "no" : "yes") << std::endl;
+
+	// the smoke: the scene used to swirl each bomb's puffs with rand(), cos() and sin() every step,
+	// and now the trails put them on samples of each bomb's path, swirled from a table
+	TrailEmitter trails(particles);
+	ParticleSystem puffs(TRAIL_SAMPLES * particles);
+	for (long particle = 0; particle < system.Count(); particle++)
+		trails.Add(system.Handle(particle), system.Position(particle));
+	double swirlTime = 0.0, trailTime = 0.0;
+	for (long frame = 0; frame < frames; frame++)
+		{ // per frame
+		auto start = std::chrono::steady_clock::now();
+		puffs.Resize(TRAIL_SAMPLES * system.Count());
+		for (long bomb = 0; bomb < system.Count(); bomb++)
+			{ // per bomb
+			Cartesian3 position = system.Position(bomb), direction = system.Direction(bomb);
+			for (int puff = 0; puff < TRAIL_SAMPLES; puff++)
+				{ // per puff
+				float angle = atan2(direction.z, direction.x) - M_PI / 2.0f + (std::rand() % 360) * M_PI / 180.0f;
+				float radius = 20.0f * (puff + 1);
+				Cartesian3 puffPosition = position - direction * (puff + 1);
+				puffPosition.x += radius * cos(angle);
+				puffPosition.z += radius * sin(angle);
+				puffs.SetPosition(TRAIL_SAMPLES * bomb + puff, puffPosition);
+				puffs.SetColour(TRAIL_SAMPLES * bomb + puff, 1.0f, 1.0f, 1.0f, 1.0f);
+				puffs.scale[TRAIL_SAMPLES * bomb + puff] = 0.5f;
+				} // per puff
+			} // per bomb
+		swirlTime += MillisecondsSince(start);
+
+		start = std::chrono::steady_clock::now();
+		trails.Update(system, deltaTime);
+		trails.EmitPuffs(puffs);
+		trailTime += MillisecondsSince(start);
+		} // per frame
+
+	std::cout << "  " << TRAIL_SAMPLES << " puffs of smoke per bomb, "
+		<< TRAIL_SAMPLES * 3 * sizeof(float) + sizeof(long long) + sizeof(int) << " bytes of trail per bomb:" << std::endl;
+	const char *smokeLabels[2] = { "rand, cos and sin", "trail emitter" };
+	double smokeTimes[2] = { swirlTime / frames, trailTime / frames };
+	for (int method = 0; method < 2; method++)
+		std::cout << std::fixed << std::setprecision(3)
+			<< "  " << std::left << std::setw(18) << smokeLabels[method] << std::right
+			<< std::setw(10) << smokeTimes[method] << " ms per frame"
+			<< std::setw(8) << std::setprecision(2) << smokeTimes[0] / smokeTimes[method] << "x" << std::endl;
+	return 0;
+	} // BenchmarkParticles()
+
+// finds the touching lava bombs with the spatial hash and with the all-pairs loop the scene
+// used to have, for clouds of 1000 bombs up to largest, ten times as many each time
+int BenchmarkCollisions(long largest, long frames)
+	{ // BenchmarkCollisions()
+	const float radius = 86.0f, distance = 2.0f * radius;
+	std::cout << "Collisions: lava bombs of radius " << radius << ", about one neighbour each, " << frames << " frames" << std::endl;
+	std::cout << "     bombs     pairs  all-pairs ms   hash ms  speedup  ns per bomb" << std::endl;
+	SpatialHash hash;
+	std::vector<CollisionPair> hashPairs, allPairs;
+	for (long bombs = 1000; bombs <= largest; bombs *= 10)
+		{ // per cloud
+		// the cloud grows with the bombs, so that each has the same neighbours on average:
+		// one bomb per cube of 300 units, against a sphere of contact of 2.1e7 cubic units
+		float side = 300.0f * cbrtf((float) bombs);
+		std::vector<float> x(bombs), y(bombs), z(bombs);
+		for (long bomb = 0; bomb < bombs; bomb++)
+			{ // per bomb
+			x[bomb] = side * (BenchmarkRandom() - 0.5f) - 38500.0f;
+			y[bomb] = side * BenchmarkRandom() + 1000.0f;
+			z[bomb] = side * (BenchmarkRandom() - 0.5f) - 4000.0f;
+			} // per bomb
+
+		auto start = std::chrono::steady_clock::now();
+		for (long frame = 0; frame < frames; frame++)
+			hash.FindPairs(x.data(), y.data(), z.data(), bombs, distance, hashPairs);
+		double hashTime = MillisecondsSince(start) / frames;
+
+		// the all-pairs loop takes seconds per frame at 100000 bombs, so it is only run once
+		long allPairsFrames = bombs <= 10000 ? frames : 1;
+		start = std::chrono::steady_clock::now();
+		for (long frame = 0; frame < allPairsFrames; frame++)
+			{ // per all-pairs frame
+			allPairs.clear();
+			for (long i = 0; i < bombs; i++)
+				for (long j = i + 1; j < bombs; j++)
+					{ // per pair
+					float dx = x[i] - x[j], dy = y[i] - y[j], dz = z[i] - z[j];
+					if (dx * dx + dy * dy + dz * dz < distance * distance)
+						allPairs.push_back({ i, j });
+					} // per pair
+			} // per all-pairs frame
+		double allPairsTime = MillisecondsSince(start) / allPairsFrames;
+
+		// the hash must find exactly the same pairs, in the same order
+		bool same = hashPairs.size() == allPairs.size();
+		for (size_t pair = 0; same && pair < hashPairs.size(); pair++)
+			same = hashPairs[pair].first == allPairs[pair].first && hashPairs[pair].second == allPairs[pair].second;
+
+		std::cout << std::fixed << std::setw(10) << bombs << std::setw(10) << hashPairs.size()
+			<< std::setprecision(3) << std::setw(14) << allPairsTime << std::setw(10) << hashTime
+			<< std::setprecision(1) << std::setw(8) << allPairsTime / hashTime << "x"
+			<< std::setw(13) << hashTime * 1e6 / bombs
+			<< (same ? "" : "  PAIRS DIFFER") << std::endl;
+		if (!same)
+			return 1;
+		} // per cloud
+	return 0;
+	} // BenchmarkCollisions()
+
+// steps a cloud of lava bombs as the scene does: integration, the broadphase, each bomb's pushes
+// and the modelview matrices, on 1, 2, 4 and so on up to maxThreads threads, printing the time
+// per frame and the speedup of each, and checking every run ends with exactly the same bombs
+int BenchmarkParticleThreads(long particles, long frames, int maxThreads)
+	{ // BenchmarkParticleThreads()
+	const float deltaTime = 1.0f / 60.0f;
+	columnMajorMatrix worldMatrix = columnMajorMatrix::RotateX(90.0f);
+	columnMajorMatrix viewMatrix = columnMajorMatrix::Translate(Cartesian3(0.0f, -2000.0f, -6000.0f)) * columnMajorMatrix::RotateY(30.0f);
+	static const float colour[4] = { 0.5f, 0.3f, 0.0f, 1.0f };
+
+	// a cloud with about one neighbour per bomb, as in the collision benchmark, drifting slowly
+	ParticleSystem cloud(particles);
+	float side = 300.0f * cbrtf((float) particles);
+	for (long particle = 0; particle < particles; particle++)
+		cloud.Add(Cartesian3(side * (BenchmarkRandom() - 0.5f), side * BenchmarkRandom() + 1000.0f, side * (BenchmarkRandom() - 0.5f)),
+			Cartesian3(20.0f * (BenchmarkRandom() - 0.5f), 20.0f * BenchmarkRandom(), 20.0f * (BenchmarkRandom() - 0.5f)),
+			Cartesian3(0.0f, 1.0f, 0.0f), 1.0f, colour);
+
+	ThreadPool &threadPool = ThreadPool::Shared();
+	std::cout << "Particle threads: " << particles << " lava bombs, " << frames << " frames, "
+		<< std::thread::hardware_concurrency() << " hardware threads" << std::endl;
+	std::cout << "  threads  integrate  collide  matrices    total ms  speedup  stolen  result" << std::endl;
+	ParticleSystem first(0);
+	double firstTime = 0.0;
+	for (int threads = 1; threads <= maxThreads; threads *= 2)
+		{ // per thread count
+		threadPool.Resize(threads);
+		long stolenBefore = threadPool.StolenChunks();
+		ParticleSystem bombs = cloud;
+		SpatialHash hash;
+		std::vector<CollisionPair> pairs;
+		std::vector<long> contactStart, contacts;
+		std::vector<columnMajorMatrix> matrices;
+		double integrateTime = 0.0, collideTime = 0.0, matrixTime = 0.0;
+		for (long frame = 0; frame < frames; frame++)
+			{ // per frame
+			auto start = std::chrono::steady_clock::now();
+			bombs.Integrate(deltaTime);
+			integrateTime += MillisecondsSince(start);
+
+			// the scene's collisions: each bomb adds up its own pushes in the order of the pairs
+			start = std::chrono::steady_clock::now();
+			hash.FindPairs(bombs.positionX.data(), bombs.positionY.data(), bombs.positionZ.data(), bombs.Count(), 2.0f * bombs.collisionRadius, pairs);
+			SpatialHash::ContactLists(pairs, bombs.Count(), contactStart, contacts);
+			threadPool.ParallelFor(0, bombs.Count(), PARTICLES_PER_TASK, [&](long firstBomb, long endBomb)
+				{ // per task
+				for (long bomb = firstBomb; bomb < endBomb; bomb++)
+					{ // per bomb
+					for (long contact = contactStart[bomb]; contact < contactStart[bomb + 1]; contact++)
+						bombs.Push(bomb, (bombs.Position(bomb) - bombs.Position(contacts[contact])).unit() * 30.0f);
+					if (contactStart[bomb + 1] > contactStart[bomb])
+						bombs.SetColour(bomb, 1.0f, 0.0f, 0.0f, 1.0f);
+					} // per bomb
+				}); // per task
+			collideTime += MillisecondsSince(start);
+
+			start = std::chrono::steady_clock::now();
+			bombs.ModelViewMatrices(viewMatrix, worldMatrix, matrices);
+			matrixTime += MillisecondsSince(start);
+			} // per frame
+
+		// every run must leave every bomb in exactly the same place, at exactly the same speed
+		double time = (integrateTime + collideTime + matrixTime) / frames;
+		bool same = true;
+		if (threads == 1)
+			{ // reference run
+			first = bombs;
+			firstTime = time;
+			} // reference run
+		else
+			for (long bomb = 0; bomb < particles && same; bomb++)
+				same = memcmp(&first.positionX[bomb], &bombs.positionX[bomb], sizeof(float)) == 0
+					&& memcmp(&first.positionY[bomb], &bombs.positionY[bomb], sizeof(float)) == 0
+					&& memcmp(&first.positionZ[bomb], &bombs.positionZ[bomb], sizeof(float)) == 0
+					&& memcmp(&first.velocityX[bomb], &bombs.velocityX[bomb], sizeof(float)) == 0
+					&& memcmp(&first.velocityY[bomb], &bombs.velocityY[bomb], sizeof(float)) == 0
+					&& memcmp(&first.velocityZ[bomb], &bombs.velocityZ[bomb], sizeof(float)) == 0
+					&& first.red[bomb] == bombs.red[bomb];
+
+		std::cout << std::fixed << std::setprecision(3)
+			<< std::setw(9) << threads << std::setw(11) << integrateTime / frames << std::setw(9) << collideTime / frames
+			<< std::setw(10) << matrixTime / frames << std::setw(12) << time
+			<< std::setprecision(2) << std::setw(8) << firstTime / time << "x"
+			<< std::setw(8) << threadPool.StolenChunks() - stolenBefore
+			<< "  " << (same ? "identical" : "DIFFERS") << std::endl;
+		if (!same)
+			return 1;
+		} // per thread count
+	return 0;
+	} // BenchmarkParticleThreads()
+
+// one row of the vertex cache report
+static void PrintVertexCacheRow(const char *label, long triangles, long verticesBefore, long verticesAfter,
+	double acmrBefore, double acmrAfter, double reorderTime, long stripIndices)
+	{ // PrintVertexCacheRow()
+	std::cout << "  " << std::left << std::setw(18) << label << std::right
+		<< std::setw(9) << triangles << std::setw(9) << verticesBefore << std::setw(9) << verticesAfter
+		<< std::fixed << std::setprecision(3) << std::setw(9) << acmrBefore << std::setw(9) << acmrAfter
+		<< std::setprecision(3) << std::setw(11) << reorderTime
+		<< std::setw(10) << 3 * triangles << std::setw(10) << stripIndices << std::endl;
+	} // PrintVertexCacheRow()
+
+// reorders a copy of some indices, best of repeats, and reports the result's ACMR and strip length
+static void ReorderIndices(const std::vector<unsigned int> &indices, const std::vector<unsigned int> &nodeStarts, int repeats,
+	std::vector<unsigned int> &reordered, double &time, double &acmr, long &stripIndices)
+	{ // ReorderIndices()
+	// nodeStarts cuts the indices into pieces drawn separately, ending with indices.size()
+	time = 1.0e30;
+	for (int repeat = 0; repeat < repeats; repeat++)
+		{ // per repeat
+		reordered = indices;
+		auto start = std::chrono::steady_clock::now();
+		for (size_t piece = 0; piece + 1 < nodeStarts.size(); piece++)
+			OptimiseVertexCache(&reordered[nodeStarts[piece]], nodeStarts[piece + 1] - nodeStarts[piece]);
+		time = std::min(time, MillisecondsSince(start));
+		} // per repeat
+
+	// each piece starts with a cold cache, as it would on the card after another piece's vertices
+	double misses = 0.0;
+	std::vector<unsigned int> strip;
+	stripIndices = 0;
+	for (size_t piece = 0; piece + 1 < nodeStarts.size(); piece++)
+		{ // per piece
+		long count = nodeStarts[piece + 1] - nodeStarts[piece];
+		misses += AverageCacheMissRatio(&reordered[nodeStarts[piece]], count) * (count / 3);
+		BuildTriangleStrip(&reordered[nodeStarts[piece]], count, strip);
+		stripIndices += strip.size();
+		} // per piece
+	acmr = misses / (indices.size() / 3);
+	} // ReorderIndices()
+
+// the ACMR of indices drawn in pieces, each from a cold cache
+static double PieceCacheMissRatio(const std::vector<unsigned int> &indices, const std::vector<unsigned int> &nodeStarts)
+	{ // PieceCacheMissRatio()
+	double misses = 0.0;
+	for (size_t piece = 0; piece + 1 < nodeStarts.size(); piece++)
+		{ // per piece
+		long count = nodeStarts[piece + 1] - nodeStarts[piece];
+		misses += AverageCacheMissRatio(&indices[nodeStarts[piece]], count) * (count / 3);
+		} // per piece
+	return misses / (indices.size() / 3);
+	} // PieceCacheMissRatio()
+
+// reports the vertex cache behaviour of the ground and the models, as loaded and as reordered,
+// and of the ground chunks as the loader lays them out
+int BenchmarkVertexCache(const char *demFileName, const char *const *modelFileNames, int models)
+	{ // BenchmarkVertexCache()
+	// load everything in row and file order, and reorder copies here
+	bool wasEnabled = MeshOptimisationEnabled();
+	SetMeshOptimisationEnabled(false);
+	Terrain terrain;
+	bool loaded = terrain.ReadFileTerrainData(demFileName, 500);
+	std::vector<HomogeneousFaceSurface> meshes(models);
+	int exitCode = 0;
+	for (int model = 0; model < models; model++)
+		if (!meshes[model].ReadFileTriangleSoup(modelFileNames[model]) || meshes[model].normals.empty())
+			{ // load failed
+			std::cout << "Unable to read " << modelFileNames[model] << std::endl;
+			exitCode = 1;
+			} // load failed
+	SetMeshOptimisationEnabled(true);
+	if (!loaded)
+		{ // load failed
+		std::cout << "Unable to read " << demFileName << std::endl;
+		SetMeshOptimisationEnabled(wasEnabled);
+		return 1;
+		} // load failed
+
+	std::cout << "Vertex cache: " << MESH_OPTIMISER_CACHE_SIZE << " entry FIFO, ACMR in vertices transformed per triangle" << std::endl;
+	std::cout << "  mesh              triangles  vertices    after     ACMR    after  reorder ms      list     strip" << std::endl;
+
+	std::vector<unsigned int> reordered, wholeMesh = { 0, (unsigned int) terrain.indices.size() };
+	double time, acmr;
+	long stripIndices;
+
+	// the full grid is drawn in one piece
+	ReorderIndices(terrain.indices, wholeMesh, 5, reordered, time, acmr, stripIndices);
+	PrintVertexCacheRow("ground grid", terrain.indices.size() / 3, terrain.vertices.size(), terrain.vertices.size(),
+		AverageCacheMissRatio(terrain.indices.data(), terrain.indices.size()), acmr, time, stripIndices);
+
+	// and the quadtree one node at a time
+	std::vector<unsigned int> nodeStarts;
+	for (const TerrainQuadtreeNode &node : terrain.quadtree.nodes)
+		nodeStarts.push_back(node.firstIndex);
+	nodeStarts.push_back(terrain.quadtree.lodIndices.size());
+	ReorderIndices(terrain.quadtree.lodIndices, nodeStarts, 5, reordered, time, acmr, stripIndices);
+	PrintVertexCacheRow("ground chunks", terrain.quadtree.lodIndices.size() / 3, terrain.vertices.size(), terrain.vertices.size(),
+		PieceCacheMissRatio(terrain.quadtree.lodIndices, nodeStarts), acmr, time, stripIndices);
+
+	// the loader doesn't reorder the chunks, but lays them out in strips as it builds them,
+	// so the time here is what the strips add to building the quadtree in row order
+	TerrainQuadtree rowOrder, strips;
+	double rowTime = 1.0e30, stripTime = 1.0e30;
+	for (int repeat = 0; repeat < 5; repeat++)
+		{ // per repeat
+		SetMeshOptimisationEnabled(false);
+		auto start = std::chrono::steady_clock::now();
+		rowOrder.Build(terrain.vertices, terrain.m_width, terrain.m_height);
+		rowTime = std::min(rowTime, MillisecondsSince(start));
+		SetMeshOptimisationEnabled(true);
+		start = std::chrono::steady_clock::now();
+		strips.Build(terrain.vertices, terrain.m_width, terrain.m_height);
+		stripTime = std::min(stripTime, MillisecondsSince(start));
+		} // per repeat
+	std::vector<unsigned int> strip;
+	stripIndices = 0;
+	for (size_t piece = 0; piece + 1 < nodeStarts.size(); piece++)
+		{ // per piece
+		BuildTriangleStrip(&strips.lodIndices[nodeStarts[piece]], nodeStarts[piece + 1] - nodeStarts[piece], strip);
+		stripIndices += strip.size();
+		} // per piece
+	PrintVertexCacheRow("ground strips", strips.lodIndices.size() / 3, terrain.vertices.size(), terrain.vertices.size(),
+		PieceCacheMissRatio(rowOrder.lodIndices, nodeStarts), PieceCacheMissRatio(strips.lodIndices, nodeStarts),
+		std::max(0.0, stripTime - rowTime), stripIndices);
+
+	// the models start as triangle soups, so before is every corner its own vertex,
+	// and after is the welded mesh reordered as the loader does it
+	for (int model = 0; model < models; model++)
+		{ // per model
+		const HomogeneousFaceSurface &mesh = meshes[model];
+		if (mesh.normals.empty())
+			continue;
+		std::vector<unsigned int> soup(mesh.vertices.size()), drawnWhole = { 0, (unsigned int) mesh.drawIndices.size() };
+		for (size_t vertex = 0; vertex < soup.size(); vertex++)
+			soup[vertex] = vertex;
+		ReorderIndices(mesh.drawIndices, drawnWhole, 1000, reordered, time, acmr, stripIndices);
+
+		const char *baseName = strrchr(modelFileNames[model], '/');
+		PrintVertexCacheRow(baseName != NULL ? baseName + 1 : modelFileNames[model], mesh.normals.size(), mesh.vertices.size(),
+			mesh.drawVertices.size(), AverageCacheMissRatio(soup.data(), soup.size()), acmr, time, stripIndices);
+		} // per model
+
+	SetMeshOptimisationEnabled(wasEnabled);
+	return exitCode;
+	} // BenchmarkVertexCache()
+
+// runs the simulator without a window, stepping the scene by a fixed time per frame
+int BenchmarkFrames(long frames, int width, int height, float deltaTime, long instances, const char *captureDirectory, bool capturePNG)
+	{ // BenchmarkFrames()
+	OffscreenContext offscreen;
+	if (frames < 1 || width < 1 || height < 1 || !offscreen.Create(width, height))
+		{ // no context
+		std::cout << "Unable to create a " << width << " x " << height << " offscreen OpenGL context" << std::endl;
+		return 1;
+		} // no context
+	std::cout << "Headless: " << frames << " frames at " << width << " x " << height << ", "
+		<< deltaTime << " s per frame, " << offscreen.Description() << std::endl;
+
+	// the same scene as the window shows, with the same start position
+	SceneModel scene(0, 4000, 0);
+	scene.fixedDeltaTime = deltaTime;
+	if (instances > 0)
+		scene.StartInstanceBenchmark(instances);
+
+	// as FlightSimulatorWidget::resizeGL() does
+	glViewport(0, 0, width, height);
+	scene.SetViewport(width, height);
+	glMatrixMode(GL_PROJECTION);
+	glLoadMatrixf(scene.projectionMatrix.coordinates);
+	glMatrixMode(GL_MODELVIEW);
+	glLoadIdentity();
+
+	// declared after the context, since its pixel buffers must be deleted before the context is
+	std::unique_ptr<FrameCapture> capture;
+	if (captureDirectory != NULL)
+		capture.reset(new FrameCapture(captureDirectory, capturePNG ? FrameCapture::PNG_IMAGES : FrameCapture::PPM_IMAGES));
+
+	// CPU time of each frame's Update(), Render() and capture, and the whole frame
+	// once the driver has finished drawing it
+	std::vector<double> frameTimes(frames);
+	double updateTotal = 0.0, renderTotal = 0.0, captureTotal = 0.0;
+	std::cout << "frame\tupdate ms\trender ms\tcapture ms\tframe ms\tdrawn\tculled\tdraws\tstate changes" << std::endl;
+	auto runStart = std::chrono::steady_clock::now();
+	for (long frame = 0; frame < frames; frame++)
+		{ // per frame
+		auto frameStart = std::chrono::steady_clock::now();
+		scene.Update();
+		double update = MillisecondsSince(frameStart);
+		auto renderStart = std::chrono::steady_clock::now();
+		scene.Render();
+		double render = MillisecondsSince(renderStart);
+		auto captureStart = std::chrono::steady_clock::now();
+		if (capture)
+			capture->Capture();
+		double captured = MillisecondsSince(captureStart);
+		glFinish();
+		frameTimes[frame] = MillisecondsSince(frameStart);
+		updateTotal += update;
+		renderTotal += render;
+		captureTotal += captured;
+
+		std::cout << std::fixed << std::setprecision(3) << frame << "\t" << update << "\t" << render << "\t" << captured << "\t" << frameTimes[frame]
+			<< "\t" << scene.objectsDrawn << "\t" << scene.objectsCulled << "\t" << scene.renderQueue.drawCalls
+			<< "\t" << scene.glState.changes << std::endl;
+
+		// a crash ends the scene, and the run with it
+		if (scene.GameOverDrawn())
+			{ // game over
+			std::cout << "The player crashed, ending the run after " << frame + 1 << " frames" << std::endl;
+			frames = frame + 1;
+			frameTimes.resize(frames);
+			break;
+			} // game over
+		} // per frame
+	double runTime = MillisecondsSince(runStart);
+	// the frames still in the ring, and the writer's backlog, aren't part of the frame loop
+	if (capture)
+		capture->Finish();
+
+	// the spread of frame times matters as much as the mean
+	std::vector<double> sorted = frameTimes;
+	std::sort(sorted.begin(), sorted.end());
+	std::cout << std::setprecision(3) << "Frames: mean " << runTime / frames << " ms (update " << updateTotal / frames
+		<< " ms, render " << renderTotal / frames << " ms, capture " << captureTotal / frames << " ms), median " << sorted[frames / 2]
+		<< " ms, 95th percentile " << sorted[(frames * 95) / 100] << " ms, worst " << sorted.back() << " ms" << std::endl;
+	std::cout << std::setprecision(1) << "Throughput: " << frames * 1000.0 / runTime << " frames per second, "
+		<< frames * deltaTime << " s of scene time" << std::endl;
+	return 0;
+	} // BenchmarkFrames()
@@ -0,0 +1,68 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	Benchmarks.h
+//	------------------------
+//
+//	Command-line benchmarks for the performance
+//	sensitive parts of the simulator.  These run
+//	without a window and print their timings.
+//
+///////////////////////////////////////////////////
+
+#ifndef _BENCHMARKS_H
+#define _BENCHMARKS_H
+
+// compares loading a text .dem against the binary heightfield format
+// returns a process exit code
+int BenchmarkTerrainLoad(const char *demFileName, int repeats);
+
+// compares getHeight on the contiguous grid against the old vector-of-rows
+// storage, for random and spatially coherent queries
+int BenchmarkTerrainHeight(long gridSize, long queries);
+
+// compares getHeightBatch against one getHeight call per point
+int BenchmarkTerrainBatch(const char *demFileName, long points);
+
+// flies across a synthetic streamed world, timing the frame thread's share
+// of the streaming and counting the height queries that found no tile
+int BenchmarkTerrainStreaming(long gridSize, long tileSize, long frames);
+
+// loads a synthetic terrain on one thread and on the whole pool, printing
+// the time of each load phase; threads of 0 means one per core
+int BenchmarkTerrainBuild(long gridSize, int threads);
+
+// compares segment queries through the height pyramid against walking the
+// cells under each segment
+int BenchmarkTerrainRays(long gridSize, long rays);
+
+// compares the batched vertex transform kernels against one
+// columnMajorMatrix::operator* per vertex, in vertices per second
+int BenchmarkTransform(long vertices);
+
+// steps ballistic lava bombs with one Particle object each and with the structure-of-arrays
+// ParticleSystem, printing the time per frame of each and how far their results differ,
+// then the time to land and launch a fiftieth of the bombs each frame with each, and to
+// place their smoke as the scene used to and with the trail emitter
+int BenchmarkParticles(long particles, long frames);
+
+// finds the touching pairs in clouds of 1000 lava bombs up to largest, ten times as many each
+// time, with the spatial hash and with an all-pairs loop, printing the time per frame of each
+int BenchmarkCollisions(long largest, long frames);
+
+// steps a cloud of lava bombs as the scene does on 1, 2, 4 and so on up to maxThreads threads,
+// printing the time per frame of each and checking that every run gives the same result
+int BenchmarkParticleThreads(long particles, long frames, int maxThreads);
+
+// reports, for the ground and for each model, the vertices it needs and its average
+// cache miss ratio as loaded and reordered for the vertex cache, the time to reorder,
+// and the length of its indices as a list and as a strip
+int BenchmarkVertexCache(const char *demFileName, const char *const *modelFileNames, int models);
+
+// draws frames of the simulator into a width x height offscreen context, each
+// advancing the scene by deltaTime seconds, printing the CPU time of each frame
+// and the throughput; instances adds the instancing benchmark's lava bombs
+// captureDirectory, if not NULL, saves every frame there as a PPM or PNG image
+int BenchmarkFrames(long frames, int width, int height, float deltaTime, long instances, const char *captureDirectory, bool capturePNG);
+
+#endif
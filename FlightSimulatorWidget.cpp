@@ -24,7 +24,8 @@
 // constructor
 FlightSimulatorWidget::FlightSimulatorWidget(QWidget *parent, SceneModel *TheScene)
 	: _GEOMETRIC_WIDGET_PARENT_CLASS(parent),
-	theScene(TheScene)
+	theScene(TheScene),
+	capture(NULL)
 	{ // constructor
 	// we want to create a timer for forcing animation
 	animationTimer = new QTimer(this);
@@ -37,12 +38,46 @@ FlightSimulatorWidget::FlightSimulatorWidget(QWidget *parent, SceneModel *TheSce
 // destructor
 FlightSimulatorWidget::~FlightSimulatorWidget()
 	{ // destructor
-	// nothing yet
+	StopCapture();
 	} // destructor																	
 
+// saves every frame painted from now on as an image in directory
+void FlightSimulatorWidget::StartCapture(const std::string &directory, FrameCapture::ImageFormat format)
+	{ // StartCapture()
+	StopCapture();
+	// the capture only touches OpenGL when a frame is painted, so needn't wait for the context
+	capture = new FrameCapture(directory, format);
+	} // StartCapture()
+
+// saves the frames still on their way, and stops
+void FlightSimulatorWidget::StopCapture()
+	{ // StopCapture()
+	if (capture == NULL)
+		return;
+	// the last frames are still in pixel buffers, which need the context
+	makeCurrent();
+	delete capture;
+	capture = NULL;
+	doneCurrent();
+	} // StopCapture()
+
+// stops the scene's threads and the capture, then exits
+void FlightSimulatorWidget::Quit()
+	{ // Quit()
+	// exit() skips the destructors of the scene and this widget, which live on main()'s stack,
+	// so stop the simulation and the tile loader, and finish writing the frames first; it does run
+	// the destructors of statics such as the mesh cache and the thread pool, which is safe once
+	// none of those threads is left
+	theScene->Shutdown();
+	StopCapture();
+	exit(0);
+	} // Quit()
+
 // called when OpenGL context is set up
 void FlightSimulatorWidget::initializeGL()
 	{ // FlightSimulatorWidget::initializeGL()
+	// a new context starts from OpenGL's defaults, not whatever the scene last set
+	theScene->glState.Invalidate();
 	} // FlightSimulatorWidget::initializeGL()
 
 // called every time the widget is resized
@@ -55,12 +90,9 @@ void FlightSimulatorWidget::resizeGL(int w, int h)
 	glMatrixMode(GL_PROJECTION);
 	glLoadIdentity();
 	
-	// compute the aspect ratio of the widget
-	float aspectRatio = (float) w / (float) h;
-	
-	// we want a 90 degree vertical field of view, as wide as the window allows
-	// and we want to see from just in front of us to 100km away
-	gluPerspective(90.0, aspectRatio, 1, 100000);
+	// the scene builds the projection, since it also culls against it
+	theScene->SetViewport(w, h);
+	glLoadMatrixf(theScene->projectionMatrix.coordinates);
 
 	// set model view matrix
 	glMatrixMode(GL_MODELVIEW);
@@ -73,12 +105,17 @@ void FlightSimulatorWidget::paintGL()
 	{ // FlightSimulatorWidget::paintGL()
 	// call the scene to render itself
 	theScene->Render();
+
+	// start reading the frame back, while the context is still current
+	if (capture != NULL)
+		capture->Capture();
 	} // FlightSimulatorWidget::paintGL()
 
 // called when a key is pressed
 void FlightSimulatorWidget::keyPressEvent(QKeyEvent *event)
 	{ // keyPressEvent()
 	// just do a big switch statement
+	// the controls are queued, since the simulation may be running on its own thread
 	switch (event->key())
 		{ // end of key switch
 		// we will use the official QT codes, even though they're mostly just ASCII
@@ -87,34 +124,34 @@ void FlightSimulatorWidget::keyPressEvent(QKeyEvent *event)
 		// 	theScene->m_player->Forward();
 		// 	break;
 		case Qt::Key_D: // Press D to yaw to the right
-			theScene->m_player->YawRight();
+			theScene->QueueInput(YAW_RIGHT);
 			break;
 		case Qt::Key_W: // Press W to yaw to the left
-			theScene->m_player->YawLeft();
+			theScene->QueueInput(YAW_LEFT);
 			break;
 		case Qt::Key_S: // Press S to pitch down
-			theScene->m_player->PitchDown();
+			theScene->QueueInput(PITCH_DOWN);
 			break;
 		case Qt::Key_A: // Press A to pitch up
-			theScene->m_player->PitchUp();
+			theScene->QueueInput(PITCH_UP);
 			break;
 		case Qt::Key_Q: // Press Q to roll left
-			theScene->m_player->RollLeft();
+			theScene->QueueInput(ROLL_LEFT);
 			break;
 		case Qt::Key_E: // Press E to roll to the right
-			theScene->m_player->RollRight();
+			theScene->QueueInput(ROLL_RIGHT);
 			break;
 		case Qt::Key_Plus: // Press plus button or shift and plus to increase speed
-			theScene->m_player->IncreaseSpeed();
+			theScene->QueueInput(SPEED_UP);
 			break;
 		case Qt::Key_Minus: // Press minus button to reduce speed
-			theScene->m_player->DecreaseSpeed();
+			theScene->QueueInput(SLOW_DOWN);
 			break;
 		case Qt::Key_V: // Pres V to change camera
-			theScene->SwitchCamera();
+			theScene->QueueInput(SWITCH_CAMERA);
 			break;
 		case Qt::Key_X:
-			exit(0);
+			Quit();
 			break;
 		default:
 			break;
@@ -126,8 +163,17 @@ void FlightSimulatorWidget::keyPressEvent(QKeyEvent *event)
 
 void FlightSimulatorWidget::nextFrame()
 	{ // nextFrame()
+	// once the crash has been drawn, quit here on the window's thread, which is not drawing now
+	if (theScene->GameOverDrawn())
+		{ // game over
+		Quit();
+		return;
+		} // game over
+
 	// each time this gets called, we will update the plane's position
-	theScene->Update();
+	// unless the simulation has a thread of its own, in which case we just draw its latest step
+	if (!theScene->SimulationThreaded())
+		theScene->Update();
 	// now force an update
 	update();
 	} // nextFrame()
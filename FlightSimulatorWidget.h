@@ -30,6 +30,7 @@
 #include <QMouseEvent>
 
 #include "SceneModel.h"
+#include "FrameCapture.h"
 
 class FlightSimulatorWidget : public _GEOMETRIC_WIDGET_PARENT_CLASS										
 	{ // class FlightSimulatorWidget
@@ -41,11 +42,22 @@ class FlightSimulatorWidget : public _GEOMETRIC_WIDGET_PARENT_CLASS
 	// a timer for animation
 	QTimer *animationTimer;
 
+	// saves each frame as it is painted, or NULL if not capturing
+	FrameCapture *capture;
+
 	// constructor
 	FlightSimulatorWidget(QWidget *parent, SceneModel *TheScene);
 	
 	// destructor
 	~FlightSimulatorWidget();
+
+	// saves every frame painted from now on as an image in directory
+	void StartCapture(const std::string &directory, FrameCapture::ImageFormat format);
+	// saves the frames still on their way, and stops
+	void StopCapture();
+
+	// stops the simulation and the capture, then exits: only ever called on the window's thread
+	void Quit();
 			
 	protected:
 	// called when OpenGL context is set up
@@ -0,0 +1,288 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	FrameCapture.cpp
+//	------------------------
+//
+//	Saves every rendered frame to a numbered image
+//	file without stalling the frame loop.  Reading
+//	into a pixel buffer object only queues a copy
+//	on the card, so glReadPixels() returns at once,
+//	and by the time the buffer is mapped again the
+//	copy is done and the map doesn't wait either.
+//	Where there are no pixel buffers, the frame is
+//	read straight into memory, which does stall.
+//
+///////////////////////////////////////////////////
+
+// the pixel buffer functions are core in 2.1, but only declared by glext.h,
+// and only if this comes before anything includes gl.h
+#define GL_GLEXT_PROTOTYPES
+#include "FrameCapture.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include <QImage>
+#include <QString>
+
+#ifdef __APPLE__
+#include <OpenGL/gl.h>
+#else
+#include <GL/gl.h>
+#include <GL/glext.h>
+#endif
+
+// milliseconds from a time to now
+static double MillisecondsSince(std::chrono::steady_clock::time_point start)
+	{ // MillisecondsSince()
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	} // MillisecondsSince()
+
+// starts the writer thread
+FrameCapture::FrameCapture(const std::string &Directory, ImageFormat Format)
+	:
+	framesCaptured(0),
+	framesWritten(0),
+	framesDropped(0),
+	directory(Directory),
+	format(Format),
+	pixelBuffers(false),
+	contextChecked(false),
+	nextFrame(0),
+	writing(false),
+	stopping(false),
+	latencyTotal(0.0),
+	latencyWorst(0.0)
+	{ // constructor
+	for (int slot = 0; slot < FRAME_CAPTURE_RING; slot++)
+		{ // per slot
+		ring[slot].buffer = 0;
+		ring[slot].bytes = 0;
+		ring[slot].number = -1;
+		ring[slot].width = ring[slot].height = 0;
+		} // per slot
+	writer = std::thread(&FrameCapture::WriterLoop, this);
+	} // constructor
+
+// destructor finishes, so the context must be current
+FrameCapture::~FrameCapture()
+	{ // destructor
+	Finish();
+	} // destructor
+
+// starts reading back the frame just drawn, and passes on the one read FRAME_CAPTURE_RING frames ago
+void FrameCapture::Capture()
+	{ // Capture()
+	if (!writer.joinable())
+		return;
+
+	if (!contextChecked)
+		{ // first frame
+		// pixel buffers are core from 2.1; the version string starts major.minor
+		const char *version = (const char *) glGetString(GL_VERSION);
+		int major = 0, minor = 0;
+		if (version != NULL)
+			sscanf(version, "%d.%d", &major, &minor);
+		pixelBuffers = major > 2 || (major == 2 && minor >= 1);
+		if (pixelBuffers)
+			for (int slot = 0; slot < FRAME_CAPTURE_RING; slot++)
+				glGenBuffers(1, &ring[slot].buffer);
+		contextChecked = true;
+		} // first frame
+
+	// the slot's last frame was read back FRAME_CAPTURE_RING frames ago, so is long finished
+	ReadbackSlot &slot = ring[nextFrame % FRAME_CAPTURE_RING];
+	if (slot.number >= 0)
+		PassOn(slot, false);
+
+	// the whole viewport, which is the whole window
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	slot.number = nextFrame++;
+	slot.width = viewport[2];
+	slot.height = viewport[3];
+	slot.issued = std::chrono::steady_clock::now();
+	size_t bytes = (size_t) slot.width * slot.height * 3;
+
+	// tightly packed RGB rows, which is what both file formats want
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	if (pixelBuffers)
+		{ // asynchronous read
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+		if (slot.bytes != bytes)
+			{ // window resized
+			glBufferData(GL_PIXEL_PACK_BUFFER, bytes, NULL, GL_STREAM_READ);
+			slot.bytes = bytes;
+			} // window resized
+		glReadPixels(viewport[0], viewport[1], slot.width, slot.height, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		} // asynchronous read
+	else
+		{ // synchronous read
+		slot.pixels.resize(bytes);
+		glReadPixels(viewport[0], viewport[1], slot.width, slot.height, GL_RGB, GL_UNSIGNED_BYTE, slot.pixels.data());
+		} // synchronous read
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	framesCaptured++;
+	} // Capture()
+
+// copies a slot's pixels out and queues them for the writer, or drops them
+void FrameCapture::PassOn(ReadbackSlot &slot, bool wait)
+	{ // PassOn()
+	CapturedFrame frame;
+	frame.number = slot.number;
+	frame.width = slot.width;
+	frame.height = slot.height;
+	frame.issued = slot.issued;
+	slot.number = -1;
+
+	{ // take a spare array
+	std::unique_lock<std::mutex> lock(mutex);
+	if (wait)
+		idle.wait(lock, [this] { return queue.size() < FRAME_CAPTURE_QUEUE; });
+	else if (queue.size() >= FRAME_CAPTURE_QUEUE)
+		{ // writer too far behind
+		// the buffer needn't be mapped at all: the next glBufferData() or glReadPixels() replaces it
+		framesDropped++;
+		return;
+		} // writer too far behind
+	if (!spares.empty())
+		{ // reuse one
+		frame.pixels.swap(spares.back());
+		spares.pop_back();
+		} // reuse one
+	} // take a spare array
+
+	size_t bytes = (size_t) frame.width * frame.height * 3;
+	if (pixelBuffers)
+		{ // map the buffer
+		frame.pixels.resize(bytes);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+		const void *data = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+		if (data != NULL)
+			memcpy(frame.pixels.data(), data, bytes);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		if (data == NULL)
+			{ // map failed
+			std::lock_guard<std::mutex> lock(mutex);
+			framesDropped++;
+			spares.push_back(std::move(frame.pixels));
+			return;
+			} // map failed
+		} // map the buffer
+	else
+		// the slot's array already holds the frame, and takes the spare in its place
+		frame.pixels.swap(slot.pixels);
+
+	{ // hand it over
+	std::lock_guard<std::mutex> lock(mutex);
+	queue.push_back(std::move(frame));
+	} // hand it over
+	wake.notify_one();
+	} // PassOn()
+
+// the writer thread: saves frames until told to stop
+void FrameCapture::WriterLoop()
+	{ // WriterLoop()
+	while (true)
+		{ // per frame
+		CapturedFrame frame;
+		{ // wait for a frame
+		std::unique_lock<std::mutex> lock(mutex);
+		wake.wait(lock, [this] { return stopping || !queue.empty(); });
+		if (queue.empty())
+			return;
+		frame = std::move(queue.front());
+		queue.pop_front();
+		writing = true;
+		} // wait for a frame
+
+		bool written = Write(frame);
+		double latency = MillisecondsSince(frame.issued);
+
+		{ // record it
+		std::lock_guard<std::mutex> lock(mutex);
+		if (written)
+			{ // saved
+			framesWritten++;
+			latencyTotal += latency;
+			latencyWorst = std::max(latencyWorst, latency);
+			} // saved
+		spares.push_back(std::move(frame.pixels));
+		writing = false;
+		} // record it
+		idle.notify_all();
+		} // per frame
+	} // WriterLoop()
+
+// saves one frame
+bool FrameCapture::Write(const CapturedFrame &frame) const
+	{ // Write()
+	char fileName[32];
+	snprintf(fileName, sizeof(fileName), "/frame_%06ld.%s", frame.number, format == PNG_IMAGES ? "png" : "ppm");
+	std::string path = directory + fileName;
+	size_t rowBytes = (size_t) frame.width * 3;
+
+	if (format == PNG_IMAGES)
+		{ // PNG
+		// Qt encodes it; the image only wraps the pixels, and mirrored() makes the top-down copy
+		QImage image(frame.pixels.data(), frame.width, frame.height, (int) rowBytes, QImage::Format_RGB888);
+		if (!image.mirrored(false, true).save(QString::fromStdString(path), "PNG"))
+			{ // save failed
+			std::cout << "Unable to write " << path << std::endl;
+			return false;
+			} // save failed
+		return true;
+		} // PNG
+
+	// binary PPM: a text header, then the rows from the top down
+	FILE *outFile = fopen(path.c_str(), "wb");
+	if (outFile == NULL)
+		{ // open failed
+		std::cout << "Unable to write " << path << std::endl;
+		return false;
+		} // open failed
+	fprintf(outFile, "P6\n%d %d\n255\n", frame.width, frame.height);
+	bool written = true;
+	for (int row = frame.height - 1; row >= 0 && written; row--)
+		written = fwrite(frame.pixels.data() + row * rowBytes, 1, rowBytes, outFile) == rowBytes;
+	written = fclose(outFile) == 0 && written;
+	if (!written)
+		std::cout << "Unable to write " << path << std::endl;
+	return written;
+	} // Write()
+
+// passes on the frames still in the ring, waits for the writer, and prints the counts
+void FrameCapture::Finish()
+	{ // Finish()
+	if (!writer.joinable())
+		return;
+
+	// oldest first, and waiting for room rather than dropping, since the frame loop is over
+	for (int offset = 0; offset < FRAME_CAPTURE_RING; offset++)
+		{ // per slot
+		ReadbackSlot &slot = ring[(nextFrame + offset) % FRAME_CAPTURE_RING];
+		if (slot.number >= 0)
+			PassOn(slot, true);
+		} // per slot
+	if (pixelBuffers)
+		for (int slot = 0; slot < FRAME_CAPTURE_RING; slot++)
+			glDeleteBuffers(1, &ring[slot].buffer);
+
+	{ // let the writer empty the queue and stop
+	std::lock_guard<std::mutex> lock(mutex);
+	stopping = true;
+	} // let the writer empty the queue and stop
+	wake.notify_all();
+	writer.join();
+
+	std::cout << "Captured " << framesCaptured << " frames to " << directory << ": " << framesWritten << " written, "
+		<< framesDropped << " dropped" << (pixelBuffers ? "" : " (no pixel buffers, so reads stalled)") << std::endl;
+	if (framesWritten > 0)
+		std::cout << "Capture latency from readback to file: mean " << latencyTotal / framesWritten
+			<< " ms, worst " << latencyWorst << " ms" << std::endl;
+	} // Finish()
@@ -0,0 +1,120 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	FrameCapture.h
+//	------------------------
+//
+//	Saves every rendered frame to a numbered image
+//	file without stalling the frame loop.  Each
+//	frame is read back into one of a ring of pixel
+//	buffer objects, and mapped a few frames later,
+//	once the card has long finished with it.  The
+//	pixels are then handed to a writer thread that
+//	encodes and saves them.  If the writer falls
+//	too far behind, frames are dropped rather than
+//	waited for, and counted.
+//
+///////////////////////////////////////////////////
+
+#ifndef _FRAME_CAPTURE_H
+#define _FRAME_CAPTURE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// frames read back but not yet mapped
+#define FRAME_CAPTURE_RING 3
+// frames mapped but not yet written, beyond which frames are dropped
+#define FRAME_CAPTURE_QUEUE 8
+
+class FrameCapture
+	{ // class FrameCapture
+	public:
+	// file format of the images
+	enum ImageFormat { PPM_IMAGES, PNG_IMAGES };
+
+	// counters since construction
+	long framesCaptured, framesWritten, framesDropped;
+
+	// starts the writer thread; images are saved as directory/frame_NNNNNN.ppm or .png
+	// the directory must already exist
+	FrameCapture(const std::string &Directory, ImageFormat Format);
+	// destructor finishes, so the context must be current
+	~FrameCapture();
+
+	// starts reading back the frame just drawn, and passes on the one read
+	// FRAME_CAPTURE_RING frames ago; must be called with the context current
+	void Capture();
+
+	// passes on the frames still in the ring, waits for the writer to save
+	// everything, and prints the latency and drop counts
+	// must be called with the context current
+	void Finish();
+
+	private:
+	// no copies: there is only one writer thread
+	FrameCapture(const FrameCapture &other);
+	FrameCapture &operator =(const FrameCapture &other);
+
+	// a frame on its way to disk
+	struct CapturedFrame
+		{ // struct CapturedFrame
+		long number;
+		int width, height;
+		// rows bottom to top, as OpenGL reads them, in RGB
+		std::vector<unsigned char> pixels;
+		// when Capture() started reading it back
+		std::chrono::steady_clock::time_point issued;
+		}; // struct CapturedFrame
+
+	// one slot of the ring
+	struct ReadbackSlot
+		{ // struct ReadbackSlot
+		// the pixel buffer, or 0 if pixel buffers are unavailable
+		unsigned int buffer;
+		// bytes allocated for the pixel buffer
+		size_t bytes;
+		// the frame in it, or -1 if empty
+		long number;
+		int width, height;
+		std::chrono::steady_clock::time_point issued;
+		// the pixels themselves, where there is no pixel buffer
+		std::vector<unsigned char> pixels;
+		}; // struct ReadbackSlot
+
+	// copies a slot's pixels out and queues them for the writer, or drops them
+	// if the writer is too far behind, unless wait is set
+	void PassOn(ReadbackSlot &slot, bool wait);
+
+	// the writer thread: saves frames until told to stop
+	void WriterLoop();
+
+	// saves one frame
+	bool Write(const CapturedFrame &frame) const;
+
+	std::string directory;
+	ImageFormat format;
+
+	// true once the context is known to have pixel buffers (2.1 or later)
+	bool pixelBuffers, contextChecked;
+	ReadbackSlot ring[FRAME_CAPTURE_RING];
+	long nextFrame;
+
+	// frames for the writer, and spare pixel arrays so that the frame loop doesn't allocate
+	std::mutex mutex;
+	std::condition_variable wake, idle;
+	std::deque<CapturedFrame> queue;
+	std::vector<std::vector<unsigned char> > spares;
+	bool writing, stopping;
+	std::thread writer;
+
+	// time from readback to the file being written, in milliseconds
+	double latencyTotal, latencyWorst;
+	}; // class FrameCapture
+
+#endif
@@ -0,0 +1,68 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	FrameSnapshot.h
+//	------------------------
+//
+//	Everything needed to draw one step of the
+//	simulation: the camera, each plane and lava
+//	bomb as a model with a modelview matrix and a
+//	colour, the streamed ground tiles, and the
+//	heights of the ground edited since the last
+//	snapshot drawn.  The simulation writes these
+//	and the renderer only reads them, so the two
+//	can run on different threads.
+//
+///////////////////////////////////////////////////
+
+#ifndef _FRAME_SNAPSHOT_H
+#define _FRAME_SNAPSHOT_H
+
+#include <vector>
+
+#include "HomogeneousFaceSurface.h"
+#include "Matrix4.h"
+#include "Terrain.h"
+#include "TerrainStreamer.h"
+
+// one object to draw
+struct SnapshotObject
+	{ // struct SnapshotObject
+	// one of the scene's shared models, which outlive every snapshot
+	const HomogeneousFaceSurface *mesh;
+	// the view is already applied
+	columnMajorMatrix modelViewMatrix;
+	float colour[4];
+	}; // struct SnapshotObject
+
+struct FrameSnapshot
+	{ // struct FrameSnapshot
+	// the simulation step that wrote it, counting from 1
+	long step;
+
+	// the camera's view matrix
+	columnMajorMatrix viewMatrix;
+
+	// the planes and lava bombs, including any that are out of view
+	std::vector<SnapshotObject> objects;
+
+	// the current heights of the ground edited since the last snapshot, and of the edits in any
+	// snapshot the renderer skipped, to apply to the mesh before drawing
+	// the regions never overlap, so the order does not matter
+	std::vector<TerrainPatch> terrainPatches;
+
+	// when the ground is streamed, the tiles loaded, and the current heights edited in them,
+	// gathered in the same way as terrainPatches
+	std::vector<StreamedTile> groundTiles;
+	std::vector<StreamedTilePatch> groundTilePatches;
+
+	// set on the last step, when the player has crashed: the window quits once it has drawn it
+	bool gameOver;
+
+	// constructor will initialise to an empty snapshot
+	FrameSnapshot()
+		: step(0), gameOver(false)
+		{}
+	}; // struct FrameSnapshot
+
+#endif
@@ -0,0 +1,82 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	Frustum.cpp
+//	------------------------
+//
+//	The six clipping planes of a view frustum,
+//	extracted from a projection * modelview matrix,
+//	for culling bounding boxes and spheres.
+//
+///////////////////////////////////////////////////
+
+#include "Frustum.h"
+#include <math.h>
+
+// constructor gives a frustum that contains everything
+Frustum::Frustum()
+	{ // constructor
+	// a plane with zero normal and positive offset accepts every point
+	for (int plane = 0; plane < 6; plane++)
+		planes[plane] = Homogeneous4(0.0, 0.0, 0.0, 1.0);
+	} // constructor
+
+// extracts the planes from a combined projection * modelview matrix
+// each plane is a sum or difference of the fourth row and one other row
+// (Gribb & Hartmann, "Fast Extraction of Viewing Frustum Planes")
+Frustum Frustum::FromMatrix(const columnMajorMatrix &clipMatrix)
+	{ // FromMatrix()
+	// rows of a column-major matrix are strided by 4
+	const float *m = clipMatrix.coordinates;
+	Homogeneous4 rows[4];
+	for (int row = 0; row < 4; row++)
+		rows[row] = Homogeneous4(m[row], m[4 + row], m[8 + row], m[12 + row]);
+
+	Frustum frustum;
+	frustum.planes[0] = rows[3] + rows[0];
+	frustum.planes[1] = rows[3] - rows[0];
+	frustum.planes[2] = rows[3] + rows[1];
+	frustum.planes[3] = rows[3] - rows[1];
+	frustum.planes[4] = rows[3] + rows[2];
+	frustum.planes[5] = rows[3] - rows[2];
+
+	// normalise so that sphere radii can be compared with plane distances
+	for (int plane = 0; plane < 6; plane++)
+		{ // per plane
+		float length = sqrt(frustum.planes[plane].x * frustum.planes[plane].x
+						+ frustum.planes[plane].y * frustum.planes[plane].y
+						+ frustum.planes[plane].z * frustum.planes[plane].z);
+		if (length > 0.0f)
+			frustum.planes[plane] = frustum.planes[plane] / length;
+		} // per plane
+	return frustum;
+	} // FromMatrix()
+
+// true unless the axis-aligned box is entirely outside one of the planes
+bool Frustum::IntersectsBox(const Cartesian3 &minCorner, const Cartesian3 &maxCorner) const
+	{ // IntersectsBox()
+	for (int plane = 0; plane < 6; plane++)
+		{ // per plane
+		// the corner furthest along the plane normal
+		const Homogeneous4 &p = planes[plane];
+		float x = p.x >= 0.0f ? maxCorner.x : minCorner.x;
+		float y = p.y >= 0.0f ? maxCorner.y : minCorner.y;
+		float z = p.z >= 0.0f ? maxCorner.z : minCorner.z;
+		// if even that is outside, the whole box is
+		if (p.x * x + p.y * y + p.z * z + p.w < 0.0f)
+			return false;
+		} // per plane
+	return true;
+	} // IntersectsBox()
+
+// true unless the sphere is entirely outside one of the planes
+bool Frustum::IntersectsSphere(const Cartesian3 &centre, float radius) const
+	{ // IntersectsSphere()
+	for (int plane = 0; plane < 6; plane++)
+		{ // per plane
+		const Homogeneous4 &p = planes[plane];
+		if (p.x * centre.x + p.y * centre.y + p.z * centre.z + p.w < -radius)
+			return false;
+		} // per plane
+	return true;
+	} // IntersectsSphere()
@@ -0,0 +1,41 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	Frustum.h
+//	------------------------
+//
+//	The six clipping planes of a view frustum,
+//	extracted from a projection * modelview matrix,
+//	for culling bounding boxes and spheres.
+//
+///////////////////////////////////////////////////
+
+#ifndef _FRUSTUM_H
+#define _FRUSTUM_H
+
+#include "Cartesian3.h"
+#include "Homogeneous4.h"
+#include "Matrix4.h"
+
+class Frustum
+	{ // class Frustum
+	public:
+	// planes as (a, b, c, d) with a x + b y + c z + d >= 0 inside
+	// in the order left, right, bottom, top, near, far
+	Homogeneous4 planes[6];
+
+	// constructor gives a frustum that contains everything
+	Frustum();
+
+	// extracts the planes from a combined projection * modelview matrix
+	// the planes are then in the coordinate system the modelview starts from
+	static Frustum FromMatrix(const columnMajorMatrix &clipMatrix);
+
+	// true unless the axis-aligned box is entirely outside one of the planes
+	bool IntersectsBox(const Cartesian3 &minCorner, const Cartesian3 &maxCorner) const;
+
+	// true unless the sphere is entirely outside one of the planes
+	bool IntersectsSphere(const Cartesian3 &centre, float radius) const;
+	}; // class Frustum
+
+#endif
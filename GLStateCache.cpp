@@ -0,0 +1,112 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	GLStateCache.cpp
+//	------------------------
+//
+//	Remembers the fixed-function state the scene
+//	last set, so that setting it again to the same
+//	value never reaches OpenGL.  Software drivers
+//	revalidate the pipeline on every change, even
+//	a redundant one.  The cache only knows what was
+//	set through it: call Invalidate() whenever the
+//	context is new or other code may have changed
+//	the same state.
+//
+///////////////////////////////////////////////////
+
+#include "GLStateCache.h"
+
+// the capabilities Enable() caches, in the order of GLStateCache::capabilities
+static const GLenum cachedCapabilities[GL_STATE_CACHE_CAPABILITIES] = { GL_DEPTH_TEST, GL_LIGHTING, GL_LIGHT0, GL_NORMALIZE };
+
+// constructor will initialise to knowing nothing
+GLStateCache::GLStateCache()
+	:
+	changes(0),
+	redundant(0)
+	{ // constructor
+	Invalidate();
+	} // constructor
+
+// forgets all the state, so that the next call of each kind reaches OpenGL
+void GLStateCache::Invalidate()
+	{ // Invalidate()
+	for (int capability = 0; capability < GL_STATE_CACHE_CAPABILITIES; capability++)
+		capabilities[capability] = -1;
+	shadeModel = 0;
+	for (int slot = 0; slot < 3; slot++)
+		materialKnown[slot] = lightKnown[slot] = false;
+	} // Invalidate()
+
+// zeroes the change counts, once a frame
+void GLStateCache::ResetCounts()
+	{ // ResetCounts()
+	changes = redundant = 0;
+	} // ResetCounts()
+
+// copies a colour into a cached slot, returning false if it was already there
+bool GLStateCache::Store(GLfloat *slot, bool &known, const GLfloat *colour)
+	{ // Store()
+	if (known && slot[0] == colour[0] && slot[1] == colour[1] && slot[2] == colour[2] && slot[3] == colour[3])
+		{ // same as before
+		redundant++;
+		return false;
+		} // same as before
+	for (int channel = 0; channel < 4; channel++)
+		slot[channel] = colour[channel];
+	known = true;
+	changes++;
+	return true;
+	} // Store()
+
+// glEnable() or glDisable()
+void GLStateCache::Enable(GLenum capability, bool enabled)
+	{ // Enable()
+	for (int cached = 0; cached < GL_STATE_CACHE_CAPABILITIES; cached++)
+		if (cachedCapabilities[cached] == capability)
+			{ // one we track
+			if (capabilities[cached] == (enabled ? 1 : 0))
+				{ // same as before
+				redundant++;
+				return;
+				} // same as before
+			capabilities[cached] = enabled ? 1 : 0;
+			break;
+			} // one we track
+
+	changes++;
+	if (enabled)
+		glEnable(capability);
+	else
+		glDisable(capability);
+	} // Enable()
+
+// glShadeModel()
+void GLStateCache::ShadeModel(GLenum model)
+	{ // ShadeModel()
+	if (shadeModel == model)
+		{ // same as before
+		redundant++;
+		return;
+		} // same as before
+	shadeModel = model;
+	changes++;
+	glShadeModel(model);
+	} // ShadeModel()
+
+// glMaterialfv() on the front faces
+void GLStateCache::Material(GLenum parameter, const GLfloat *colour)
+	{ // Material()
+	int slot = parameter == GL_AMBIENT_AND_DIFFUSE ? 0 : parameter == GL_SPECULAR ? 1 : 2;
+	if (Store(material[slot], materialKnown[slot], colour))
+		glMaterialfv(GL_FRONT, parameter, colour);
+	} // Material()
+
+// glLightfv() for GL_LIGHT0 and a colour parameter
+void GLStateCache::LightColour(GLenum parameter, const GLfloat *colour)
+	{ // LightColour()
+	int slot = parameter == GL_AMBIENT ? 0 : parameter == GL_DIFFUSE ? 1 : 2;
+	if (Store(light[slot], lightKnown[slot], colour))
+		glLightfv(GL_LIGHT0, parameter, colour);
+	} // LightColour()
@@ -0,0 +1,76 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	GLStateCache.h
+//	------------------------
+//
+//	Remembers the fixed-function state the scene
+//	last set, so that setting it again to the same
+//	value never reaches OpenGL.  Software drivers
+//	revalidate the pipeline on every change, even
+//	a redundant one.  The cache only knows what was
+//	set through it: call Invalidate() whenever the
+//	context is new or other code may have changed
+//	the same state.
+//
+///////////////////////////////////////////////////
+
+#ifndef _GL_STATE_CACHE_H
+#define _GL_STATE_CACHE_H
+
+#ifdef __APPLE__
+#include <OpenGL/gl.h>
+#else
+#include <GL/gl.h>
+#endif
+
+// the capabilities the cache tracks for Enable()
+#define GL_STATE_CACHE_CAPABILITIES 4
+
+class GLStateCache
+	{ // class GLStateCache
+	public:
+	// state changes passed on to OpenGL, and those dropped as redundant,
+	// since the last ResetCounts()
+	long changes, redundant;
+
+	// constructor will initialise to knowing nothing
+	GLStateCache();
+
+	// forgets all the state, so that the next call of each kind reaches OpenGL
+	void Invalidate();
+
+	// zeroes the change counts, once a frame
+	void ResetCounts();
+
+	// glEnable() or glDisable(): GL_DEPTH_TEST, GL_LIGHTING, GL_LIGHT0 and GL_NORMALIZE are
+	// cached, and anything else goes straight through
+	void Enable(GLenum capability, bool enabled);
+
+	// glShadeModel()
+	void ShadeModel(GLenum model);
+
+	// glMaterialfv() on the front faces, for GL_AMBIENT_AND_DIFFUSE, GL_SPECULAR and GL_EMISSION
+	void Material(GLenum parameter, const GLfloat *colour);
+
+	// glLightfv() for GL_LIGHT0 and a colour parameter (GL_AMBIENT, GL_DIFFUSE or GL_SPECULAR)
+	// the position depends on the modelview matrix, so it is not cached
+	void LightColour(GLenum parameter, const GLfloat *colour);
+
+	private:
+	// -1 where unknown, otherwise 0 or 1, in the order of the capability list
+	int capabilities[GL_STATE_CACHE_CAPABILITIES];
+	// 0 where unknown
+	GLenum shadeModel;
+	// ambient and diffuse, specular, emission; known is false until first set
+	GLfloat material[3][4];
+	bool materialKnown[3];
+	// ambient, diffuse, specular of light 0
+	GLfloat light[3][4];
+	bool lightKnown[3];
+
+	// copies a colour into a cached slot, returning false if it was already there
+	bool Store(GLfloat *slot, bool &known, const GLfloat *colour);
+	}; // class GLStateCache
+
+#endif
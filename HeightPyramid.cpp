@@ -0,0 +1,95 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	HeightPyramid.cpp
+//	------------------------
+//
+//	A min/max mip pyramid over the cells of a
+//	heightfield.  Level 0 holds the lowest and
+//	highest corner of each cell, and each level
+//	above holds the range of a 2x2 block of the
+//	level below, up to a single root.  Ray queries
+//	skip any block the ray passes above or below.
+//
+///////////////////////////////////////////////////
+
+#include "HeightPyramid.h"
+
+#include <algorithm>
+
+// builds every level from the height samples
+void HeightPyramid::Build(const Heightfield &heightfield)
+	{ // Build()
+	levels.clear();
+	widths.clear();
+	heights.clear();
+	long cellsWide = heightfield.Width() - 1, cellsHigh = heightfield.Height() - 1;
+	if (cellsWide < 1 || cellsHigh < 1)
+		return;
+
+	// level 0: one range per cell, from its four corners
+	levels.emplace_back((size_t) cellsWide * cellsHigh);
+	widths.push_back(cellsWide);
+	heights.push_back(cellsHigh);
+	Refresh(heightfield, TerrainRegion(0, cellsHigh, 0, cellsWide));
+
+	// then halve until a single block covers the grid
+	while (widths.back() > 1 || heights.back() > 1)
+		{ // per level
+		long width = (widths.back() + 1) / 2, height = (heights.back() + 1) / 2;
+		levels.emplace_back((size_t) width * height);
+		widths.push_back(width);
+		heights.push_back(height);
+		int level = levels.size() - 1;
+		for (long row = 0; row < height; row++)
+			for (long col = 0; col < width; col++)
+				Combine(level, row, col);
+		} // per level
+	} // Build()
+
+// recomputes a block of a level above 0 from the four below it
+// blocks on the last row or column may have only one or two below them
+void HeightPyramid::Combine(int level, long row, long col)
+	{ // Combine()
+	const std::vector<HeightRange> &below = levels[level - 1];
+	long belowWidth = widths[level - 1], belowHeight = heights[level - 1];
+	HeightRange range = below[(2 * row) * belowWidth + 2 * col];
+	for (long subRow = 2 * row; subRow < std::min(2 * row + 2, belowHeight); subRow++)
+		for (long subCol = 2 * col; subCol < std::min(2 * col + 2, belowWidth); subCol++)
+			{ // per block below
+			const HeightRange &sub = below[subRow * belowWidth + subCol];
+			range.low = std::min(range.low, sub.low);
+			range.high = std::max(range.high, sub.high);
+			} // per block below
+	levels[level][row * widths[level] + col] = range;
+	} // Combine()
+
+// recomputes the ranges of the cells touching a block of samples, at every level
+void HeightPyramid::Refresh(const Heightfield &heightfield, const TerrainRegion &samples)
+	{ // Refresh()
+	if (levels.empty())
+		return;
+
+	// the cells that have one of the samples as a corner
+	long firstRow = std::max(0L, samples.firstRow - 1), lastRow = std::min(heights[0] - 1, samples.lastRow);
+	long firstCol = std::max(0L, samples.firstColumn - 1), lastCol = std::min(widths[0] - 1, samples.lastColumn);
+	for (long row = firstRow; row <= lastRow; row++)
+		for (long col = firstCol; col <= lastCol; col++)
+			{ // per cell
+			float upperLeft, upperRight, lowerLeft, lowerRight;
+			heightfield.CellCorners(row, col, upperLeft, upperRight, lowerLeft, lowerRight);
+			HeightRange &range = levels[0][row * widths[0] + col];
+			range.low = std::min(std::min(upperLeft, upperRight), std::min(lowerLeft, lowerRight));
+			range.high = std::max(std::max(upperLeft, upperRight), std::max(lowerLeft, lowerRight));
+			} // per cell
+
+	// and the blocks above them, halving the block each level
+	for (int level = 1; level < (int) levels.size(); level++)
+		{ // per level
+		firstRow /= 2; lastRow /= 2;
+		firstCol /= 2; lastCol /= 2;
+		for (long row = firstRow; row <= lastRow; row++)
+			for (long col = firstCol; col <= lastCol; col++)
+				Combine(level, row, col);
+		} // per level
+	} // Refresh()
@@ -0,0 +1,58 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	HeightPyramid.h
+//	------------------------
+//
+//	A min/max mip pyramid over the cells of a
+//	heightfield.  Level 0 holds the lowest and
+//	highest corner of each cell, and each level
+//	above holds the range of a 2x2 block of the
+//	level below, up to a single root.  Ray queries
+//	skip any block the ray passes above or below.
+//
+///////////////////////////////////////////////////
+
+#ifndef _HEIGHT_PYRAMID_H
+#define _HEIGHT_PYRAMID_H
+
+#include <vector>
+
+#include "Heightfield.h"
+
+// the lowest and highest height in a block of cells
+struct HeightRange
+	{ // struct HeightRange
+	float low, high;
+	}; // struct HeightRange
+
+class HeightPyramid
+	{ // class HeightPyramid
+	public:
+	// builds every level from the height samples
+	void Build(const Heightfield &heights);
+
+	// recomputes the ranges of the cells touching a block of samples, at every level
+	void Refresh(const Heightfield &heights, const TerrainRegion &samples);
+
+	// number of levels, with the root last
+	int Levels() const	{ return levels.size(); }
+
+	// size of a level, in blocks
+	long LevelWidth(int level) const	{ return widths[level]; }
+	long LevelHeight(int level) const	{ return heights[level]; }
+
+	// the range of a block: level 0 blocks are single cells
+	const HeightRange &Range(int level, long row, long col) const
+		{ return levels[level][row * widths[level] + col]; }
+
+	private:
+	// recomputes a block of a level above 0 from the four below it
+	void Combine(int level, long row, long col);
+
+	// one array of ranges per level, row-major
+	std::vector<std::vector<HeightRange> > levels;
+	std::vector<long> widths, heights;
+	}; // class HeightPyramid
+
+#endif
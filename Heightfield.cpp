@@ -0,0 +1,41 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	Heightfield.cpp
+//	------------------------
+//
+//	A contiguous grid of height samples, stored row
+//	by row in one allocation, so that a sample's
+//	neighbours are a fixed stride away.
+//
+///////////////////////////////////////////////////
+
+#include "Heightfield.h"
+
+// constructor will initialise to an empty grid
+Heightfield::Heightfield()
+	:
+	width(0),
+	height(0)
+	{ // constructor
+	} // constructor
+
+// reallocates the grid, zeroing all samples
+void Heightfield::Resize(long Width, long Height)
+	{ // Resize()
+	width = Width;
+	height = Height;
+	values.assign((size_t) width * height, 0.0f);
+	} // Resize()
+
+// copies a row of samples in from a plain array
+void Heightfield::SetRow(long row, const float *rowValues)
+	{ // SetRow()
+	std::copy(rowValues, rowValues + width, values.begin() + Index(row, 0));
+	} // SetRow()
+
+// copies a row of samples out to a plain array
+void Heightfield::GetRow(long row, float *rowValues) const
+	{ // GetRow()
+	std::copy(values.begin() + Index(row, 0), values.begin() + Index(row, 0) + width, rowValues);
+	} // GetRow()
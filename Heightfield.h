@@ -0,0 +1,99 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	Heightfield.h
+//	------------------------
+//
+//	A contiguous grid of height samples, stored row
+//	by row in one allocation, so that a sample's
+//	neighbours are a fixed stride away.
+//
+///////////////////////////////////////////////////
+
+#ifndef _HEIGHTFIELD_H
+#define _HEIGHTFIELD_H
+
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+
+// an inclusive block of rows and columns of the grid
+struct TerrainRegion
+	{ // struct TerrainRegion
+	long firstRow, lastRow;
+	long firstColumn, lastColumn;
+
+	TerrainRegion(long FirstRow, long LastRow, long FirstColumn, long LastColumn)
+		: firstRow(FirstRow), lastRow(LastRow), firstColumn(FirstColumn), lastColumn(LastColumn)
+		{}
+
+	bool IsEmpty() const
+		{ return firstRow > lastRow || firstColumn > lastColumn; }
+
+	// true if the regions share or border on a sample
+	bool Overlaps(const TerrainRegion &other) const
+		{ return firstRow <= other.lastRow + 1 && other.firstRow <= lastRow + 1 && firstColumn <= other.lastColumn + 1 && other.firstColumn <= lastColumn + 1; }
+
+	// grows the region to cover another one as well
+	void Include(const TerrainRegion &other)
+		{ // Include()
+		firstRow = std::min(firstRow, other.firstRow);
+		lastRow = std::max(lastRow, other.lastRow);
+		firstColumn = std::min(firstColumn, other.firstColumn);
+		lastColumn = std::max(lastColumn, other.lastColumn);
+		} // Include()
+	}; // struct TerrainRegion
+
+class Heightfield
+	{ // class Heightfield
+	public:
+	// constructor will initialise to an empty grid
+	Heightfield();
+
+	// reallocates the grid, zeroing all samples
+	void Resize(long Width, long Height);
+
+	// number of samples along a row, and number of rows
+	long Width() const	{ return width; }
+	long Height() const	{ return height; }
+
+	// number of samples from one row to the next
+	long Stride() const	{ return width; }
+
+	// offset of a sample from the start of the grid
+	size_t Index(long row, long col) const
+		{ return (size_t) row * width + col; }
+
+	// sample access by row and column
+	float &At(long row, long col)				{ return values[Index(row, col)]; }
+	const float &At(long row, long col) const	{ return values[Index(row, col)]; }
+
+	// fetches the four corners of the cell whose upper left sample is (row, col)
+	// the lower corners are one row further on, so only one index is computed
+	void CellCorners(long row, long col, float &upperLeft, float &upperRight, float &lowerLeft, float &lowerRight) const
+		{ // CellCorners()
+		const float *upper = values.data() + Index(row, col);
+		const float *lower = upper + width;
+		upperLeft = upper[0];
+		upperRight = upper[1];
+		lowerLeft = lower[0];
+		lowerRight = lower[1];
+		} // CellCorners()
+
+	// the whole grid, row by row
+	float *Data()				{ return values.data(); }
+	const float *Data() const	{ return values.data(); }
+
+	// copies a row of samples in from a plain array
+	void SetRow(long row, const float *values);
+
+	// copies a row of samples out to a plain array
+	void GetRow(long row, float *values) const;
+
+	private:
+	long width, height;
+	// the samples, row by row
+	std::vector<float> values;
+	}; // class Heightfield
+
+#endif
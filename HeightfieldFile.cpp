@@ -0,0 +1,208 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	HeightfieldFile.cpp
+//	------------------------
+//
+//	Versioned binary heightfield format.  The file is
+//	a fixed header followed by width * height raw
+//	little-endian floats in row-major order, so it can
+//	be memory-mapped and used without any parsing.
+//
+///////////////////////////////////////////////////
+
+#include "HeightfieldFile.h"
+
+#include <cstring>
+#include <fstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// the header is padded so that the floats start on a cache line
+static const uint32_t heightfieldDataOffset = 64;
+
+// check the byte order of the host
+static bool HostIsLittleEndian()
+	{ // HostIsLittleEndian()
+	const uint32_t probe = 1;
+	unsigned char firstByte;
+	memcpy(&firstByte, &probe, 1);
+	return firstByte == 1;
+	} // HostIsLittleEndian()
+
+// reverse the bytes of a 32-bit value in place
+static void SwapBytes(void *value)
+	{ // SwapBytes()
+	unsigned char *bytes = (unsigned char *) value;
+	unsigned char temp = bytes[0]; bytes[0] = bytes[3]; bytes[3] = temp;
+	temp = bytes[1]; bytes[1] = bytes[2]; bytes[2] = temp;
+	} // SwapBytes()
+
+// convert the numeric header fields between file and host order
+static void SwapHeader(HeightfieldFileHeader &header)
+	{ // SwapHeader()
+	SwapBytes(&header.version);
+	SwapBytes(&header.width);
+	SwapBytes(&header.height);
+	SwapBytes(&header.xyScale);
+	SwapBytes(&header.dataOffset);
+	} // SwapHeader()
+
+// constructor will initialise to safe values
+MappedHeightfieldFile::MappedHeightfieldFile()
+	:
+	mapping(NULL),
+	mappingSize(0),
+	values(NULL)
+	{ // constructor
+	memset(&header, 0, sizeof(header));
+	} // constructor
+
+// destructor releases the mapping
+MappedHeightfieldFile::~MappedHeightfieldFile()
+	{ // destructor
+	Close();
+	} // destructor
+
+// opens and validates the file, returns true on success
+bool MappedHeightfieldFile::Open(const char *fileName)
+	{ // MappedHeightfieldFile::Open()
+	Close();
+
+#ifndef _WIN32
+	// map the whole file read-only
+	int fd = open(fileName, O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat fileStatus;
+	if (fstat(fd, &fileStatus) != 0 || fileStatus.st_size < (off_t) sizeof(HeightfieldFileHeader))
+		{ // too small to be a heightfield
+		close(fd);
+		return false;
+		} // too small to be a heightfield
+	mappingSize = fileStatus.st_size;
+	mapping = mmap(NULL, mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	// the mapping keeps its own reference to the file
+	close(fd);
+	if (mapping == MAP_FAILED)
+		{ // mapping failed
+		mapping = NULL;
+		mappingSize = 0;
+		return false;
+		} // mapping failed
+	const char *bytes = (const char *) mapping;
+#else
+	// no mmap: read the file into memory instead
+	std::ifstream inFile(fileName, std::ios::binary | std::ios::ate);
+	if (!inFile.good())
+		return false;
+	mappingSize = inFile.tellg();
+	if (mappingSize < sizeof(HeightfieldFileHeader))
+		{ // too small to be a heightfield
+		mappingSize = 0;
+		return false;
+		} // too small to be a heightfield
+	fallbackValues.resize((mappingSize + sizeof(float) - 1) / sizeof(float));
+	inFile.seekg(0);
+	inFile.read((char *) fallbackValues.data(), mappingSize);
+	const char *bytes = (const char *) fallbackValues.data();
+#endif
+
+	// copy out the header and validate it
+	memcpy(&header, bytes, sizeof(header));
+	if (!HostIsLittleEndian())
+		SwapHeader(header);
+	// the values must be aligned floats, and the file must hold them all; the room left
+	// is compared by division, since width * height * 4 can overflow for a hostile header
+	if (memcmp(header.magic, HEIGHTFIELD_FILE_MAGIC, 4) != 0
+		|| header.version != HEIGHTFIELD_FILE_VERSION
+		|| header.dataOffset < sizeof(HeightfieldFileHeader)
+		|| header.dataOffset % sizeof(float) != 0
+		|| header.dataOffset > mappingSize
+		|| (uint64_t) header.width * header.height > (mappingSize - header.dataOffset) / sizeof(float))
+		{ // bad header
+		Close();
+		return false;
+		} // bad header
+	size_t valueBytes = (size_t) header.width * header.height * sizeof(float);
+
+	// on the usual little-endian host the values are used in place
+	values = (const float *) (bytes + header.dataOffset);
+	if (!HostIsLittleEndian())
+		{ // swap into a private copy
+		std::vector<float> swapped((size_t) header.width * header.height);
+		memcpy(swapped.data(), values, valueBytes);
+		for (size_t value = 0; value < swapped.size(); value++)
+			SwapBytes(&swapped[value]);
+		fallbackValues.swap(swapped);
+		values = fallbackValues.data();
+		} // swap into a private copy
+
+	return true;
+	} // MappedHeightfieldFile::Open()
+
+// releases the mapping
+void MappedHeightfieldFile::Close()
+	{ // MappedHeightfieldFile::Close()
+#ifndef _WIN32
+	if (mapping != NULL)
+		munmap(mapping, mappingSize);
+#endif
+	mapping = NULL;
+	mappingSize = 0;
+	values = NULL;
+	fallbackValues.clear();
+	memset(&header, 0, sizeof(header));
+	} // MappedHeightfieldFile::Close()
+
+// true if the file starts with the binary heightfield magic
+bool MappedHeightfieldFile::IsHeightfieldFile(const char *fileName)
+	{ // MappedHeightfieldFile::IsHeightfieldFile()
+	std::ifstream inFile(fileName, std::ios::binary);
+	char magic[4];
+	if (!inFile.read(magic, 4))
+		return false;
+	return memcmp(magic, HEIGHTFIELD_FILE_MAGIC, 4) == 0;
+	} // MappedHeightfieldFile::IsHeightfieldFile()
+
+// writes width * height row-major values as a binary heightfield
+// returns true on success, false otherwise
+bool WriteHeightfieldFile(const char *fileName, long width, long height, float xyScale, const float *rowMajorValues)
+	{ // WriteHeightfieldFile()
+	std::ofstream outFile(fileName, std::ios::binary | std::ios::trunc);
+	if (!outFile.good())
+		return false;
+
+	// fill in the header, zeroing the padding
+	char headerBytes[heightfieldDataOffset];
+	memset(headerBytes, 0, sizeof(headerBytes));
+	HeightfieldFileHeader header;
+	memcpy(header.magic, HEIGHTFIELD_FILE_MAGIC, 4);
+	header.version = HEIGHTFIELD_FILE_VERSION;
+	header.width = width;
+	header.height = height;
+	header.xyScale = xyScale;
+	header.dataOffset = heightfieldDataOffset;
+	if (!HostIsLittleEndian())
+		SwapHeader(header);
+	memcpy(headerBytes, &header, sizeof(header));
+	outFile.write(headerBytes, sizeof(headerBytes));
+
+	// and the values, one row at a time
+	std::vector<float> row(width);
+	for (long rowIndex = 0; rowIndex < height; rowIndex++)
+		{ // per row
+		memcpy(row.data(), rowMajorValues + rowIndex * width, width * sizeof(float));
+		if (!HostIsLittleEndian())
+			for (long col = 0; col < width; col++)
+				SwapBytes(&row[col]);
+		outFile.write((const char *) row.data(), width * sizeof(float));
+		} // per row
+
+	return outFile.good();
+	} // WriteHeightfieldFile()
@@ -0,0 +1,84 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	HeightfieldFile.h
+//	------------------------
+//
+//	Versioned binary heightfield format.  The file is
+//	a fixed header followed by width * height raw
+//	little-endian floats in row-major order, so it can
+//	be memory-mapped and used without any parsing.
+//
+///////////////////////////////////////////////////
+
+#ifndef _HEIGHTFIELD_FILE_H
+#define _HEIGHTFIELD_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// the four bytes at the start of every binary heightfield
+#define HEIGHTFIELD_FILE_MAGIC "FSHF"
+// bump this whenever the header layout changes
+#define HEIGHTFIELD_FILE_VERSION 1
+
+// the on-disk header: all fields little-endian
+struct HeightfieldFileHeader
+	{ // struct HeightfieldFileHeader
+	char magic[4];
+	uint32_t version;
+	// number of samples along a row, and number of rows
+	uint32_t width;
+	uint32_t height;
+	// spacing between samples in the x-y directions
+	float xyScale;
+	// byte offset of the first height value from the start of the file
+	uint32_t dataOffset;
+	}; // struct HeightfieldFileHeader
+
+// a read-only view of a binary heightfield file
+// the file stays mapped for as long as the object lives
+class MappedHeightfieldFile
+	{ // class MappedHeightfieldFile
+	public:
+	MappedHeightfieldFile();
+	~MappedHeightfieldFile();
+
+	// opens and validates the file, returns true on success
+	bool Open(const char *fileName);
+
+	// releases the mapping
+	void Close();
+
+	// accessors for the header values
+	long Width() const 		{ return header.width; }
+	long Height() const 	{ return header.height; }
+	float XYScale() const 	{ return header.xyScale; }
+
+	// pointer to the first value of a row, in host byte order
+	const float *Row(long row) const { return values + row * header.width; }
+
+	// true if the file starts with the binary heightfield magic
+	static bool IsHeightfieldFile(const char *fileName);
+
+	private:
+	// no copying: we own the mapping
+	MappedHeightfieldFile(const MappedHeightfieldFile &);
+	MappedHeightfieldFile &operator =(const MappedHeightfieldFile &);
+
+	HeightfieldFileHeader header;
+	// the mapped bytes and their length
+	void *mapping;
+	size_t mappingSize;
+	// only used on big-endian hosts or where mmap is unavailable
+	std::vector<float> fallbackValues;
+	// the height values themselves
+	const float *values;
+	}; // class MappedHeightfieldFile
+
+// writes width * height row-major values as a binary heightfield
+// returns true on success, false otherwise
+bool WriteHeightfieldFile(const char *fileName, long width, long height, float xyScale, const float *rowMajorValues);
+
+#endif
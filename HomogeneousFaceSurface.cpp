@@ -11,13 +11,22 @@
 //	GeometricSurfaceFaceDS class that uses Homogeneous4 
 // 	instead of Cartesian coordinates and that precomputes
 //	normal vectors for all of the triangles
-//	This version DOES NOT compute bounding spheres or midpoints
+//	It also computes a bounding sphere, for culling,
+//	but DOES NOT compute midpoints
 //	ALL transformations are up to the user.
+//	Where the context allows, the triangles are kept
+//	in vertex buffers and the card applies the matrix,
+//	drawn from a welded, indexed copy of the mesh
+//	ordered for the vertex cache.
 //	
 ///////////////////////////////////////////////////
 
 
 #include "HomogeneousFaceSurface.h"
+#include "MeshOptimiser.h"
+#include "ThreadPool.h"
+#include "TransformKernels.h"
+#include <algorithm>
 #include <iostream>
 #include <iomanip>
 #include <fstream>
@@ -32,6 +41,11 @@
 
 // constructor will initialise to safe values
 HomogeneousFaceSurface::HomogeneousFaceSurface()
+	:
+	boundingCentre(0.0, 0.0, 0.0),
+	boundingRadius(0.0),
+	indexBuffer(VertexBuffer::INDEX_DATA),
+	buffersStale(true)
 	{ // HomogeneousFaceSurface::HomogeneousFaceSurface()
 	// force the size to nil (should not be necessary, but . . .)
 	vertices.resize(0);
@@ -76,9 +90,41 @@ void HomogeneousFaceSurface::ComputeUnitNormalVectors()
 	{ // ComputeUnitNormalVectors()
 	// assume that the triangle vertices are set correctly, and allocate one third of that for normals
 	normals.resize(vertices.size() / 3);
-	
+
+	// and compute all of them, in blocks of triangles spread over the thread pool
+	ThreadPool::Shared().ParallelFor(0, normals.size(), 8192, [this](long firstTriangle, long endTriangle)
+		{ // per block of triangles
+		ComputeNormals(firstTriangle, endTriangle);
+		}); // per block of triangles
+
+	// the extent of the mesh may have changed
+	ComputeBoundingSphere();
+
+	// and every triangle may have
+	BuildDrawMesh();
+	} // ComputeUnitNormalVectors()
+
+// routine to recompute the unit normal vectors of a range of triangles
+// from firstTriangle up to but not including endTriangle
+void HomogeneousFaceSurface::ComputeUnitNormalVectors(int firstTriangle, int endTriangle)
+	{ // ComputeUnitNormalVectors()
+	ComputeNormals(firstTriangle, endTriangle);
+
+	// grow the sphere over any vertex that moved outside it, so that culling stays safe
+	for (int vertex = 3 * firstTriangle; vertex < 3 * endTriangle; vertex++)
+		boundingRadius = std::max(boundingRadius, (vertices[vertex].Point() - boundingCentre).length());
+
+	// an edit can split or join welded vertices, so the draw mesh is built afresh;
+	// the models are small enough that this costs less than tracking what changed
+	BuildDrawMesh();
+	} // ComputeUnitNormalVectors()
+
+// computes the normals of a range of triangles, without marking them for upload
+// safe to call on separate ranges at once
+void HomogeneousFaceSurface::ComputeNormals(int firstTriangle, int endTriangle)
+	{ // ComputeNormals()
 	// loop through the triangles, computing normal vectors
-	for (int triangle = 0; triangle < (int) normals.size(); triangle++)
+	for (int triangle = firstTriangle; triangle < endTriangle; triangle++)
 		{ // per triangle
 		// retrieve the three vertices in Cartesian form
 		Cartesian3 vertexP = vertices[3 * triangle		].Point();
@@ -92,34 +138,183 @@ void HomogeneousFaceSurface::ComputeUnitNormalVectors()
 		// and store it as a homogeneous vector
 		normals[triangle] = Homogeneous4(normal.x, normal.y, normal.z, 0.0);	
 		} // per triangle
-	} // ComputeUnitNormalVectors()
+	} // ComputeNormals()
+
+// fits the bounding sphere to all the vertices
+// the centre of the bounding box is used, which is within a factor of sqrt(3)
+// of the smallest sphere, and cheap enough to redo after any edit
+void HomogeneousFaceSurface::ComputeBoundingSphere()
+	{ // ComputeBoundingSphere()
+	boundingCentre = Cartesian3(0.0, 0.0, 0.0);
+	boundingRadius = 0.0;
+	if (vertices.empty())
+		return;
+
+	Cartesian3 minCorner = vertices[0].Point(), maxCorner = minCorner;
+	for (const Homogeneous4 &vertex : vertices)
+		{ // per vertex
+		Cartesian3 point = vertex.Point();
+		for (int axis = 0; axis < 3; axis++)
+			{ // per axis
+			minCorner[axis] = std::min(minCorner[axis], point[axis]);
+			maxCorner[axis] = std::max(maxCorner[axis], point[axis]);
+			} // per axis
+		} // per vertex
+	boundingCentre = (minCorner + maxCorner) / 2.0;
+
+	for (const Homogeneous4 &vertex : vertices)
+		boundingRadius = std::max(boundingRadius, (vertex.Point() - boundingCentre).length());
+	} // ComputeBoundingSphere()
+
+// welds the triangles into drawVertices, drawNormals and drawIndices
+// each triangle owns one vertex, carrying its normal, which becomes its last corner;
+// its other two corners share whatever vertex is already at their position
+void HomogeneousFaceSurface::BuildDrawMesh()
+	{ // BuildDrawMesh()
+	long nTriangles = normals.size();
+	std::vector<Homogeneous4> positions;
+	std::vector<unsigned int> positionIndex;
+	WeldVertices(vertices.data(), 3 * nTriangles, positions, positionIndex);
+
+	drawVertices.clear();
+	drawNormals.clear();
+	drawIndices.resize(3 * nTriangles);
+
+	// a vertex at each position, once one has been made
+	std::vector<int> vertexAt(positions.size(), -1);
+
+	// first, the vertex each triangle owns, at a corner whose position has no vertex yet if
+	// there is one, so that as few positions as possible need a vertex of their own later
+	std::vector<int> ownedCorner(nTriangles);
+	for (long triangle = 0; triangle < nTriangles; triangle++)
+		{ // per triangle
+		int corner = 2;
+		for (int trial = 0; trial < 3; trial++)
+			if (vertexAt[positionIndex[3 * triangle + trial]] < 0)
+				{ // unclaimed
+				corner = trial;
+				break;
+				} // unclaimed
+		ownedCorner[triangle] = corner;
+		unsigned int position = positionIndex[3 * triangle + corner];
+		if (vertexAt[position] < 0)
+			vertexAt[position] = drawVertices.size();
+		drawIndices[3 * triangle + 2] = drawVertices.size();
+		drawVertices.push_back(positions[position]);
+		drawNormals.push_back(normals[triangle].Vector());
+		} // per triangle
+
+	// then the other two corners, rotated so that the winding is kept
+	for (long triangle = 0; triangle < nTriangles; triangle++)
+		for (int offset = 1; offset < 3; offset++)
+			{ // per shared corner
+			unsigned int position = positionIndex[3 * triangle + (ownedCorner[triangle] + offset) % 3];
+			// a position no triangle owns still needs a vertex, and any normal will do
+			if (vertexAt[position] < 0)
+				{ // new vertex
+				vertexAt[position] = drawVertices.size();
+				drawVertices.push_back(positions[position]);
+				drawNormals.push_back(normals[triangle].Vector());
+				} // new vertex
+			drawIndices[3 * triangle + offset - 1] = vertexAt[position];
+			} // per shared corner
+
+	OptimiseVertexCache(drawIndices.data(), drawIndices.size());
+	buffersStale = true;
+	} // BuildDrawMesh()
+
+// true unless the bounding sphere, placed by a modelview matrix, is entirely outside a frustum in eye coordinates
+bool HomogeneousFaceSurface::IsVisible(const columnMajorMatrix &modelViewMatrix, const Frustum &eyeFrustum) const
+	{ // IsVisible()
+	Cartesian3 centre = (modelViewMatrix * Homogeneous4(boundingCentre.x, boundingCentre.y, boundingCentre.z, 1.0)).Point();
+
+	// the radius grows by the largest scale along any axis of the matrix
+	const float *m = modelViewMatrix.coordinates;
+	float scale = 0.0;
+	for (int column = 0; column < 3; column++)
+		scale = std::max(scale, m[4 * column] * m[4 * column] + m[4 * column + 1] * m[4 * column + 1] + m[4 * column + 2] * m[4 * column + 2]);
+
+	return eyeFrustum.IntersectsSphere(centre, boundingRadius * sqrt(scale));
+	} // IsVisible()
+
+// brings the buffers up to date with the draw mesh
+void HomogeneousFaceSurface::UploadBuffers() const
+	{ // UploadBuffers()
+	if (!buffersStale && vertexBuffer.IsAllocated())
+		return;
+	vertexBuffer.Allocate(drawVertices.size() * sizeof(Homogeneous4), drawVertices.data());
+	normalBuffer.Allocate(drawNormals.size() * sizeof(Cartesian3), drawNormals.data());
+	indexBuffer.Allocate(drawIndices.size() * sizeof(unsigned int), drawIndices.data());
+	buffersStale = false;
+	} // UploadBuffers()
 
 // routine to render
-void HomogeneousFaceSurface::Render(columnMajorMatrix &viewMatrix)
+void HomogeneousFaceSurface::Render(columnMajorMatrix &viewMatrix) const
 	{ // HomogeneousFaceSurface::Render()
+	if (vertices.empty())
+		return;
+
+	// retained: the mesh stays on the card, and the card applies the matrix
+	if (VertexBuffer::Available())
+		{ // draw from the buffers
+		glMatrixMode(GL_MODELVIEW);
+		glPushMatrix();
+		glLoadMatrixf(viewMatrix.coordinates);
+
+		BindBuffers();
+		glDrawElements(GL_TRIANGLES, drawIndices.size(), GL_UNSIGNED_INT, NULL);
+		UnbindBuffers();
+
+		glPopMatrix();
+		return;
+		} // draw from the buffers
+
+	// transform the whole mesh in one batch
+	transformedVertices.resize(vertices.size());
+	transformedNormals.resize(normals.size());
+	TransformHomogeneous(viewMatrix, vertices.data(), transformedVertices.data(), vertices.size());
+	TransformNormals(viewMatrix, normals.data(), transformedNormals.data(), normals.size());
+
 	// walk through the faces rendering each one
 	glBegin(GL_TRIANGLES);
 
 	// we loop through all of the triangles
 	for (int triangle = 0; triangle < (int) normals.size(); triangle++)
 		{ // per triangle
-		// retrieve the vertices and the normal
-		Homogeneous4 vertexP 	= viewMatrix * vertices[3 * triangle		];
-		Homogeneous4 vertexQ 	= viewMatrix * vertices[3 * triangle + 1	];
-		Homogeneous4 vertexR 	= viewMatrix * vertices[3 * triangle + 2	];
-		Homogeneous4 normal 	= viewMatrix * normals[triangle];
-		
 		// this works because C++ guarantees that the POD data is in exactly
 		// the order stated in the class with no padding.
-		glNormal3fv(&normal.x);
-		glVertex4fv(&vertexP.x);
-		glVertex4fv(&vertexQ.x);
-		glVertex4fv(&vertexR.x);
+		glNormal3fv(&transformedNormals[triangle].x);
+		glVertex4fv(&transformedVertices[3 * triangle		].x);
+		glVertex4fv(&transformedVertices[3 * triangle + 1	].x);
+		glVertex4fv(&transformedVertices[3 * triangle + 2	].x);
 		} // per triangle
 
 	glEnd();
 	} // HomogeneousFaceSurface::Render()
 
+// uploads the buffers if need be, points the vertex and normal arrays at them and binds the indices
+void HomogeneousFaceSurface::BindBuffers() const
+	{ // BindBuffers()
+	UploadBuffers();
+
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+	vertexBuffer.Bind();
+	glVertexPointer(4, GL_FLOAT, sizeof(Homogeneous4), NULL);
+	normalBuffer.Bind();
+	glNormalPointer(GL_FLOAT, sizeof(Cartesian3), NULL);
+	normalBuffer.Unbind();
+	indexBuffer.Bind();
+	} // BindBuffers()
+
+// turns the vertex and normal arrays back off, and unbinds the indices
+void HomogeneousFaceSurface::UnbindBuffers() const
+	{ // UnbindBuffers()
+	indexBuffer.Unbind();
+	glDisableClientState(GL_NORMAL_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+	} // UnbindBuffers()
+
 // routine to dump out as triangle soup
 void HomogeneousFaceSurface::WriteTriangleSoup()
 	{ // HomogeneousFaceSurface::WriteTriangleSoup()
@@ -11,8 +11,13 @@
 //	GeometricSurfaceFaceDS class that uses Homogeneous4 
 // 	instead of Cartesian coordinates and that precomputes
 //	normal vectors for all of the triangles
-//	This version DOES NOT compute bounding spheres or midpoints
+//	It also computes a bounding sphere, for culling,
+//	but DOES NOT compute midpoints
 //	ALL transformations are up to the user.
+//	Where the context allows, the triangles are kept
+//	in vertex buffers and the card applies the matrix,
+//	drawn from a welded, indexed copy of the mesh
+//	ordered for the vertex cache.
 //	
 ///////////////////////////////////////////////////
 
@@ -21,8 +26,11 @@
 
 #include <vector>
 
+#include "Cartesian3.h"
 #include "Homogeneous4.h"
 #include "Matrix4.h"
+#include "Frustum.h"
+#include "VertexBuffer.h"
 
 class HomogeneousFaceSurface
 	{ // class HomogeneousFaceSurface
@@ -34,6 +42,18 @@ class HomogeneousFaceSurface
 	// vector to hold corresponding normal vectors
 	std::vector<Homogeneous4> normals;
 
+	// the mesh as drawn from the buffers: each distinct position once, plus a copy
+	// wherever a triangle needs its own normal, and three indices per triangle
+	// under flat shading a triangle takes its normal from its last corner, so the
+	// corners are rotated to put a vertex with the triangle's own normal last
+	std::vector<Homogeneous4> drawVertices;
+	std::vector<Cartesian3> drawNormals;
+	std::vector<unsigned int> drawIndices;
+
+	// a sphere around every vertex, in the model's own coordinates
+	Cartesian3 boundingCentre;
+	float boundingRadius;
+
 	// constructor will initialise to safe values
 	HomogeneousFaceSurface();
 	
@@ -42,13 +62,54 @@ class HomogeneousFaceSurface
 	
 	// routine to compute unit normal vectors
 	void ComputeUnitNormalVectors();
+
+	// routine to recompute the normals of triangles firstTriangle up to endTriangle
+	void ComputeUnitNormalVectors(int firstTriangle, int endTriangle);
 	
 	// routine to render
-	void Render(columnMajorMatrix &viewMatrix);
+	// uses vertex buffers where the context has them, and immediate mode otherwise
+	// const, so that a shared model can be drawn by everything that uses it
+	void Render(columnMajorMatrix &viewMatrix) const;
+
+	// true unless the bounding sphere, placed by a modelview matrix, is entirely outside
+	// a frustum in eye coordinates (one made from the projection matrix alone)
+	bool IsVisible(const columnMajorMatrix &modelViewMatrix, const Frustum &eyeFrustum) const;
+
+	// uploads the buffers if need be, points the vertex and normal arrays at them and
+	// binds the indices, so that the caller can draw the mesh several times with
+	// glDrawElements() on drawIndices
+	// only valid where VertexBuffer::Available()
+	void BindBuffers() const;
+
+	// turns the vertex and normal arrays back off, and unbinds the indices
+	void UnbindBuffers() const;
 	
 	// routine to dump out as triangle soup
 	void WriteTriangleSoup();	
 	
+	private:
+	// computes the normals of a range of triangles, without marking them for upload
+	void ComputeNormals(int firstTriangle, int endTriangle);
+
+	// fits the bounding sphere to all the vertices
+	void ComputeBoundingSphere();
+
+	// welds the triangles into drawVertices, drawNormals and drawIndices
+	void BuildDrawMesh();
+
+	// brings the buffers up to date with the vertices and normals
+	void UploadBuffers() const;
+
+	// the rest is a cache of the mesh for drawing, which Render() may update
+
+	// the draw mesh, uploaded by the first retained Render() and again after any edit
+	mutable VertexBuffer vertexBuffer, normalBuffer, indexBuffer;
+
+	// true if the draw mesh has changed since the last upload
+	mutable bool buffersStale;
+
+	// scratch space for immediate mode, reused every frame
+	mutable std::vector<Homogeneous4> transformedVertices, transformedNormals;
 	}; // class HomogeneousFaceSurface
 
 #endif
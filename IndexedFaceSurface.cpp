@@ -0,0 +1,101 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	IndexedFaceSurface.cpp
+//	------------------------
+//	
+//	An indexed sibling of HomogeneousFaceSurface.
+//	Each vertex is stored once and every three
+//	indices form a single triangle, so vertices
+//	shared between triangles are not duplicated.
+//	Normal vectors are precomputed per triangle.
+//	ALL transformations are up to the user.
+//	
+///////////////////////////////////////////////////
+
+#include "IndexedFaceSurface.h"
+#include "ThreadPool.h"
+#include "TransformKernels.h"
+#include <iostream>
+#include <iomanip>
+#include <math.h>
+#ifdef __APPLE__
+#include <OpenGL/gl.h>
+#include <OpenGL/glu.h>
+#else
+#include <GL/gl.h>
+#include <GL/glu.h>
+#endif
+
+// constructor will initialise to safe values
+IndexedFaceSurface::IndexedFaceSurface()
+	{ // IndexedFaceSurface::IndexedFaceSurface()
+	} // IndexedFaceSurface::IndexedFaceSurface()
+
+// routine to compute unit normal vectors
+void IndexedFaceSurface::ComputeUnitNormalVectors()
+	{ // ComputeUnitNormalVectors()
+	// one normal for each three indices
+	normals.resize(indices.size() / 3);
+
+	// and compute all of them, in blocks of triangles spread over the thread pool
+	ThreadPool::Shared().ParallelFor(0, normals.size(), 8192, [this](long firstTriangle, long endTriangle)
+		{ // per block of triangles
+		ComputeUnitNormalVectors(firstTriangle, endTriangle);
+		}); // per block of triangles
+	} // ComputeUnitNormalVectors()
+
+// routine to recompute the unit normal vectors of a range of triangles
+// from firstTriangle up to but not including endTriangle
+void IndexedFaceSurface::ComputeUnitNormalVectors(int firstTriangle, int endTriangle)
+	{ // ComputeUnitNormalVectors()
+	// loop through the triangles, computing normal vectors
+	for (int triangle = firstTriangle; triangle < endTriangle; triangle++)
+		{ // per triangle
+		// retrieve the three vertices in Cartesian form
+		Cartesian3 vertexP = vertices[indices[3 * triangle		]].Point();
+		Cartesian3 vertexQ = vertices[indices[3 * triangle + 1	]].Point();
+		Cartesian3 vertexR = vertices[indices[3 * triangle + 2	]].Point();
+		// compute two edge vectors
+		Cartesian3 vectorU = vertexQ - vertexP;
+		Cartesian3 vectorV = vertexR - vertexP;
+		// compute a normal with the cross-product
+		Cartesian3 normal = vectorU.cross(vectorV).unit();
+		// and store it as a homogeneous vector
+		normals[triangle] = Homogeneous4(normal.x, normal.y, normal.z, 0.0);	
+		} // per triangle
+	} // ComputeUnitNormalVectors()
+
+// routine to render
+void IndexedFaceSurface::Render(columnMajorMatrix &viewMatrix)
+	{ // IndexedFaceSurface::Render()
+	// each shared vertex is transformed once, not once per triangle, in one batch
+	transformedVertices.resize(vertices.size());
+	transformedNormals.resize(normals.size());
+	TransformHomogeneous(viewMatrix, vertices.data(), transformedVertices.data(), vertices.size());
+	TransformNormals(viewMatrix, normals.data(), transformedNormals.data(), normals.size());
+
+	// walk through the faces rendering each one
+	glBegin(GL_TRIANGLES);
+
+	// we loop through all of the triangles
+	for (int triangle = 0; triangle < (int) normals.size(); triangle++)
+		{ // per triangle
+		// this works because C++ guarantees that the POD data is in exactly
+		// the order stated in the class with no padding.
+		glNormal3fv(&transformedNormals[triangle].x);
+		glVertex4fv(&transformedVertices[indices[3 * triangle		]].x);
+		glVertex4fv(&transformedVertices[indices[3 * triangle + 1	]].x);
+		glVertex4fv(&transformedVertices[indices[3 * triangle + 2	]].x);
+		} // per triangle
+
+	glEnd();
+	} // IndexedFaceSurface::Render()
+
+// routine to dump out as triangle soup
+void IndexedFaceSurface::WriteTriangleSoup()
+	{ // IndexedFaceSurface::WriteTriangleSoup()
+	std::cout << normals.size() << std::endl;
+	for (int triangle = 0; triangle < (int) normals.size(); triangle++)
+		std::cout << std::fixed << vertices[indices[3 * triangle]] << "\t\t" << vertices[indices[3 * triangle + 1]] << "\t\t" << vertices[indices[3 * triangle + 2]] << std::endl;
+	} // IndexedFaceSurface::WriteTriangleSoup()
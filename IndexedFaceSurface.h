@@ -0,0 +1,57 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	IndexedFaceSurface.h
+//	------------------------
+//	
+//	An indexed sibling of HomogeneousFaceSurface.
+//	Each vertex is stored once and every three
+//	indices form a single triangle, so vertices
+//	shared between triangles are not duplicated.
+//	Normal vectors are precomputed per triangle.
+//	ALL transformations are up to the user.
+//	
+///////////////////////////////////////////////////
+
+#ifndef _INDEXED_FACE_SURFACE_H
+#define _INDEXED_FACE_SURFACE_H
+
+#include <vector>
+
+#include "Homogeneous4.h"
+#include "Matrix4.h"
+
+class IndexedFaceSurface
+	{ // class IndexedFaceSurface
+	public:
+	// vector to store the shared vertices
+	std::vector<Homogeneous4> vertices;
+
+	// vector to store triangle information
+	// each three indices will form a single triangle
+	std::vector<unsigned int> indices;
+
+	// vector to hold the normal vector of each triangle
+	std::vector<Homogeneous4> normals;
+
+	// constructor will initialise to safe values
+	IndexedFaceSurface();
+	
+	// routine to compute unit normal vectors
+	void ComputeUnitNormalVectors();
+
+	// routine to recompute the normals of triangles firstTriangle up to endTriangle
+	void ComputeUnitNormalVectors(int firstTriangle, int endTriangle);
+	
+	// routine to render
+	void Render(columnMajorMatrix &viewMatrix);
+	
+	// routine to dump out as triangle soup
+	void WriteTriangleSoup();	
+
+	protected:
+	// scratch space for the transformed vertices and normals, reused every frame
+	std::vector<Homogeneous4> transformedVertices, transformedNormals;
+	}; // class IndexedFaceSurface
+
+#endif
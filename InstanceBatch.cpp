@@ -0,0 +1,234 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	InstanceBatch.cpp
+//	------------------------
+//
+//	Collects the copies of one mesh drawn in a
+//	frame, each with its own modelview matrix and
+//	colour, and draws them together.  Where the
+//	context has instanced arrays (OpenGL 3.3) the
+//	whole batch is a single draw call.  Otherwise
+//	the mesh is bound once and drawn per copy from
+//	its vertex buffers, or in immediate mode if
+//	there are no buffers either.
+//
+//	The instanced path needs a vertex shader to
+//	read the per-instance attributes.  It repeats
+//	the fixed-function lighting the rest of the
+//	scene uses, with one directional light and the
+//	colour as ambient and diffuse material, and
+//	leaves the fragments to the fixed pipeline.
+//
+///////////////////////////////////////////////////
+
+// the shader and instancing functions are core in 3.3, but only declared by glext.h,
+// and only if this comes before anything includes gl.h
+#define GL_GLEXT_PROTOTYPES
+#include "InstanceBatch.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <iostream>
+
+#ifdef __APPLE__
+#include <OpenGL/gl.h>
+#else
+#include <GL/gl.h>
+#include <GL/glext.h>
+#endif
+
+// attribute locations of the modelview columns and the colour
+// some drivers alias the low locations to gl_Vertex, gl_Normal and gl_Color,
+// so these sit where only the unused texture coordinates would be
+#define INSTANCE_MATRIX_LOCATION 8
+#define INSTANCE_COLOUR_LOCATION 12
+
+// set by SetInstancingEnabled(), so that one draw per copy can still be timed
+static bool instancingEnabled = true;
+
+// the shader program: 0 until built, and contextSupportsInstancing is false if it can't be
+static GLuint instanceProgram = 0;
+static bool contextChecked = false, contextSupportsInstancing = false;
+
+// transforms each vertex by its instance's modelview matrix and lights it as
+// glLightfv() and glShadeModel(GL_FLAT) would; the models are only ever scaled
+// uniformly, so the modelview itself transforms the normals
+static const char *instanceVertexShader =
+	"#version 130\n"
+	"in vec4 instanceColumn0, instanceColumn1, instanceColumn2, instanceColumn3;\n"
+	"in vec4 instanceColour;\n"
+	"void main()\n"
+	"	{\n"
+	"	mat4 modelView = mat4(instanceColumn0, instanceColumn1, instanceColumn2, instanceColumn3);\n"
+	"	gl_Position = gl_ProjectionMatrix * (modelView * gl_Vertex);\n"
+	"	vec3 normal = normalize(mat3(modelView) * gl_Normal);\n"
+	"	vec3 light = normalize(gl_LightSource[0].position.xyz);\n"
+	"	vec3 lit = gl_LightModel.ambient.rgb + gl_LightSource[0].ambient.rgb\n"
+	"		+ max(dot(normal, light), 0.0) * gl_LightSource[0].diffuse.rgb;\n"
+	"	gl_FrontColor = clamp(vec4(instanceColour.rgb * lit, instanceColour.a), 0.0, 1.0);\n"
+	"	}\n";
+
+// compiles and links the instancing program, returns 0 on failure
+static GLuint BuildInstanceProgram()
+	{ // BuildInstanceProgram()
+	GLuint shader = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(shader, 1, &instanceVertexShader, NULL);
+	glCompileShader(shader);
+	GLint compiled = GL_FALSE;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+
+	GLuint program = glCreateProgram();
+	glAttachShader(program, shader);
+	const char *columnNames[4] = { "instanceColumn0", "instanceColumn1", "instanceColumn2", "instanceColumn3" };
+	for (int column = 0; column < 4; column++)
+		glBindAttribLocation(program, INSTANCE_MATRIX_LOCATION + column, columnNames[column]);
+	glBindAttribLocation(program, INSTANCE_COLOUR_LOCATION, "instanceColour");
+	glLinkProgram(program);
+	GLint linked = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+
+	// the program keeps the shader alive for as long as it needs it
+	glDeleteShader(shader);
+	if (compiled == GL_TRUE && linked == GL_TRUE)
+		return program;
+
+	char log[1024] = "";
+	glGetProgramInfoLog(program, sizeof(log), NULL, log);
+	std::cout << "Instanced drawing unavailable, drawing one copy at a time: " << log << std::endl;
+	glDeleteProgram(program);
+	return 0;
+	} // BuildInstanceProgram()
+
+// constructor will initialise to an empty batch
+InstanceBatch::InstanceBatch()
+	:
+	drawCalls(0)
+	{ // constructor
+	} // constructor
+
+// forgets the copies, keeping the memory for the next frame
+void InstanceBatch::Clear()
+	{ // Clear()
+	instances.clear();
+	} // Clear()
+
+// adds a copy of the mesh
+void InstanceBatch::Add(const columnMajorMatrix &modelViewMatrix, const float *colour)
+	{ // Add()
+	instances.emplace_back();
+	MeshInstance &instance = instances.back();
+	instance.modelViewMatrix = modelViewMatrix;
+	for (int channel = 0; channel < 4; channel++)
+		instance.colour[channel] = colour[channel];
+	} // Add()
+
+// true if the current context can draw a batch in one call
+bool InstanceBatch::InstancingAvailable()
+	{ // InstancingAvailable()
+	if (!instancingEnabled || !VertexBuffer::Available())
+		return false;
+	if (!contextChecked)
+		{ // ask the context
+		const char *version = (const char *) glGetString(GL_VERSION);
+		int major = 0, minor = 0;
+		if (version == NULL || sscanf(version, "%d.%d", &major, &minor) != 2)
+			return false;
+		contextChecked = true;
+		// compatibility contexts only, since the rest of the scene is fixed-function
+		if (major > 3 || (major == 3 && minor >= 3))
+			instanceProgram = BuildInstanceProgram();
+		contextSupportsInstancing = instanceProgram != 0;
+		} // ask the context
+	return contextSupportsInstancing;
+	} // InstancingAvailable()
+
+// switches instanced drawing on or off
+void InstanceBatch::SetInstancingEnabled(bool enabled)
+	{ // SetInstancingEnabled()
+	instancingEnabled = enabled;
+	} // SetInstancingEnabled()
+
+// draws a copy of the mesh for each instance
+void InstanceBatch::Render(const HomogeneousFaceSurface &mesh, GLStateCache &state)
+	{ // Render()
+	drawCalls = 0;
+	if (instances.empty() || mesh.vertices.empty())
+		return;
+
+	if (InstancingAvailable())
+		RenderInstanced(mesh);
+	else if (VertexBuffer::Available())
+		RenderPerInstance(mesh, state);
+	else
+		RenderImmediate(mesh, state);
+	} // Render()
+
+// the whole batch in one call, with the instances read from a buffer
+void InstanceBatch::RenderInstanced(const HomogeneousFaceSurface &mesh)
+	{ // RenderInstanced()
+	// grow the buffer geometrically, so that a growing scene doesn't reallocate every frame
+	size_t bytes = instances.size() * sizeof(MeshInstance);
+	if (bytes > instanceBuffer.Bytes())
+		instanceBuffer.Allocate(std::max(bytes, 2 * instanceBuffer.Bytes()), NULL);
+	instanceBuffer.Update(0, bytes, instances.data());
+
+	mesh.BindBuffers();
+
+	// the matrix goes in as four columns, each advancing once per instance
+	instanceBuffer.Bind();
+	for (int column = 0; column < 4; column++)
+		{ // per column
+		glEnableVertexAttribArray(INSTANCE_MATRIX_LOCATION + column);
+		glVertexAttribPointer(INSTANCE_MATRIX_LOCATION + column, 4, GL_FLOAT, GL_FALSE, sizeof(MeshInstance),
+			(const void *) (offsetof(MeshInstance, modelViewMatrix) + 4 * column * sizeof(float)));
+		glVertexAttribDivisor(INSTANCE_MATRIX_LOCATION + column, 1);
+		} // per column
+	glEnableVertexAttribArray(INSTANCE_COLOUR_LOCATION);
+	glVertexAttribPointer(INSTANCE_COLOUR_LOCATION, 4, GL_FLOAT, GL_FALSE, sizeof(MeshInstance), (const void *) offsetof(MeshInstance, colour));
+	glVertexAttribDivisor(INSTANCE_COLOUR_LOCATION, 1);
+	instanceBuffer.Unbind();
+
+	glUseProgram(instanceProgram);
+	glDrawElementsInstanced(GL_TRIANGLES, mesh.drawIndices.size(), GL_UNSIGNED_INT, NULL, instances.size());
+	glUseProgram(0);
+	drawCalls = 1;
+
+	// leave the attributes as the fixed-function paths expect them
+	for (int location = INSTANCE_MATRIX_LOCATION; location <= INSTANCE_COLOUR_LOCATION; location++)
+		{ // per attribute
+		glVertexAttribDivisor(location, 0);
+		glDisableVertexAttribArray(location);
+		} // per attribute
+	mesh.UnbindBuffers();
+	} // RenderInstanced()
+
+// the compatibility fallback: the mesh is bound once, and each copy is one
+// glDrawElements() with its own matrix, and its material where that changes
+void InstanceBatch::RenderPerInstance(const HomogeneousFaceSurface &mesh, GLStateCache &state)
+	{ // RenderPerInstance()
+	mesh.BindBuffers();
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	for (const MeshInstance &instance : instances)
+		{ // per instance
+		glLoadMatrixf(instance.modelViewMatrix.coordinates);
+		state.Material(GL_AMBIENT_AND_DIFFUSE, instance.colour);
+		glDrawElements(GL_TRIANGLES, mesh.drawIndices.size(), GL_UNSIGNED_INT, NULL);
+		} // per instance
+	glPopMatrix();
+	mesh.UnbindBuffers();
+	drawCalls = instances.size();
+	} // RenderPerInstance()
+
+// without buffers, each copy is transformed on the CPU as before
+void InstanceBatch::RenderImmediate(const HomogeneousFaceSurface &mesh, GLStateCache &state)
+	{ // RenderImmediate()
+	for (MeshInstance &instance : instances)
+		{ // per instance
+		state.Material(GL_AMBIENT_AND_DIFFUSE, instance.colour);
+		mesh.Render(instance.modelViewMatrix);
+		} // per instance
+	drawCalls = instances.size();
+	} // RenderImmediate()
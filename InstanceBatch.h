@@ -0,0 +1,77 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	InstanceBatch.h
+//	------------------------
+//
+//	Collects the copies of one mesh drawn in a
+//	frame, each with its own modelview matrix and
+//	colour, and draws them together.  Where the
+//	context has instanced arrays (OpenGL 3.3) the
+//	whole batch is a single draw call.  Otherwise
+//	the mesh is bound once and drawn per copy from
+//	its vertex buffers, or in immediate mode if
+//	there are no buffers either.
+//
+///////////////////////////////////////////////////
+
+#ifndef _INSTANCE_BATCH_H
+#define _INSTANCE_BATCH_H
+
+#include <vector>
+
+#include "GLStateCache.h"
+#include "HomogeneousFaceSurface.h"
+#include "Matrix4.h"
+#include "VertexBuffer.h"
+
+// one copy of a mesh, laid out as the instanced arrays read it
+struct MeshInstance
+	{ // struct MeshInstance
+	// the full modelview matrix of the copy
+	columnMajorMatrix modelViewMatrix;
+	// ambient and diffuse material colour
+	float colour[4];
+	}; // struct MeshInstance
+
+class InstanceBatch
+	{ // class InstanceBatch
+	public:
+	// the copies added since the last Clear()
+	std::vector<MeshInstance> instances;
+
+	// draw calls issued by the last Render()
+	long drawCalls;
+
+	// constructor will initialise to an empty batch
+	InstanceBatch();
+
+	// forgets the copies, keeping the memory for the next frame
+	void Clear();
+
+	// adds a copy of the mesh
+	void Add(const columnMajorMatrix &modelViewMatrix, const float *colour);
+
+	// draws a copy of the mesh for each instance, with the current lighting
+	// where the colour has to be set per copy, it goes through the state cache
+	// must be called on the thread that owns the context
+	void Render(const HomogeneousFaceSurface &mesh, GLStateCache &state);
+
+	// true if the current context can draw a batch in one call, and this
+	// has not been switched off
+	static bool InstancingAvailable();
+
+	// switches instanced drawing on or off, for comparison with one draw per copy
+	static void SetInstancingEnabled(bool enabled);
+
+	private:
+	// the instances on the card, reallocated only when the batch grows
+	VertexBuffer instanceBuffer;
+
+	// the three ways of drawing, best first
+	void RenderInstanced(const HomogeneousFaceSurface &mesh);
+	void RenderPerInstance(const HomogeneousFaceSurface &mesh, GLStateCache &state);
+	void RenderImmediate(const HomogeneousFaceSurface &mesh, GLStateCache &state);
+	}; // class InstanceBatch
+
+#endif
@@ -186,6 +186,21 @@ class columnMajorMatrix
         return rotationMatrix;
     }
 
+    // Perspective projection matching gluPerspective(), field of view in degrees
+    static columnMajorMatrix Perspective(float fieldOfViewY, float aspectRatio, float nearPlane, float farPlane)
+    {
+        float f = 1.0f / std::tan(DEG2RAD(fieldOfViewY) / 2.0f);
+
+        columnMajorMatrix ret;
+        ret.coordinates[0] = f / aspectRatio;
+        ret.coordinates[5] = f;
+        ret.coordinates[10] = (farPlane + nearPlane) / (nearPlane - farPlane);
+        ret.coordinates[11] = -1.0f;
+        ret.coordinates[14] = (2.0f * farPlane * nearPlane) / (nearPlane - farPlane);
+
+        return ret;
+    }
+
     // View matrix 
     static columnMajorMatrix constructView(const Cartesian3& camerpos, const Cartesian3& target, const Cartesian3& up)
     {	
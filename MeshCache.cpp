@@ -0,0 +1,54 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	MeshCache.cpp
+//	------------------------
+//
+//	Loads each triangle soup model once and hands
+//	out shared, read-only handles to it, so that
+//	every plane or lava bomb using a model draws
+//	the same copy instead of parsing its own.
+//
+///////////////////////////////////////////////////
+
+#include "MeshCache.h"
+
+// returns the model in a triangle soup file, reading it on first use only
+MeshHandle MeshCache::Load(const char *fileName)
+	{ // Load()
+	std::lock_guard<std::mutex> lock(mutex);
+	auto cached = meshes.find(fileName);
+	if (cached != meshes.end())
+		return cached->second;
+
+	// first use: read it, and keep it for the next caller
+	std::shared_ptr<HomogeneousFaceSurface> mesh = std::make_shared<HomogeneousFaceSurface>();
+	mesh->ReadFileTriangleSoup(fileName);
+	meshes.emplace(fileName, mesh);
+	return mesh;
+	} // Load()
+
+// number of distinct models loaded
+size_t MeshCache::MeshCount()
+	{ // MeshCount()
+	std::lock_guard<std::mutex> lock(mutex);
+	return meshes.size();
+	} // MeshCount()
+
+// forgets models that nothing else holds, so that they are freed
+void MeshCache::ReleaseUnused()
+	{ // ReleaseUnused()
+	std::lock_guard<std::mutex> lock(mutex);
+	for (auto mesh = meshes.begin(); mesh != meshes.end(); )
+		if (mesh->second.use_count() == 1)
+			mesh = meshes.erase(mesh);
+		else
+			++mesh;
+	} // ReleaseUnused()
+
+// the cache shared by the whole program
+MeshCache &MeshCache::Shared()
+	{ // Shared()
+	static MeshCache sharedCache;
+	return sharedCache;
+	} // Shared()
@@ -0,0 +1,51 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	MeshCache.h
+//	------------------------
+//
+//	Loads each triangle soup model once and hands
+//	out shared, read-only handles to it, so that
+//	every plane or lava bomb using a model draws
+//	the same copy instead of parsing its own.
+//
+///////////////////////////////////////////////////
+
+#ifndef _MESH_CACHE_H
+#define _MESH_CACHE_H
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "HomogeneousFaceSurface.h"
+
+// a shared, read-only model: copying one only bumps a reference count
+typedef std::shared_ptr<const HomogeneousFaceSurface> MeshHandle;
+
+class MeshCache
+	{ // class MeshCache
+	public:
+	// returns the model in a triangle soup file, reading it on first use only
+	// a file that cannot be read gives an empty model, as reading one directly does
+	// safe to call from any thread
+	MeshHandle Load(const char *fileName);
+
+	// number of distinct models loaded
+	size_t MeshCount();
+
+	// forgets models that nothing else holds, so that they are freed
+	void ReleaseUnused();
+
+	// the cache shared by the whole program
+	static MeshCache &Shared();
+
+	private:
+	// models by file name; the transparent comparison finds a name given as a
+	// C string without building a std::string
+	std::map<std::string, MeshHandle, std::less<> > meshes;
+	std::mutex mutex;
+	}; // class MeshCache
+
+#endif
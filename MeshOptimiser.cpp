@@ -0,0 +1,323 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	MeshOptimiser.cpp
+//	------------------------
+//
+//	Prepares indexed triangles for the card's post
+//	transform vertex cache.  Duplicate vertices are
+//	welded so that triangles can share them, and
+//	the triangles are reordered with Forsyth's
+//	linear-speed algorithm so that each shared
+//	vertex is used again while still in the cache.
+//
+//	Forsyth scores every vertex by how recently it
+//	entered a simulated LRU cache and by how few
+//	triangles still use it, and always draws next
+//	the best scoring triangle that touches the
+//	cache.  Only the triangles of the vertices in
+//	the cache are rescored, so the cost is linear.
+//
+///////////////////////////////////////////////////
+
+#include "MeshOptimiser.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <math.h>
+#include <unordered_map>
+#include <utility>
+
+// Forsyth's published constants
+#define CACHE_DECAY_POWER 1.5f
+#define LAST_TRIANGLE_SCORE 0.75f
+#define VALENCE_BOOST_SCALE 2.0f
+#define VALENCE_BOOST_POWER 0.5f
+
+// set by SetMeshOptimisationEnabled()
+static bool optimisationEnabled = true;
+
+// switches the reordering on or off
+void SetMeshOptimisationEnabled(bool enabled)
+	{ // SetMeshOptimisationEnabled()
+	optimisationEnabled = enabled;
+	} // SetMeshOptimisationEnabled()
+
+bool MeshOptimisationEnabled()
+	{ // MeshOptimisationEnabled()
+	return optimisationEnabled;
+	} // MeshOptimisationEnabled()
+
+// the bit patterns of a vertex, so that welding compares exactly and hashes cheaply
+struct VertexBits
+	{ // struct VertexBits
+	uint32_t bits[4];
+
+	bool operator ==(const VertexBits &other) const
+		{ return memcmp(bits, other.bits, sizeof(bits)) == 0; }
+	}; // struct VertexBits
+
+struct VertexBitsHash
+	{ // struct VertexBitsHash
+	size_t operator ()(const VertexBits &vertex) const
+		{ // operator ()
+		uint64_t hash = 14695981039346656037ULL;
+		for (int coordinate = 0; coordinate < 4; coordinate++)
+			hash = (hash ^ vertex.bits[coordinate]) * 1099511628211ULL;
+		return (size_t) hash;
+		} // operator ()
+	}; // struct VertexBitsHash
+
+// finds the distinct vertices among count, comparing every coordinate exactly
+void WeldVertices(const Homogeneous4 *vertices, long count, std::vector<Homogeneous4> &unique, std::vector<unsigned int> &indices)
+	{ // WeldVertices()
+	unique.clear();
+	indices.resize(count);
+	std::unordered_map<VertexBits, unsigned int, VertexBitsHash> seen;
+	seen.reserve(count);
+	for (long vertex = 0; vertex < count; vertex++)
+		{ // per vertex
+		VertexBits key;
+		memcpy(key.bits, &vertices[vertex].x, sizeof(key.bits));
+		auto found = seen.emplace(key, (unsigned int) unique.size());
+		if (found.second)
+			unique.push_back(vertices[vertex]);
+		indices[vertex] = found.first->second;
+		} // per vertex
+	} // WeldVertices()
+
+// a vertex's score: higher the more recently it was used, and the fewer triangles still need it
+// cacheScores and valenceScores are the tables the scores are looked up from
+static inline float VertexScore(int cachePosition, int remainingTriangles, const float *cacheScores, const float *valenceScores, int valenceTableSize)
+	{ // VertexScore()
+	// nothing left to draw with it
+	if (remainingTriangles == 0)
+		return -1.0f;
+	float score = cachePosition < 0 ? 0.0f : cacheScores[cachePosition];
+	// a boost for vertices with few triangles left, so that they are finished off rather than stranded
+	if (remainingTriangles < valenceTableSize)
+		return score + valenceScores[remainingTriangles];
+	return score + VALENCE_BOOST_SCALE * powf((float) remainingTriangles, -VALENCE_BOOST_POWER);
+	} // VertexScore()
+
+// reorders indexCount / 3 triangles for the vertex cache
+void OptimiseVertexCache(unsigned int *indices, long indexCount)
+	{ // OptimiseVertexCache()
+	long triangleCount = indexCount / 3;
+	if (!optimisationEnabled || triangleCount < 2)
+		return;
+
+	// number the vertices used from 0, since they may be a few scattered over a large array
+	std::vector<unsigned int> distinct(indices, indices + 3 * triangleCount);
+	std::sort(distinct.begin(), distinct.end());
+	distinct.erase(std::unique(distinct.begin(), distinct.end()), distinct.end());
+	long vertexCount = distinct.size();
+	std::vector<int> corners(3 * triangleCount);
+	for (long corner = 0; corner < 3 * triangleCount; corner++)
+		corners[corner] = std::lower_bound(distinct.begin(), distinct.end(), indices[corner]) - distinct.begin();
+
+	// the triangles using each vertex, as one array with a run per vertex
+	// the first remainingTriangles[vertex] of each run are the ones not yet drawn
+	std::vector<int> remainingTriangles(vertexCount, 0), firstUse(vertexCount + 1, 0), uses(3 * triangleCount);
+	for (long corner = 0; corner < 3 * triangleCount; corner++)
+		remainingTriangles[corners[corner]]++;
+	for (long vertex = 0; vertex < vertexCount; vertex++)
+		firstUse[vertex + 1] = firstUse[vertex] + remainingTriangles[vertex];
+	std::vector<int> filled(firstUse.begin(), firstUse.end() - 1);
+	for (long corner = 0; corner < 3 * triangleCount; corner++)
+		uses[filled[corners[corner]]++] = corner / 3;
+
+	// score tables: the three most recent vertices score the same, since the triangle
+	// just drawn would otherwise be favoured to use them yet again
+	float cacheScores[MESH_OPTIMISER_CACHE_SIZE];
+	for (int position = 0; position < MESH_OPTIMISER_CACHE_SIZE; position++)
+		cacheScores[position] = position < 3 ? LAST_TRIANGLE_SCORE
+			: powf(1.0f - (position - 3) / (float) (MESH_OPTIMISER_CACHE_SIZE - 3), CACHE_DECAY_POWER);
+	const int valenceTableSize = 32;
+	float valenceScores[valenceTableSize];
+	valenceScores[0] = 0.0f;
+	for (int valence = 1; valence < valenceTableSize; valence++)
+		valenceScores[valence] = VALENCE_BOOST_SCALE * powf((float) valence, -VALENCE_BOOST_POWER);
+
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> vertexScores(vertexCount), triangleScores(triangleCount, 0.0f);
+	for (long vertex = 0; vertex < vertexCount; vertex++)
+		vertexScores[vertex] = VertexScore(-1, remainingTriangles[vertex], cacheScores, valenceScores, valenceTableSize);
+	for (long corner = 0; corner < 3 * triangleCount; corner++)
+		triangleScores[corner / 3] += vertexScores[corners[corner]];
+	std::vector<unsigned char> drawn(triangleCount, 0);
+
+	// the LRU cache, with room for the three new corners before the oldest fall out
+	int cache[MESH_OPTIMISER_CACHE_SIZE + 3], newCache[MESH_OPTIMISER_CACHE_SIZE + 3];
+	int cacheCount = 0;
+
+	std::vector<unsigned int> ordered;
+	ordered.reserve(3 * triangleCount);
+	long bestTriangle = std::max_element(triangleScores.begin(), triangleScores.end()) - triangleScores.begin();
+	long nextUndrawn = 0;
+	for (long drawnCount = 0; drawnCount < triangleCount; drawnCount++)
+		{ // per triangle drawn
+		// nothing in the cache leads on: start again from the first triangle left
+		if (bestTriangle < 0)
+			{ // dead end
+			while (drawn[nextUndrawn])
+				nextUndrawn++;
+			bestTriangle = nextUndrawn;
+			} // dead end
+
+		// draw it, and take it off its vertices' lists
+		drawn[bestTriangle] = 1;
+		for (int corner = 0; corner < 3; corner++)
+			{ // per corner
+			ordered.push_back(indices[3 * bestTriangle + corner]);
+			int vertex = corners[3 * bestTriangle + corner];
+			int *first = &uses[firstUse[vertex]], *last = first + remainingTriangles[vertex] - 1;
+			std::swap(*std::find(first, last + 1, (int) bestTriangle), *last);
+			remainingTriangles[vertex]--;
+			} // per corner
+
+		// the corners go to the front of the cache, and everything else moves back
+		int newCount = 0;
+		for (int corner = 0; corner < 3; corner++)
+			{ // per corner
+			int vertex = corners[3 * bestTriangle + corner];
+			if (std::find(newCache, newCache + newCount, vertex) == newCache + newCount)
+				newCache[newCount++] = vertex;
+			} // per corner
+		int cornerCount = newCount;
+		for (int entry = 0; entry < cacheCount; entry++)
+			if (std::find(newCache, newCache + cornerCount, cache[entry]) == newCache + cornerCount)
+				newCache[newCount++] = cache[entry];
+
+		// rescore the vertices that moved, including any that fell out, and their triangles
+		for (int entry = 0; entry < newCount; entry++)
+			{ // per vertex touched
+			int vertex = newCache[entry];
+			cachePosition[vertex] = entry < MESH_OPTIMISER_CACHE_SIZE ? entry : -1;
+			float score = VertexScore(cachePosition[vertex], remainingTriangles[vertex], cacheScores, valenceScores, valenceTableSize);
+			float change = score - vertexScores[vertex];
+			vertexScores[vertex] = score;
+			for (int use = firstUse[vertex]; use < firstUse[vertex] + remainingTriangles[vertex]; use++)
+				triangleScores[uses[use]] += change;
+			} // per vertex touched
+		cacheCount = std::min(newCount, MESH_OPTIMISER_CACHE_SIZE);
+		for (int entry = 0; entry < cacheCount; entry++)
+			cache[entry] = newCache[entry];
+
+		// the next triangle is the best of those using a vertex in the cache
+		bestTriangle = -1;
+		float bestScore = -1.0f;
+		for (int entry = 0; entry < cacheCount; entry++)
+			for (int use = firstUse[cache[entry]]; use < firstUse[cache[entry]] + remainingTriangles[cache[entry]]; use++)
+				if (triangleScores[uses[use]] > bestScore)
+					{ // better
+					bestScore = triangleScores[uses[use]];
+					bestTriangle = uses[use];
+					} // better
+		} // per triangle drawn
+
+	std::copy(ordered.begin(), ordered.end(), indices);
+	} // OptimiseVertexCache()
+
+// the vertices transformed per triangle through a first-in first-out cache
+double AverageCacheMissRatio(const unsigned int *indices, long indexCount, int cacheSize)
+	{ // AverageCacheMissRatio()
+	long triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+		return 0.0;
+
+	// a vertex is in the cache if fewer than cacheSize misses have happened since it was loaded
+	unsigned int largest = *std::max_element(indices, indices + 3 * triangleCount);
+	std::vector<long> loadedAt(largest + 1, -1);
+	long misses = 0;
+	for (long corner = 0; corner < 3 * triangleCount; corner++)
+		{ // per corner
+		long &loaded = loadedAt[indices[corner]];
+		if (loaded < 0 || misses - loaded >= cacheSize)
+			loaded = misses++;
+		} // per corner
+	return misses / (double) triangleCount;
+	} // AverageCacheMissRatio()
+
+// the directed edge from a to b, as a sort key
+static inline uint64_t EdgeKey(unsigned int a, unsigned int b)
+	{ // EdgeKey()
+	return ((uint64_t) a << 32) | b;
+	} // EdgeKey()
+
+// joins triangles into a single triangle strip
+// each run is grown greedily from the first triangle left, through the neighbour across
+// its newest edge; a strip's triangles alternate in winding, so the edge wanted alternates too
+void BuildTriangleStrip(const unsigned int *indices, long indexCount, std::vector<unsigned int> &strip)
+	{ // BuildTriangleStrip()
+	strip.clear();
+	long triangleCount = indexCount / 3;
+
+	// every triangle under each of its three directed edges, sorted for lookup
+	std::vector<std::pair<uint64_t, long> > edges;
+	edges.reserve(3 * triangleCount);
+	for (long triangle = 0; triangle < triangleCount; triangle++)
+		for (int corner = 0; corner < 3; corner++)
+			edges.push_back(std::make_pair(EdgeKey(indices[3 * triangle + corner], indices[3 * triangle + (corner + 1) % 3]), triangle));
+	std::sort(edges.begin(), edges.end());
+	std::vector<unsigned char> used(triangleCount, 0);
+
+	// an unused triangle with the directed edge a to b, and its third corner, or -1
+	auto Neighbour = [&](unsigned int a, unsigned int b, unsigned int &third) -> long
+		{ // Neighbour()
+		uint64_t key = EdgeKey(a, b);
+		for (auto edge = std::lower_bound(edges.begin(), edges.end(), std::make_pair(key, -1L)); edge != edges.end() && edge->first == key; edge++)
+			if (!used[edge->second])
+				{ // found one
+				for (int corner = 0; corner < 3; corner++)
+					if (indices[3 * edge->second + corner] == a && indices[3 * edge->second + (corner + 1) % 3] == b)
+						third = indices[3 * edge->second + (corner + 2) % 3];
+				return edge->second;
+				} // found one
+		return -1;
+		}; // Neighbour()
+
+	std::vector<unsigned int> run;
+	for (long start = 0; start < triangleCount; start++)
+		{ // per run
+		if (used[start])
+			continue;
+		used[start] = 1;
+
+		// begin with the rotation whose far edge leads on to another triangle, if any does
+		const unsigned int *corner = &indices[3 * start];
+		int rotation = 0;
+		unsigned int third;
+		for (int trial = 0; trial < 3; trial++)
+			if (Neighbour(corner[(trial + 2) % 3], corner[(trial + 1) % 3], third) >= 0)
+				{ // leads on
+				rotation = trial;
+				break;
+				} // leads on
+		run.assign({ corner[rotation], corner[(rotation + 1) % 3], corner[(rotation + 2) % 3] });
+
+		// the triangle at strip position k has the edge from run[k] to run[k+1] if k is even,
+		// and from run[k+1] to run[k] if k is odd
+		while (true)
+			{ // extend
+			size_t k = run.size() - 2;
+			long next = k % 2 == 0 ? Neighbour(run[k], run[k + 1], third) : Neighbour(run[k + 1], run[k], third);
+			if (next < 0)
+				break;
+			used[next] = 1;
+			run.push_back(third);
+			} // extend
+
+		// join with two degenerate triangles, or three if the run would start on an odd position
+		if (!strip.empty())
+			{ // join
+			unsigned int last = strip.back();
+			if (strip.size() % 2 == 1)
+				strip.push_back(last);
+			strip.push_back(last);
+			strip.push_back(run[0]);
+			} // join
+		strip.insert(strip.end(), run.begin(), run.end());
+		} // per run
+	} // BuildTriangleStrip()
@@ -0,0 +1,56 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	MeshOptimiser.h
+//	------------------------
+//
+//	Prepares indexed triangles for the card's post
+//	transform vertex cache.  Duplicate vertices are
+//	welded so that triangles can share them, and
+//	the triangles are reordered with Forsyth's
+//	linear-speed algorithm so that each shared
+//	vertex is used again while still in the cache.
+//	The average cache miss ratio (ACMR) measures
+//	the result: the vertices transformed for each
+//	triangle drawn, from 3 for a triangle soup down
+//	to about 0.5 for a large regular grid.
+//
+///////////////////////////////////////////////////
+
+#ifndef _MESH_OPTIMISER_H
+#define _MESH_OPTIMISER_H
+
+#include <vector>
+
+#include "Homogeneous4.h"
+
+// the cache the triangles are ordered for, and the FIFO cache the ACMR is measured with
+// cards since the mid-2000s keep at least this many vertices
+#define MESH_OPTIMISER_CACHE_SIZE 32
+
+// switches the reordering on or off, for comparison; welding is unaffected
+void SetMeshOptimisationEnabled(bool enabled);
+bool MeshOptimisationEnabled();
+
+// finds the distinct vertices among count, comparing every coordinate exactly
+// unique receives each distinct vertex once, in order of first use, and
+// indices[i] the position of vertex i in unique
+void WeldVertices(const Homogeneous4 *vertices, long count, std::vector<Homogeneous4> &unique, std::vector<unsigned int> &indices);
+
+// reorders indexCount / 3 triangles for the vertex cache, keeping the corners of each
+// triangle in the same order, so that winding and the provoking vertex are unchanged
+// the indices may be scattered over a large vertex array, as the terrain's chunks are
+// does nothing if the optimisation is switched off
+void OptimiseVertexCache(unsigned int *indices, long indexCount);
+
+// the vertices transformed per triangle when drawing indexCount / 3 triangles in order,
+// through a first-in first-out cache of cacheSize vertices
+double AverageCacheMissRatio(const unsigned int *indices, long indexCount, int cacheSize = MESH_OPTIMISER_CACHE_SIZE);
+
+// joins triangles into a single triangle strip, with degenerate triangles between
+// the runs, keeping each triangle's winding; the triangles are taken in the order given
+// under flat shading a strip changes each triangle's provoking vertex, so the scene
+// draws lists, and this is for meshes with smooth shading or for comparison
+void BuildTriangleStrip(const unsigned int *indices, long indexCount, std::vector<unsigned int> &strip);
+
+#endif
@@ -0,0 +1,159 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	OffscreenContext.cpp
+//	------------------------
+//
+//	An OpenGL context that renders into an image in
+//	memory instead of a window, so that frames can
+//	be drawn and timed on machines with no display.
+//	On Linux it is an EGL pbuffer, which Mesa and
+//	the vendor drivers provide without an X server.
+//	Elsewhere it is a Qt offscreen surface drawing
+//	into a framebuffer object.
+//
+///////////////////////////////////////////////////
+
+#include "OffscreenContext.h"
+
+#ifdef OFFSCREEN_CONTEXT_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GL/gl.h>
+#else
+#include <QGuiApplication>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLFramebufferObject>
+#include <QSurfaceFormat>
+#ifdef __APPLE__
+#include <OpenGL/gl.h>
+#else
+#include <GL/gl.h>
+#endif
+#endif
+
+// constructor will initialise to no context
+OffscreenContext::OffscreenContext()
+	:
+#ifdef OFFSCREEN_CONTEXT_EGL
+	display(EGL_NO_DISPLAY),
+	surface(EGL_NO_SURFACE),
+	context(EGL_NO_CONTEXT)
+#else
+	surface(NULL),
+	context(NULL),
+	framebuffer(NULL)
+#endif
+	{ // constructor
+	} // constructor
+
+#ifdef OFFSCREEN_CONTEXT_EGL
+
+// destructor releases the context
+OffscreenContext::~OffscreenContext()
+	{ // destructor
+	if (display == EGL_NO_DISPLAY)
+		return;
+	eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	if (context != EGL_NO_CONTEXT)
+		eglDestroyContext(display, context);
+	if (surface != EGL_NO_SURFACE)
+		eglDestroySurface(display, surface);
+	eglTerminate(display);
+	} // destructor
+
+// creates a compatibility context with a width x height colour and depth buffer
+bool OffscreenContext::Create(int width, int height)
+	{ // Create()
+	// the default display needs an X server or Wayland compositor, so without one
+	// fall back to Mesa's surfaceless platform, which only renders offscreen
+	display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL))
+		{ // no default display
+		PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+		display = getPlatformDisplay == NULL ? EGL_NO_DISPLAY : getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+		if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL))
+			{ // no EGL at all
+			display = EGL_NO_DISPLAY;
+			return false;
+			} // no EGL at all
+		} // no default display
+
+	// desktop OpenGL rather than ES, since the scene uses the fixed-function pipeline
+	if (!eglBindAPI(EGL_OPENGL_API))
+		return false;
+
+	EGLint configAttributes[] = {	EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+									EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_DEPTH_SIZE, 24, EGL_NONE };
+	EGLConfig config;
+	EGLint configs = 0;
+	if (!eglChooseConfig(display, configAttributes, &config, 1, &configs) || configs == 0)
+		return false;
+
+	EGLint surfaceAttributes[] = { EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE };
+	surface = eglCreatePbufferSurface(display, config, surfaceAttributes);
+	if (surface == EGL_NO_SURFACE)
+		return false;
+
+	// no version asked for, which gives a compatibility context
+	context = eglCreateContext(display, config, EGL_NO_CONTEXT, NULL);
+	if (context == EGL_NO_CONTEXT)
+		return false;
+
+	return eglMakeCurrent(display, surface, surface, context);
+	} // Create()
+
+#else
+
+// destructor releases the context
+OffscreenContext::~OffscreenContext()
+	{ // destructor
+	if (context != NULL)
+		context->makeCurrent(surface);
+	delete framebuffer;
+	if (context != NULL)
+		context->doneCurrent();
+	delete context;
+	delete surface;
+	} // destructor
+
+// creates a compatibility context with a width x height colour and depth buffer
+bool OffscreenContext::Create(int width, int height)
+	{ // Create()
+	// Qt surfaces need an application object, which the command-line tools don't otherwise make
+	static int argc = 1;
+	static char name[] = "A1_handout";
+	static char *argv[] = { name, NULL };
+	if (QGuiApplication::instance() == NULL)
+		new QGuiApplication(argc, argv);
+
+	QSurfaceFormat format;
+	format.setProfile(QSurfaceFormat::CompatibilityProfile);
+	format.setDepthBufferSize(24);
+
+	surface = new QOffscreenSurface();
+	surface->setFormat(format);
+	surface->create();
+
+	context = new QOpenGLContext();
+	context->setFormat(format);
+	if (!context->create() || !context->makeCurrent(surface))
+		return false;
+
+	// the surface itself may have no pixels, so draw into a framebuffer object instead
+	framebuffer = new QOpenGLFramebufferObject(width, height, QOpenGLFramebufferObject::Depth);
+	return framebuffer->isValid() && framebuffer->bind();
+	} // Create()
+
+#endif
+
+// the GL version and renderer, once created
+std::string OffscreenContext::Description() const
+	{ // Description()
+	const char *version = (const char *) glGetString(GL_VERSION);
+	const char *renderer = (const char *) glGetString(GL_RENDERER);
+	if (version == NULL || renderer == NULL)
+		return "no context";
+	return std::string("OpenGL ") + version + " on " + renderer;
+	} // Description()
@@ -0,0 +1,60 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	OffscreenContext.h
+//	------------------------
+//
+//	An OpenGL context that renders into an image in
+//	memory instead of a window, so that frames can
+//	be drawn and timed on machines with no display.
+//	On Linux it is an EGL pbuffer, which Mesa and
+//	the vendor drivers provide without an X server.
+//	Elsewhere it is a Qt offscreen surface drawing
+//	into a framebuffer object.
+//
+///////////////////////////////////////////////////
+
+#ifndef _OFFSCREEN_CONTEXT_H
+#define _OFFSCREEN_CONTEXT_H
+
+#include <string>
+
+#if defined(__linux__)
+#define OFFSCREEN_CONTEXT_EGL
+#else
+class QOffscreenSurface;
+class QOpenGLContext;
+class QOpenGLFramebufferObject;
+#endif
+
+class OffscreenContext
+	{ // class OffscreenContext
+	public:
+	// constructor will initialise to no context
+	OffscreenContext();
+	// destructor releases the context
+	~OffscreenContext();
+
+	// creates a compatibility context with a width x height colour and depth buffer,
+	// and makes it current on this thread; returns false if there is none to be had
+	bool Create(int width, int height);
+
+	// the GL version and renderer, once created
+	std::string Description() const;
+
+	private:
+	// no copies: there is only one context
+	OffscreenContext(const OffscreenContext &other);
+	OffscreenContext &operator =(const OffscreenContext &other);
+
+#ifdef OFFSCREEN_CONTEXT_EGL
+	// EGLDisplay, EGLSurface and EGLContext, which are all pointers
+	void *display, *surface, *context;
+#else
+	QOffscreenSurface *surface;
+	QOpenGLContext *context;
+	QOpenGLFramebufferObject *framebuffer;
+#endif
+	}; // class OffscreenContext
+
+#endif
@@ -1,11 +1,17 @@
 #include "Particle.h"
 
 Particle::Particle(const char *fileName, const Cartesian3& direction, float speed, float s)
+    : Particle(MeshCache::Shared().Load(fileName), direction, speed, s)
 {
-        // Load lava bomb model and init default particle values
-        lavaBombModel.ReadFileTriangleSoup(fileName);
+}
+
+Particle::Particle(const MeshHandle& model, const Cartesian3& direction, float speed, float s)
+{
+        // Share the lava bomb model (loaded once for all particles) and init default particle values
+        lavaBombModel = model;
         m_direction = direction;
         m_position = Cartesian3(-38500.0f, 1000.0f, -4000); // default position
+        m_previousPosition = m_position;
         m_velocity.x = direction.x;
         m_velocity.y = direction.y;
         m_velocity.z = direction.z;
@@ -37,7 +43,7 @@ void Particle::CreateChildren()
     // we use the same direction as main particle 
     for(int i = 0; i < 5; i++)
     {   
-        Particle* p = new Particle("./models/lavaBombModel.tri", m_direction, 2.0f, 1.0f);
+        Particle* p = new Particle(lavaBombModel, m_direction, 2.0f, 1.0f);
         children.push_back(p);
     }
 }
@@ -45,6 +51,9 @@ void Particle::CreateChildren()
 // Update particle data each frame to ensure the particle physics and movement are correct 
 void Particle::Update(float dt, const columnMajorMatrix& worldMatrix, const columnMajorMatrix& viewMatrix)
 {
+    // Remember where the particle was, so that collision can check the whole path it moved along
+    m_previousPosition = m_position;
+
     // Update position (s = ut + 1/2at^2)
     // Gibbs, K. (2016). schoolphysics ::Welcome:: [online] www.schoolphysics.co.uk. Available at: https://www.schoolphysics.co.uk/age14-16/Mechanics/Motion/text/Equations_of_motion/index.html.
     m_position.x += m_velocity.x * dt;
@@ -2,12 +2,14 @@
 #include <cstdlib>
 #include <ctime>
 #include "Matrix4.h"
-#include "HomogeneousFaceSurface.h"
+#include "MeshCache.h"
 
 class Particle
 {
 public:
     Particle(const char *fileName, const Cartesian3& direction, float speed, float s);
+    // Share an already loaded model, as the smoke children do
+    Particle(const MeshHandle& model, const Cartesian3& direction, float speed, float s);
     ~Particle();
 
     // Push will apply some force to the particle to move it,
@@ -20,8 +22,9 @@ public:
     
     // Getters for the particle to get private properties
     Cartesian3 GetPosition() const { return m_position; }
+    Cartesian3 GetPreviousPosition() const { return m_previousPosition; }
     Cartesian3 GetDirection() const  { return m_direction; }
-    std::vector<Particle*> GetChildren() const { return children; }
+    const std::vector<Particle*>& GetChildren() const { return children; }
     float GetCollisionSphereRadius() const { return m_collisionSphereRadius; }
     const float* GetColor() { return lavaBombColour; }
     const float* GetChildColor() { return childSmoke; }
@@ -35,12 +38,13 @@ public:
     void SetPosition(Cartesian3 position);
     void SetVelocity(Cartesian3 velocity);
 
-    // Rendering models remain public 
-    HomogeneousFaceSurface lavaBombModel;
+    // Rendering models remain public, shared with every particle using the same file
+    MeshHandle lavaBombModel;
     columnMajorMatrix modelMatrix; // leave model matrix public since the render method doesnt reqires an l-value so a get method is not useful
 private:
 
     Cartesian3 m_position;
+    Cartesian3 m_previousPosition; // position before the last Update
     Cartesian3 m_velocity;
     Cartesian3 m_direction;
     float m_mass;
@@ -0,0 +1,333 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	ParticleSystem.cpp
+//	------------------------
+//
+//	Lava bombs and their smoke as a structure of
+//	arrays.  Integration loads the same lane of
+//	the position and velocity arrays, so that each
+//	register holds one coordinate of four or eight
+//	particles, and the step is a multiply-add per
+//	coordinate with dt and gravity broadcast.
+//
+//	Integration and the modelview matrices are
+//	split across the shared thread pool in tasks of
+//	PARTICLES_PER_TASK particles.  Each particle is
+//	only read and written by the task it falls in,
+//	so the results are the same on any number of
+//	threads.
+//
+//	Every array is reserved at its full capacity
+//	when the pool is made, and resizing a vector
+//	within its capacity never reallocates, so that
+//	spawning and removing particles in the steady
+//	state makes no heap allocations at all.
+//
+///////////////////////////////////////////////////
+
+#include "ParticleSystem.h"
+#include "ThreadPool.h"
+#include "TransformKernels.h"
+
+#include <algorithm>
+
+#if defined(__SSE__) || defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+#if defined(__AVX__)
+// a * b + c, fused where the machine allows
+static inline __m256 MultiplyAdd(__m256 a, __m256 b, __m256 c)
+	{ // MultiplyAdd()
+#if defined(__FMA__)
+	return _mm256_fmadd_ps(a, b, c);
+#else
+	return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+	} // MultiplyAdd()
+#endif
+
+#if defined(__SSE__)
+static inline __m128 MultiplyAdd(__m128 a, __m128 b, __m128 c)
+	{ // MultiplyAdd()
+#if defined(__FMA__)
+	return _mm_fmadd_ps(a, b, c);
+#else
+	return _mm_add_ps(_mm_mul_ps(a, b), c);
+#endif
+	} // MultiplyAdd()
+#endif
+
+// every per-particle array of floats, so that they can all be resized or moved together
+static std::vector<float> ParticleSystem::* const floatArrays[] = {
+	&ParticleSystem::positionX, &ParticleSystem::positionY, &ParticleSystem::positionZ,
+	&ParticleSystem::previousX, &ParticleSystem::previousY, &ParticleSystem::previousZ,
+	&ParticleSystem::velocityX, &ParticleSystem::velocityY, &ParticleSystem::velocityZ,
+	&ParticleSystem::directionX, &ParticleSystem::directionY, &ParticleSystem::directionZ,
+	&ParticleSystem::red, &ParticleSystem::green, &ParticleSystem::blue, &ParticleSystem::alpha,
+	&ParticleSystem::scale, &ParticleSystem::age };
+
+// the slot number in a handle
+#define HANDLE_SLOT_MASK 0xffffffffLL
+
+// constructor will initialise to an empty pool of Capacity particles, allocating all its memory
+ParticleSystem::ParticleSystem(long Capacity, float Gravity, float CollisionRadius, float Lifetime)
+	:
+	gravity(Gravity),
+	collisionRadius(CollisionRadius),
+	lifetime(Lifetime),
+	capacity(Capacity),
+	slotIndex(Capacity, -1),
+	slotGeneration(Capacity, 0)
+	{ // constructor
+	for (std::vector<float> ParticleSystem::*array : floatArrays)
+		(this->*array).reserve(capacity);
+	flags.reserve(capacity);
+	handles.reserve(capacity);
+	eyeX.reserve(capacity);
+	eyeY.reserve(capacity);
+	eyeZ.reserve(capacity);
+	// the lowest slots are handed out first
+	freeSlots.reserve(capacity);
+	for (long slot = capacity - 1; slot >= 0; slot--)
+		freeSlots.push_back(slot);
+	} // constructor
+
+// adds a particle that has not yet moved, and returns its index, or -1 if the pool is full
+long ParticleSystem::Add(const Cartesian3 &position, const Cartesian3 &velocity, const Cartesian3 &direction, float Scale, const float *colour)
+	{ // Add()
+	long particle = Count();
+	if (particle >= capacity)
+		return -1;
+	Resize(particle + 1);
+	SetPosition(particle, position);
+	previousX[particle] = position.x;
+	previousY[particle] = position.y;
+	previousZ[particle] = position.z;
+	SetVelocity(particle, velocity);
+	directionX[particle] = direction.x;
+	directionY[particle] = direction.y;
+	directionZ[particle] = direction.z;
+	SetColour(particle, colour[0], colour[1], colour[2], colour[3]);
+	scale[particle] = Scale;
+	return particle;
+	} // Add()
+
+// sets the number of particles, up to the capacity
+void ParticleSystem::Resize(long count)
+	{ // Resize()
+	count = std::min(count, capacity);
+	long oldCount = Count();
+	for (long particle = oldCount - 1; particle >= count; particle--)
+		FreeSlot(particle);
+	for (std::vector<float> ParticleSystem::*array : floatArrays)
+		(this->*array).resize(count, 0.0f);
+	flags.resize(count, 0);
+	handles.resize(count);
+	for (long particle = oldCount; particle < count; particle++)
+		TakeSlot(particle);
+	} // Resize()
+
+// removes every particle
+void ParticleSystem::Clear()
+	{ // Clear()
+	Resize(0);
+	} // Clear()
+
+// removes a particle in constant time by moving the last particle into its place
+void ParticleSystem::Remove(long particle)
+	{ // Remove()
+	long last = Count() - 1;
+	FreeSlot(particle);
+	if (particle != last)
+		{ // move the last particle down
+		for (std::vector<float> ParticleSystem::*array : floatArrays)
+			(this->*array)[particle] = (this->*array)[last];
+		flags[particle] = flags[last];
+		handles[particle] = handles[last];
+		slotIndex[handles[particle] & HANDLE_SLOT_MASK] = particle;
+		} // move the last particle down
+	for (std::vector<float> ParticleSystem::*array : floatArrays)
+		(this->*array).pop_back();
+	flags.pop_back();
+	handles.pop_back();
+	} // Remove()
+
+// removes the particles flagged PARTICLE_EXPIRED, and any older than the lifetime
+void ParticleSystem::RemoveExpired()
+	{ // RemoveExpired()
+	// a particle moved into a removed one's place is checked in its turn
+	for (long particle = 0; particle < Count(); )
+		if ((flags[particle] & PARTICLE_EXPIRED) != 0 || (lifetime > 0.0f && age[particle] > lifetime))
+			Remove(particle);
+		else
+			particle++;
+	} // RemoveExpired()
+
+// the index of the particle with a handle, or -1 if it has been removed since
+long ParticleSystem::Find(long long handle) const
+	{ // Find()
+	long long slot = handle & HANDLE_SLOT_MASK;
+	if (handle < 0 || slot >= capacity || slotGeneration[slot] != handle >> 32)
+		return -1;
+	return slotIndex[slot];
+	} // Find()
+
+// takes a slot for a new particle at index
+void ParticleSystem::TakeSlot(long index)
+	{ // TakeSlot()
+	long slot = freeSlots.back();
+	freeSlots.pop_back();
+	slotIndex[slot] = index;
+	handles[index] = (slotGeneration[slot] << 32) | slot;
+	} // TakeSlot()
+
+// frees the slot of the particle at index, so that its handle no longer finds anything
+void ParticleSystem::FreeSlot(long index)
+	{ // FreeSlot()
+	long slot = handles[index] & HANDLE_SLOT_MASK;
+	slotIndex[slot] = -1;
+	slotGeneration[slot]++;
+	freeSlots.push_back(slot);
+	} // FreeSlot()
+
+void ParticleSystem::SetPosition(long particle, const Cartesian3 &position)
+	{ // SetPosition()
+	positionX[particle] = position.x;
+	positionY[particle] = position.y;
+	positionZ[particle] = position.z;
+	} // SetPosition()
+
+void ParticleSystem::SetVelocity(long particle, const Cartesian3 &velocity)
+	{ // SetVelocity()
+	velocityX[particle] = velocity.x;
+	velocityY[particle] = velocity.y;
+	velocityZ[particle] = velocity.z;
+	} // SetVelocity()
+
+void ParticleSystem::SetColour(long particle, float r, float g, float b, float a)
+	{ // SetColour()
+	red[particle] = r;
+	green[particle] = g;
+	blue[particle] = b;
+	alpha[particle] = a;
+	} // SetColour()
+
+// copies a particle's colour into an RGBA array
+void ParticleSystem::GetColour(long particle, float *colour) const
+	{ // GetColour()
+	colour[0] = red[particle];
+	colour[1] = green[particle];
+	colour[2] = blue[particle];
+	colour[3] = alpha[particle];
+	} // GetColour()
+
+// applies a force to a particle: with unit mass, the acceleration is the force
+void ParticleSystem::Push(long particle, const Cartesian3 &pushAmount)
+	{ // Push()
+	velocityX[particle] += pushAmount.x;
+	velocityY[particle] += pushAmount.y;
+	velocityZ[particle] += pushAmount.z;
+	} // Push()
+
+// advances every particle by dt seconds under gravity, remembering where each was
+void ParticleSystem::Integrate(float dt)
+	{ // Integrate()
+	ThreadPool::Shared().ParallelFor(0, Count(), PARTICLES_PER_TASK, [this, dt](long first, long end)
+		{ // per task
+		IntegrateRange(first, end, dt);
+		}); // per task
+	} // Integrate()
+
+// advances particles [first, end) by dt seconds
+void ParticleSystem::IntegrateRange(long first, long end, float dt)
+	{ // IntegrateRange()
+	long count = end, particle = first;
+	float *px = positionX.data(), *py = positionY.data(), *pz = positionZ.data();
+	float *qx = previousX.data(), *qy = previousY.data(), *qz = previousZ.data();
+	const float *vx = velocityX.data(), *vz = velocityZ.data();
+	float *vy = velocityY.data(), *ages = age.data();
+	// the drop from gravity over the step, and the speed gained
+	float fall = 0.5f * gravity * dt * dt, gain = gravity * dt;
+
+#if defined(__AVX__)
+	__m256 step8 = _mm256_set1_ps(dt), fall8 = _mm256_set1_ps(fall), gain8 = _mm256_set1_ps(gain);
+	for (; particle + 8 <= count; particle += 8)
+		{ // per eight particles
+		__m256 x = _mm256_loadu_ps(px + particle), y = _mm256_loadu_ps(py + particle), z = _mm256_loadu_ps(pz + particle);
+		__m256 velocity = _mm256_loadu_ps(vy + particle);
+		_mm256_storeu_ps(qx + particle, x);
+		_mm256_storeu_ps(qy + particle, y);
+		_mm256_storeu_ps(qz + particle, z);
+		_mm256_storeu_ps(px + particle, MultiplyAdd(_mm256_loadu_ps(vx + particle), step8, x));
+		_mm256_storeu_ps(py + particle, _mm256_add_ps(MultiplyAdd(velocity, step8, y), fall8));
+		_mm256_storeu_ps(pz + particle, MultiplyAdd(_mm256_loadu_ps(vz + particle), step8, z));
+		_mm256_storeu_ps(vy + particle, _mm256_add_ps(velocity, gain8));
+		_mm256_storeu_ps(ages + particle, _mm256_add_ps(_mm256_loadu_ps(ages + particle), step8));
+		} // per eight particles
+#endif
+
+#if defined(__SSE__)
+	__m128 step4 = _mm_set1_ps(dt), fall4 = _mm_set1_ps(fall), gain4 = _mm_set1_ps(gain);
+	for (; particle + 4 <= count; particle += 4)
+		{ // per four particles
+		__m128 x = _mm_loadu_ps(px + particle), y = _mm_loadu_ps(py + particle), z = _mm_loadu_ps(pz + particle);
+		__m128 velocity = _mm_loadu_ps(vy + particle);
+		_mm_storeu_ps(qx + particle, x);
+		_mm_storeu_ps(qy + particle, y);
+		_mm_storeu_ps(qz + particle, z);
+		_mm_storeu_ps(px + particle, MultiplyAdd(_mm_loadu_ps(vx + particle), step4, x));
+		_mm_storeu_ps(py + particle, _mm_add_ps(MultiplyAdd(velocity, step4, y), fall4));
+		_mm_storeu_ps(pz + particle, MultiplyAdd(_mm_loadu_ps(vz + particle), step4, z));
+		_mm_storeu_ps(vy + particle, _mm_add_ps(velocity, gain4));
+		_mm_storeu_ps(ages + particle, _mm_add_ps(_mm_loadu_ps(ages + particle), step4));
+		} // per four particles
+#endif
+
+	// the rest one at a time
+	for (; particle < count; particle++)
+		{ // per particle
+		qx[particle] = px[particle];
+		qy[particle] = py[particle];
+		qz[particle] = pz[particle];
+		px[particle] += vx[particle] * dt;
+		py[particle] += vy[particle] * dt + fall;
+		pz[particle] += vz[particle] * dt;
+		vy[particle] += gain;
+		ages[particle] += dt;
+		} // per particle
+	} // IntegrateRange()
+
+// the modelview matrix of every particle: viewMatrix * Translate(position) * worldMatrix * Scale(scale)
+// the three matrices on the right only scale the world matrix's columns and add the position to its
+// translation, so every particle shares the upper 3x3 of viewMatrix * worldMatrix, times its scale,
+// and its translation is its position moved to eye space, which is done for all of them in one batch
+void ParticleSystem::ModelViewMatrices(const columnMajorMatrix &viewMatrix, const columnMajorMatrix &worldMatrix, std::vector<columnMajorMatrix> &matrices) const
+	{ // ModelViewMatrices()
+	long count = Count();
+	matrices.resize(count);
+	columnMajorMatrix viewWorld = viewMatrix * worldMatrix;
+	const float *world = worldMatrix.coordinates;
+	columnMajorMatrix toEye = viewMatrix * columnMajorMatrix::Translate(Cartesian3(world[12], world[13], world[14]));
+
+	eyeX.resize(count);
+	eyeY.resize(count);
+	eyeZ.resize(count);
+	const float *rotation = viewWorld.coordinates;
+	ThreadPool::Shared().ParallelFor(0, count, PARTICLES_PER_TASK, [&](long first, long end)
+		{ // per task
+		TransformPointsSoA(toEye, positionX.data() + first, positionY.data() + first, positionZ.data() + first,
+			eyeX.data() + first, eyeY.data() + first, eyeZ.data() + first, end - first);
+		for (long particle = first; particle < end; particle++)
+			{ // per particle
+			float *m = matrices[particle].coordinates;
+			for (int entry = 0; entry < 12; entry++)
+				m[entry] = rotation[entry] * scale[particle];
+			m[12] = eyeX[particle];
+			m[13] = eyeY[particle];
+			m[14] = eyeZ[particle];
+			m[15] = 1.0f;
+			} // per particle
+		}); // per task
+	} // ModelViewMatrices()
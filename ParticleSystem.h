@@ -0,0 +1,145 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	ParticleSystem.h
+//	------------------------
+//
+//	Lava bombs and their smoke as a structure of
+//	arrays: each property of every particle is kept
+//	in an array of its own, indexed alike, so that
+//	integration streams through memory four or
+//	eight particles at a time with SSE or AVX,
+//	rather than visiting one object per particle.
+//	Every particle has unit mass and the same
+//	collision radius.
+//
+//	The arrays are a pool of fixed capacity, all
+//	allocated up front, so that adding and removing
+//	particles never touches the heap.  A particle
+//	is removed by moving the last one into its
+//	place, so the arrays stay packed; a handle,
+//	taken from a free list, follows each particle
+//	wherever it is moved.
+//
+///////////////////////////////////////////////////
+
+#ifndef _PARTICLE_SYSTEM_H
+#define _PARTICLE_SYSTEM_H
+
+#include <vector>
+
+#include "Cartesian3.h"
+#include "Matrix4.h"
+
+// the particles in each task when a system is split across the thread pool: a multiple of 8,
+// so that only the last task has a tail too short for the vector registers
+#define PARTICLES_PER_TASK 4096
+
+// bits of ParticleSystem::flags
+// set on a particle that has finished, such as a lava bomb that hit the ground
+#define PARTICLE_EXPIRED 1
+
+class ParticleSystem
+	{ // class ParticleSystem
+	public:
+	// where each particle is
+	std::vector<float> positionX, positionY, positionZ;
+	// where each was before the last Integrate(), so that collision can sweep its path
+	std::vector<float> previousX, previousY, previousZ;
+	std::vector<float> velocityX, velocityY, velocityZ;
+	// the direction each was launched in, which its smoke trails behind
+	std::vector<float> directionX, directionY, directionZ;
+	std::vector<float> red, green, blue, alpha;
+	// the scale of each particle's model
+	std::vector<float> scale;
+	// seconds each particle has been integrated for
+	std::vector<float> age;
+	std::vector<unsigned char> flags;
+
+	// the acceleration along y, and the radius of every particle's collision sphere
+	float gravity;
+	float collisionRadius;
+	// particles older than this are removed with the expired ones, unless it is 0
+	float lifetime;
+
+	// constructor will initialise to an empty pool of Capacity particles, allocating all its memory
+	ParticleSystem(long Capacity, float Gravity = -19.81f, float CollisionRadius = 86.0f, float Lifetime = 0.0f);
+
+	// the number of particles, and the most there can be
+	long Count() const	{ return positionX.size(); }
+	long Capacity() const	{ return capacity; }
+
+	// adds a particle that has not yet moved, and returns its index, or -1 if the pool is full
+	long Add(const Cartesian3 &position, const Cartesian3 &velocity, const Cartesian3 &direction, float Scale, const float *colour);
+
+	// sets the number of particles, up to the capacity; any added are at the origin, at rest, with no scale
+	void Resize(long count);
+
+	// removes every particle
+	void Clear();
+
+	// removes a particle in constant time by moving the last particle into its place
+	void Remove(long particle);
+
+	// removes the particles flagged PARTICLE_EXPIRED, and any older than the lifetime
+	// the order of the rest is not kept
+	void RemoveExpired();
+
+	// a number for a particle that stays the same wherever it is moved, until it is removed
+	long long Handle(long particle) const	{ return handles[particle]; }
+
+	// the index of the particle with a handle, or -1 if it has been removed since
+	long Find(long long handle) const;
+
+	// one particle's properties as vectors
+	Cartesian3 Position(long particle) const
+		{ return Cartesian3(positionX[particle], positionY[particle], positionZ[particle]); }
+	Cartesian3 PreviousPosition(long particle) const
+		{ return Cartesian3(previousX[particle], previousY[particle], previousZ[particle]); }
+	Cartesian3 Velocity(long particle) const
+		{ return Cartesian3(velocityX[particle], velocityY[particle], velocityZ[particle]); }
+	Cartesian3 Direction(long particle) const
+		{ return Cartesian3(directionX[particle], directionY[particle], directionZ[particle]); }
+
+	void SetPosition(long particle, const Cartesian3 &position);
+	void SetVelocity(long particle, const Cartesian3 &velocity);
+	void SetColour(long particle, float r, float g, float b, float a);
+
+	// copies a particle's colour into an RGBA array
+	void GetColour(long particle, float *colour) const;
+
+	// applies a force to a particle, changing its velocity
+	void Push(long particle, const Cartesian3 &pushAmount);
+
+	// advances every particle by dt seconds under gravity, remembering where each was:
+	// s = ut + 1/2 at^2 and v = u + at, with a only along y
+	// large systems are split across the shared thread pool
+	void Integrate(float dt);
+
+	// the modelview matrix of every particle: viewMatrix * Translate(position) * worldMatrix * Scale(scale)
+	// both matrices must be affine, as view and model matrices are
+	void ModelViewMatrices(const columnMajorMatrix &viewMatrix, const columnMajorMatrix &worldMatrix, std::vector<columnMajorMatrix> &matrices) const;
+
+	private:
+	long capacity;
+	// the handle of each particle: a slot number in the low 32 bits and the slot's generation
+	// above them, so that a handle whose particle was removed is never mistaken for a later one
+	std::vector<long long> handles;
+	// the index of the particle in each slot, or -1, and the slot's current generation
+	std::vector<long> slotIndex;
+	std::vector<long long> slotGeneration;
+	// slots not in use, as a stack
+	std::vector<long> freeSlots;
+
+	// advances particles [first, end) by dt seconds
+	void IntegrateRange(long first, long end, float dt);
+
+	// takes a slot for a new particle at index, or frees the slot of the particle at index
+	void TakeSlot(long index);
+	void FreeSlot(long index);
+
+	// scratch arrays for ModelViewMatrices()
+	mutable std::vector<float> eyeX, eyeY, eyeZ;
+	}; // class ParticleSystem
+
+#endif
@@ -2,7 +2,7 @@
 
 Plane::Plane(const char *fileName, const Cartesian3& startPosition, float collisionRadius, bool clockwise, const PlaneRole& role)
 {
-    planeModel.ReadFileTriangleSoup(fileName);
+    planeModel = MeshCache::Shared().Load(fileName);
 
     m_position = startPosition;
     m_forward = Cartesian3(-1, 0, 0);
@@ -37,10 +37,10 @@ bool Plane::isCollidingWithFloor(float height)
 }
 
 // Check if the plane collides with a particle
-bool Plane::isCollidingWithParticle(const Particle& particle)
+bool Plane::isCollidingWithParticle(const Cartesian3& particlePosition, float particleRadius)
 {
-    float distance = (m_position - particle.GetPosition()).length();
-    return distance < (m_collisionSphereRadius + particle.GetCollisionSphereRadius());
+    float distance = (m_position - particlePosition).length();
+    return distance < (m_collisionSphereRadius + particleRadius);
 }
 
 void Plane::Update(float dt, const columnMajorMatrix& worldMatrix, const columnMajorMatrix& viewMatrix)
@@ -1,5 +1,6 @@
 #include <iostream>
-#include "Particle.h"
+#include "Matrix4.h"
+#include "MeshCache.h"
 
 // Define enum class so per plane object we can define it's role and
 // adjust behaviour accordingly  
@@ -20,7 +21,7 @@ public:
     Plane(const char *fileName, const Cartesian3& startPosition, float collisionRadius, bool clockwise, const PlaneRole& role);
     // Collision check functions to check if the plane collides with objects in the scene
     bool isCollidingWithAnotherPlane(const Plane& other);
-    bool isCollidingWithParticle(const Particle& particle);
+    bool isCollidingWithParticle(const Cartesian3& particlePosition, float particleRadius);
     bool isCollidingWithFloor(float height);
 
     // Update the movement of the plane each frame
@@ -59,7 +60,7 @@ public:
     float GetCollisionSphereRadius() const { return m_collisionSphereRadius; }
 
     // Keep these private for cleaner code when using these objects in SceneModel
-    HomogeneousFaceSurface planeModel;
+    MeshHandle planeModel; // shared with every plane using the same file
     columnMajorMatrix modelMatrix; // This is public since .Render method does not take a const reference, using getter would result in messier code
 
 private:
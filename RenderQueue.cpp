@@ -0,0 +1,88 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	RenderQueue.cpp
+//	------------------------
+//
+//	Collects the objects to draw in a frame, each a
+//	mesh with a modelview matrix and a colour, and
+//	draws them sorted by a key of mesh then colour.
+//	Each mesh is then bound once and drawn as one
+//	instance batch, and where copies are drawn one
+//	at a time, copies of the same colour follow one
+//	another so the material changes least often.
+//
+///////////////////////////////////////////////////
+
+#include "RenderQueue.h"
+
+#include <algorithm>
+
+// a colour as four bytes, for sorting: colours that differ by less than a
+// byte's step may be interleaved, which only costs a material change
+static uint32_t ColourKey(const float *colour)
+	{ // ColourKey()
+	uint32_t key = 0;
+	for (int channel = 0; channel < 4; channel++)
+		key = (key << 8) | (uint32_t) (std::min(std::max(colour[channel], 0.0f), 1.0f) * 255.0f + 0.5f);
+	return key;
+	} // ColourKey()
+
+// constructor will initialise to an empty queue
+RenderQueue::RenderQueue()
+	:
+	drawCalls(0)
+	{ // constructor
+	} // constructor
+
+// forgets the objects, keeping the memory for the next frame
+void RenderQueue::Clear()
+	{ // Clear()
+	items.clear();
+	} // Clear()
+
+// adds a copy of a mesh
+void RenderQueue::Add(const HomogeneousFaceSurface &mesh, const columnMajorMatrix &modelViewMatrix, const float *colour)
+	{ // Add()
+	// the scene has only a handful of meshes, so a linear search is quickest
+	unsigned int slot = std::find(meshes.begin(), meshes.end(), &mesh) - meshes.begin();
+	if (slot == meshes.size())
+		{ // first sight of this mesh
+		meshes.push_back(&mesh);
+		batches.emplace_back();
+		} // first sight of this mesh
+
+	items.emplace_back();
+	RenderItem &item = items.back();
+	item.meshSlot = slot;
+	item.instance.modelViewMatrix = modelViewMatrix;
+	for (int channel = 0; channel < 4; channel++)
+		item.instance.colour[channel] = colour[channel];
+	} // Add()
+
+// sorts the objects and draws them
+void RenderQueue::Render(GLStateCache &state)
+	{ // Render()
+	drawCalls = 0;
+
+	// sort keys and indices rather than the items themselves, which are much larger
+	order.resize(items.size());
+	for (size_t item = 0; item < items.size(); item++)
+		order[item] = std::make_pair(((uint64_t) items[item].meshSlot << 32) | ColourKey(items[item].instance.colour), (unsigned int) item);
+	std::sort(order.begin(), order.end());
+
+	// each run of the same mesh is one batch
+	for (size_t first = 0; first < order.size(); )
+		{ // per mesh
+		unsigned int slot = items[order[first].second].meshSlot;
+		InstanceBatch &batch = batches[slot];
+		batch.Clear();
+		size_t end = first;
+		for (; end < order.size() && items[order[end].second].meshSlot == slot; end++)
+			batch.instances.push_back(items[order[end].second].instance);
+
+		batch.Render(*meshes[slot], state);
+		drawCalls += batch.drawCalls;
+		first = end;
+		} // per mesh
+	} // Render()
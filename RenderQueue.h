@@ -0,0 +1,70 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	RenderQueue.h
+//	------------------------
+//
+//	Collects the objects to draw in a frame, each a
+//	mesh with a modelview matrix and a colour, and
+//	draws them sorted by a key of mesh then colour.
+//	Each mesh is then bound once and drawn as one
+//	instance batch, and where copies are drawn one
+//	at a time, copies of the same colour follow one
+//	another so the material changes least often.
+//
+///////////////////////////////////////////////////
+
+#ifndef _RENDER_QUEUE_H
+#define _RENDER_QUEUE_H
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "GLStateCache.h"
+#include "HomogeneousFaceSurface.h"
+#include "InstanceBatch.h"
+#include "Matrix4.h"
+
+// one object to draw
+struct RenderItem
+	{ // struct RenderItem
+	// which of the queue's meshes it is a copy of
+	unsigned int meshSlot;
+	// where, and in which colour
+	MeshInstance instance;
+	}; // struct RenderItem
+
+class RenderQueue
+	{ // class RenderQueue
+	public:
+	// the objects added since the last Clear(), in the order they were added
+	std::vector<RenderItem> items;
+
+	// draw calls issued by the last Render()
+	long drawCalls;
+
+	// constructor will initialise to an empty queue
+	RenderQueue();
+
+	// forgets the objects, keeping the memory for the next frame
+	void Clear();
+
+	// adds a copy of a mesh; the mesh must outlive the next Render()
+	void Add(const HomogeneousFaceSurface &mesh, const columnMajorMatrix &modelViewMatrix, const float *colour);
+
+	// sorts the objects and draws them, setting materials through the state cache
+	// must be called on the thread that owns the context
+	void Render(GLStateCache &state);
+
+	private:
+	// the meshes seen so far, and a batch for each, kept from frame to frame
+	// so that their instance buffers are reused
+	std::vector<const HomogeneousFaceSurface *> meshes;
+	std::vector<InstanceBatch> batches;
+
+	// sort key and item index of each object
+	std::vector<std::pair<uint64_t, unsigned int> > order;
+	}; // class RenderQueue
+
+#endif
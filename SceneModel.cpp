@@ -13,13 +13,16 @@
 ///////////////////////////////////////////////////
 
 #include "SceneModel.h"
+#include "ThreadPool.h"
 #include <math.h>
 #include <chrono>
 #include <cstdlib>
 #include <ctime>
+#include <algorithm>
 
 // three local variables with the hardcoded file names
 const char *groundModelName 	= "./models/landscape.dem";
+const char *groundTileDirectory	= "./models/landscape_tiles";
 const char *planeModelName 		= "./models/planeModel.tri";
 const char *lavaBombModelName 	= "./models/lavaBombModel.tri";
 
@@ -34,15 +37,26 @@ const GLfloat planeRadius = 2.0;
 const GLfloat lavaBombRadius = 100.0;
 const Cartesian3 chaseCamVector(0.0, -2.0, 0.5);
 
-// Set up timer so we can incrementally spawn particles in the scene over time
-auto lastSpawnTime = std::chrono::high_resolution_clock::now() - std::chrono::seconds(3);
 
 // constructor
 SceneModel::SceneModel(float x, float y, float z)
+	:
+	lavaBombs(LAVA_BOMB_CAPACITY, -19.81f, 86.0f, LAVA_BOMB_LIFETIME),
+	smoke(TRAIL_SAMPLES * LAVA_BOMB_CAPACITY),
+	smokeTrails(LAVA_BOMB_CAPACITY)
 	{ // constructor
 	// this is not the best place to put this in general, but this is a quick and dirty hack
 	// we start by loading three files: one for each model
-	groundModel.ReadFileTerrainData(groundModelName, 500);	
+	// a tile directory made with --tile-dem is streamed, otherwise the whole terrain is loaded
+	streamingGround = groundStreamer.Open(groundTileDirectory);
+	if (!streamingGround)
+		{ // whole terrain
+		groundModel.ReadFileTerrainData(groundModelName, 500);
+		const TerrainLoadTimes &times = groundModel.loadTimes;
+		std::cout << "Terrain loaded on " << ThreadPool::Shared().ThreadCount() << " threads: heights " << times.heights
+			<< " ms, vertices " << times.vertices << " ms, triangles " << times.triangles
+			<< " ms, normals " << times.normals << " ms, quadtree " << times.quadtree << " ms" << std::endl;
+		} // whole terrain
 //	When modelling, z is commonly used for "vertical" with x-y used for "horizontal"
 //	When rendering, the default is that we render using screen coordinates, so x is to the right,
 //	y is up, and z points behind us by the right hand rule.  That means when looking into the screen,
@@ -56,18 +70,45 @@ SceneModel::SceneModel(float x, float y, float z)
 //	because x is unchanged, this is a rotation around x, with y moving towards z, so it is a
 //	rotation of 90 degrees CCW
 
+	// the particles' scratch arrays are as large as they will ever need, so stepping never allocates
+	particleMatrices.reserve(TRAIL_SAMPLES * LAVA_BOMB_CAPACITY);
+	groundHeights.reserve(LAVA_BOMB_CAPACITY);
+	segmentStarts.reserve(LAVA_BOMB_CAPACITY);
+	segmentEnds.reserve(LAVA_BOMB_CAPACITY);
+	segmentHitPoints.reserve(LAVA_BOMB_CAPACITY);
+	segmentHits.reserve(LAVA_BOMB_CAPACITY);
+	collisionPairs.reserve(LAVA_BOMB_CAPACITY);
+	contactStart.reserve(LAVA_BOMB_CAPACITY + 1);
+	contacts.reserve(2 * LAVA_BOMB_CAPACITY);
+
 	// set the world to opengl matrix
 	WorldMatrix = columnMajorMatrix::RotateX(90.0f);
+	// until the widget tells us otherwise, assume a square viewport
+	SetViewport(1, 1);
 	// Instantiate the camera, player and plane objects.
 	// Heap allocate to ensure they live until the end of the program
 	// Destructor will return all heap allocated memory for these objects
 
 	// Set up camera position can be anywhere since it will recalculate its position relative to the player plane 
 	m_camera = new Camera(Cartesian3(0.0f, 0.0f, 0.0f), Cartesian3(0.0f,0.0f, -1.0f), CameraMode::Pilot);
-	m_player = new Plane("./models/planeModel.tri", Cartesian3(x, y, z), planeRadius, false, PlaneRole::Controller);
-
-	Plane* plane1 = new Plane("./models/planeModel.tri", Cartesian3(0.0f, 4000.0f, 0.0f), 200.0f, true, PlaneRole::AI);
-	Plane* plane2 = new Plane("./models/planeModel.tri", Cartesian3(0.0f, 4000.0f, 0.0f), 200.0f, false, PlaneRole::AI);
+	// every plane and lava bomb shares these, so each is drawn as one batch
+	planeModel = MeshCache::Shared().Load(planeModelName);
+	lavaBombModel = MeshCache::Shared().Load(lavaBombModelName);
+	benchmarkFrames = 0;
+	benchmarkMilliseconds = 0.0;
+	objectsDrawn = objectsCulled = 0;
+	snapshotsSkipped = snapshotsRepeated = 0;
+	simulationRunning = false;
+	simulationSteps = 0;
+	gameOver = gameOverDrawn = false;
+	// step with the real frame time, and spawn the first lava bomb on the first frame
+	fixedDeltaTime = 0.0f;
+	secondsSinceSpawn = 3.0f;
+
+	m_player = new Plane(planeModelName, Cartesian3(x, y, z), planeRadius, false, PlaneRole::Controller);
+
+	Plane* plane1 = new Plane(planeModelName, Cartesian3(0.0f, 4000.0f, 0.0f), 200.0f, true, PlaneRole::AI);
+	Plane* plane2 = new Plane(planeModelName, Cartesian3(0.0f, 4000.0f, 0.0f), 200.0f, false, PlaneRole::AI);
 	planes.push_back(plane1);
 	planes.push_back(plane2);
 
@@ -77,8 +118,14 @@ SceneModel::SceneModel(float x, float y, float z)
 	// Will use this to change planes to random colour when they collide
 	srand(static_cast<unsigned int>(time(0)));
 
+	// the tile under the player has to be there before the first frame
+	groundStreamer.Prime(m_player->GetPostion());
+
 	RandomDirections();
 
+	// so that there is something to draw before the first step
+	PublishSnapshot();
+
 	// Start the timer to calculatr deltaTime 
 	timer.start();
 
@@ -89,12 +136,9 @@ SceneModel::SceneModel(float x, float y, float z)
 // Release all heap allocated memory used 
 SceneModel::~SceneModel()
 {
-	// Free heap allocated memory for particles
-	for(int i = 0; i < particles.size(); i++)
-	{
-		delete particles[i];
-		particles[i] = nullptr;
-	}
+	// the simulation thread uses everything below
+	StopSimulationThread();
+
 	// Free heap allocated memory for plane AI
 	for(int i = 0; i < planes.size(); i++)
 	{
@@ -126,10 +170,33 @@ void SceneModel::RandomDirections()
 // routine that updates the scene for the next frame
 void SceneModel::Update()
 	{ // Update()
+		// after a crash the scene stays as it was, until the window quits
+		if(gameOver)
+			return;
 
 		// Calculate delta time to ensure movements in the world are consistent with frame time 
 		// https://doc.qt.io/qt-6/qelapsedtimer.html
-		deltaTime = timer.restart() / 1000.0f;
+		// unless the scene is being stepped at a fixed rate, as the headless benchmark does
+		deltaTime = fixedDeltaTime > 0.0f ? fixedDeltaTime : timer.restart() / 1000.0f;
+		secondsSinceSpawn += deltaTime; // the lava bomb spawn timer runs on scene time, so fixed steps spawn at the same rate
+
+		// the controls pressed since the last step
+		ApplyInput();
+
+		// Count 3 seconds of scene time and then spawn a new lava bomb
+		if(secondsSinceSpawn >= 3.0f)
+		{	
+			// every bomb leaves the same vent, moving in its launch direction
+			// if the sky is already full, this one is simply not launched
+			long bomb = lavaBombs.Add(Cartesian3(-38500.0f, 1000.0f, -4000), random_directions[lastIndex], random_directions[lastIndex], 1.0f, lavaBombColour);
+			// and trails smoke from where it starts
+			if(bomb >= 0)
+				smokeTrails.Add(lavaBombs.Handle(bomb), lavaBombs.Position(bomb));
+			secondsSinceSpawn = 0.0f; // restart the spawn timer
+			lastIndex >= random_directions.size() ? lastIndex = 0 : lastIndex++; // prepare a new position for next lava bomb
+		}
+
+		Cartesian3 playerStart = m_player->GetPostion(); // where the player was, for the ground sweep below
 		m_player->Forward(); // move the player forward each frame
 
 		// Check if the value is set to switch between follow or pilot camera
@@ -164,62 +231,101 @@ void SceneModel::Update()
 
 		// Update the camera and the player
 		m_camera->Update();
+		m_player->SetScale(1.0f);
 		m_player->Update(deltaTime, WorldMatrix, m_camera->GetViewMatrix());
 
-		// Update particles data over each frame to ensure calculations are correct
-		for(int i = 0; i < particles.size(); i++)
+		// page in the ground around and ahead of the player
+		if(streamingGround)
 		{
-			particles[i]->Update(deltaTime, WorldMatrix, m_camera->GetViewMatrix());
-			// Update child particles for the particle to ensure they have the data required to render
-			if(particles[i]->GetChildren().size() > 0) // safety check incase we don't want child smoke particles, we dont want to try and update nullptr's
-			{
-				for(auto& child : particles[i]->GetChildren())
-				{
-					child->Update(deltaTime, WorldMatrix, m_camera->GetViewMatrix());
-				}
-			}
+			groundStreamer.Update(m_player->GetPostion(), m_player->GetDirection());
 		}
 
+		// Update particles data over each frame to ensure calculations are correct
+		// every lava bomb at once, a few at a time in each vector register
+		lavaBombs.Integrate(deltaTime);
+
 		// PARTICLE TO PARTICLE COLLISION - Check if particles collide with each other, if they do, add some push force to them and change 
 		// their colour to red to indicate that the interation is heated them both up even more 
-		for(int i = 0; i < particles.size(); i++)
+		// the spatial hash finds the touching pairs without testing every bomb against every other
+		bombHash.FindPairs(lavaBombs.positionX.data(), lavaBombs.positionY.data(), lavaBombs.positionZ.data(),
+			lavaBombs.Count(), 2.0f * lavaBombs.collisionRadius, collisionPairs);
+		// each bomb then adds up its own pushes, in the order of the pairs, so that many bombs can be
+		// pushed at once on different threads and still end up exactly as if the pairs were taken in turn
+		SpatialHash::ContactLists(collisionPairs, lavaBombs.Count(), contactStart, contacts);
+		ThreadPool::Shared().ParallelFor(0, lavaBombs.Count(), PARTICLES_PER_TASK, [this](long first, long end)
 		{
-			for(int j = i + 1; j < particles.size(); j++)
+			for(long i = first; i < end; i++)
 			{
-				if(particles[i]->isColliding(*particles[j]))
+				for(long contact = contactStart[i]; contact < contactStart[i + 1]; contact++)
 				{
-					Cartesian3 pushDirection = particles[i]->GetPosition() - particles[j]->GetPosition();
-					pushDirection = pushDirection.unit();
-					float magnitude = 30.0f;
 					// If the particles collide, make them push in opposite directions
-					particles[i]->Push(pushDirection * magnitude);
-					particles[j]->Push(pushDirection * -magnitude);
-
-					// Also change their colour to red to indicate they've become hotter from colliding
-					particles[i]->SetColor(1.0f, 0.0f, 0.0f, 1.0f);
-					particles[j]->SetColor(1.0f, 0.0f, 0.0f, 1.0f);
+					Cartesian3 pushDirection = (lavaBombs.Position(i) - lavaBombs.Position(contacts[contact])).unit();
+					float magnitude = 30.0f;
+					lavaBombs.Push(i, pushDirection * magnitude);
 				}
+
+				// Also change their colour to red to indicate they've become hotter from colliding
+				if(contactStart[i + 1] > contactStart[i])
+					lavaBombs.SetColour(i, 1.0f, 0.0f, 0.0f, 1.0f);
 			}
-		}
+		});
 
 		// IMAPCT WITH GROUND
 		// Check if the particles impact the ground, if they do, deform the mesh and recompute normals
-		for(auto& particle: particles)
+		// Look up the ground height under every particle in a single batch first
+		// the positions are already in separate x and z arrays, as the batch wants them
+		long bombCount = lavaBombs.Count();
+		groundHeights.resize(bombCount);
+		// A fast particle can pass right through a ridge between two frames, so also
+		// cast the bottom of each particle's collision sphere along the path it just moved
+		segmentStarts.resize(bombCount);
+		segmentEnds.resize(bombCount);
+		segmentHitPoints.resize(bombCount);
+		segmentHits.resize(bombCount);
+		for(long i = 0; i < bombCount; i++)
+		{
+			Cartesian3 sphereBottom(0.0f, lavaBombs.collisionRadius, 0.0f);
+			segmentStarts[i] = lavaBombs.PreviousPosition(i) - sphereBottom;
+			segmentEnds[i] = lavaBombs.Position(i) - sphereBottom;
+		}
+		if(streamingGround)
 		{
+			for(long i = 0; i < bombCount; i++)
+			{
+				groundHeights[i] = groundStreamer.getHeight(lavaBombs.positionX[i], lavaBombs.positionZ[i]);
+				segmentHits[i] = groundStreamer.IntersectSegment(segmentStarts[i], segmentEnds[i], segmentHitPoints[i]);
+			}
+		} else {
 			// get height wants x,y but z is up for the terrain in object space
+			groundModel.getHeightBatch(lavaBombs.positionX.data(), lavaBombs.positionZ.data(), groundHeights.data(), bombCount);
+			groundModel.IntersectSegments(segmentStarts.data(), segmentEnds.data(), segmentHitPoints.data(), segmentHits.data(), bombCount);
+		}
+
+		for(long i = 0; i < bombCount; i++)
+		{
 			// impact point y value
 			auto groundMatrix = WorldMatrix * columnMajorMatrix::Scale(Cartesian3(1, -1, 1));
 			// Get the height of the terrain where the particle's position is
-			float groundHeight = groundModel.getHeight(particle->GetPosition().x, particle->GetPosition().z);
-			Homogeneous4 end = Homogeneous4(particle->GetPosition().x, groundHeight, particle->GetPosition().z, 1.0); // end is the hitpoint of particle
+			float groundHeight = groundHeights[i];
+			Homogeneous4 end = Homogeneous4(lavaBombs.positionX[i], groundHeight, lavaBombs.positionZ[i], 1.0); // end is the hitpoint of particle
+			// if the path crossed the ground, the impact is where it first touched
+			if(segmentHits[i])
+			{
+				end = Homogeneous4(segmentHitPoints[i]);
+			}
 
-			if(particle->isCollidingWithFloor(groundHeight))
+			if(segmentHits[i] || lavaBombs.positionY[i] - lavaBombs.collisionRadius <= groundHeight)
 			{
 				// Edit mesh will deform the mesh where the impact of the particle happens
-				groundModel.EditMesh(Cartesian3(end.x, end.y, end.z), 1.1f * 100.0f, groundMatrix);
-				particle->SetColor(0.2f, 0.3f, 0.7f, 1.0f); // change colour when hitting the floor (this is mostly unnoticeable but when visible looks good)
-				groundModel.ComputeUnitNormalVectors(); //re-compute normals since ground mesh has changed to ensure lighting looks correct
-				particle->SetShouldRender(false); // if the particle hit the floor, it expires
+				// and re-compute the normals of the triangles it changed so lighting looks correct
+				if(streamingGround)
+				{
+					groundStreamer.EditMesh(Cartesian3(end.x, end.y, end.z), 1.1f * 100.0f);
+				} else {
+					groundModel.EditMesh(Cartesian3(end.x, end.y, end.z), 1.1f * 100.0f, groundMatrix);
+				}
+				lavaBombs.SetColour(i, 0.2f, 0.3f, 0.7f, 1.0f); // change colour when hitting the floor (this is mostly unnoticeable but when visible looks good)
+				lavaBombs.flags[i] |= PARTICLE_EXPIRED; // if the particle hit the floor, it expires
 			}
 		}
 
@@ -263,52 +369,277 @@ void SceneModel::Update()
 			if(m_player->isCollidingWithAnotherPlane(*plane))
 			{
 				std::cout << "You crashed into another plane. " << std::endl;
-				exit(0); // exit the program if player plane hits another plane
+				EndGame(); // end the game if player plane hits another plane
+				return;
 			}
 		}
 
 		// Check if the plane collides with a flying particle lava bomb 
-		// if so exit the game since the plane will be destroyed
-		for(int i = 0; i < particles.size(); i++)
+		// if so end the game since the plane will be destroyed
+		for(long i = 0; i < lavaBombs.Count(); i++)
 		{
-			if(m_player->isCollidingWithParticle(*particles[i]))
+			if(m_player->isCollidingWithParticle(lavaBombs.Position(i), lavaBombs.collisionRadius))
 			{
 				std::cout << "You crashed the plane into a lava bomb, which destroyed it." << std::endl;
-				exit(0);
+				EndGame();
+				return;
 			}
 		}
 
-		// Check the players collision with the floor. If they collide, exit the game 
+		// Check the players collision with the floor. If they collide, end the game 
+		// a streamed ground is as large as its tile set
 		float groundHeight = 0;
-		if((m_player->GetPostion().z <= 24500 && m_player->GetPostion().z >= -24500) && (m_player->GetPostion().x <= 49500 && m_player->GetPostion().x >= -49500))
+		if(streamingGround && groundStreamer.Contains(m_player->GetPostion().x, m_player->GetPostion().z))
+		{
+			groundHeight = groundStreamer.getHeight(m_player->GetPostion().x, m_player->GetPostion().z);
+		} else if(!streamingGround && (m_player->GetPostion().z <= 24500 && m_player->GetPostion().z >= -24500) && (m_player->GetPostion().x <= 49500 && m_player->GetPostion().x >= -49500))
 		{
 			groundHeight = groundModel.getHeight(m_player->GetPostion().x, m_player->GetPostion().z);
 		} else {
 			m_player->SetPosition(Cartesian3(0,4000,0)); 
 			std::cout << "Don't fly out into no mans land." << std::endl;
+			playerStart = m_player->GetPostion(); // a jump back to the start is not a sweep
 		}
-		if(m_player->isCollidingWithFloor(groundHeight))
+		// Sweep the bottom of the player's collision sphere along this frame's movement too, so
+		// that a fast plane cannot fly through a thin ridge between frames
+		Cartesian3 playerBottom(0.0f, m_player->GetCollisionSphereRadius(), 0.0f);
+		Cartesian3 playerHit;
+		bool playerSweptIntoGround = streamingGround
+			? groundStreamer.IntersectSegment(playerStart - playerBottom, m_player->GetPostion() - playerBottom, playerHit)
+			: groundModel.IntersectSegment(playerStart - playerBottom, m_player->GetPostion() - playerBottom, playerHit);
+		if(playerSweptIntoGround || m_player->isCollidingWithFloor(groundHeight))
 		{
 			std::cout << "You hit the floor and crashed the plane." << std::endl;
-			exit(0);
+			EndGame();
+			return;
 		}
+
+		// Remove the lava bombs that hit the ground or outlived LAVA_BOMB_LIFETIME, now that nothing else needs them
+		lavaBombs.RemoveExpired();
+
+		// The smoke trails behind each lava bomb that is left, a "smoke" like trail
+		// the trails of the bombs just removed end here
+		smokeTrails.Update(lavaBombs, deltaTime);
+		smokeTrails.EmitPuffs(smoke);
+
+		// hand the result to the renderer
+		PublishSnapshot();
 	} // Update()
 
-// routine to tell the scene to render itself
+// fills the write snapshot from the simulation and publishes it
+void SceneModel::PublishSnapshot()
+	{ // PublishSnapshot()
+	FrameSnapshot &snapshot = snapshots.WriteBuffer();
+	snapshot.step = ++simulationSteps;
+	snapshot.gameOver = gameOver;
+	snapshot.viewMatrix = m_camera->GetViewMatrix();
+
+	// the heights edited since the last snapshot, including those of a snapshot that was never drawn
+	if (streamingGround)
+		groundStreamer.TakeTiles(snapshot.groundTiles, snapshot.groundTilePatches);
+	else
+		groundModel.TakePatches(snapshot.terrainPatches);
+
+	// the player, the lava bombs with their smoke, and the other planes
+	snapshot.objects.clear();
+	AddToSnapshot(snapshot, *planeModel, m_player->modelMatrix, planeColour);
+	GLfloat colour[4];
+	for (ParticleSystem *system : { &lavaBombs, &smoke })
+		{ // per particle system
+		system->ModelViewMatrices(snapshot.viewMatrix, WorldMatrix, particleMatrices);
+		for (long particle = 0; particle < system->Count(); particle++)
+			{ // per particle
+			system->GetColour(particle, colour);
+			AddToSnapshot(snapshot, *lavaBombModel, particleMatrices[particle], colour);
+			} // per particle
+		} // per particle system
+	for (Plane *plane : planes)
+		AddToSnapshot(snapshot, *planeModel, plane->modelMatrix, plane->GetColor());
+
+	// the benchmark scene, if there is one, hangs still in the sky
+	static const GLfloat benchmarkColours[4][4] = { {0.5, 0.3, 0.0, 1.0}, {0.8, 0.2, 0.1, 1.0}, {0.3, 0.3, 0.3, 1.0}, {1.0, 1.0, 1.0, 1.0} };
+	for (size_t i = 0; i < benchmarkPositions.size(); i++)
+		AddToSnapshot(snapshot, *lavaBombModel, snapshot.viewMatrix * columnMajorMatrix::Translate(benchmarkPositions[i]) * WorldMatrix, benchmarkColours[i % 4]);
+
+	// the snapshot given back to fill next is either one the renderer has finished
+	// with, or one it never saw, whose ground edits must then go out with the next
+	// the renderer may already have drawn a newer snapshot over the same samples, so the
+	// heights it copied are stale: the regions are marked dirty again instead, and the
+	// next snapshot copies the heights as they are then
+	if (snapshots.Publish())
+		{ // skipped
+		snapshotsSkipped++;
+		for (const TerrainPatch &patch : snapshots.WriteBuffer().terrainPatches)
+			groundModel.MarkDirty(patch.samples);
+		// a tile evicted since is only marked, and never taken from again
+		for (const StreamedTilePatch &tilePatch : snapshots.WriteBuffer().groundTilePatches)
+			tilePatch.terrain->MarkDirty(tilePatch.patch.samples);
+		} // skipped
+	snapshots.WriteBuffer().terrainPatches.clear();
+	snapshots.WriteBuffer().groundTilePatches.clear();
+	} // PublishSnapshot()
+
+// adds an object to a snapshot
+void SceneModel::AddToSnapshot(FrameSnapshot &snapshot, const HomogeneousFaceSurface &mesh, const columnMajorMatrix &modelViewMatrix, const float *colour)
+	{ // AddToSnapshot()
+	snapshot.objects.emplace_back();
+	SnapshotObject &object = snapshot.objects.back();
+	object.mesh = &mesh;
+	object.modelViewMatrix = modelViewMatrix;
+	for (int channel = 0; channel < 4; channel++)
+		object.colour[channel] = colour[channel];
+	} // AddToSnapshot()
+
+// queues a control for the next Update()
+void SceneModel::QueueInput(SceneInput input)
+	{ // QueueInput()
+	std::lock_guard<std::mutex> lock(inputMutex);
+	queuedInput.push_back(input);
+	} // QueueInput()
+
+// applies the controls queued since the last step
+void SceneModel::ApplyInput()
+	{ // ApplyInput()
+	{ // take the queue
+	std::lock_guard<std::mutex> lock(inputMutex);
+	appliedInput.swap(queuedInput);
+	} // take the queue
+	for (SceneInput input : appliedInput)
+		switch (input)
+			{ // per control
+			case YAW_LEFT:		m_player->YawLeft();		break;
+			case YAW_RIGHT:		m_player->YawRight();		break;
+			case PITCH_UP:		m_player->PitchUp();		break;
+			case PITCH_DOWN:	m_player->PitchDown();		break;
+			case ROLL_LEFT:		m_player->RollLeft();		break;
+			case ROLL_RIGHT:	m_player->RollRight();		break;
+			case SPEED_UP:		m_player->IncreaseSpeed();	break;
+			case SLOW_DOWN:		m_player->DecreaseSpeed();	break;
+			case SWITCH_CAMERA:	SwitchCamera();				break;
+			} // per control
+	appliedInput.clear();
+	} // ApplyInput()
+
+// runs Update() on a thread of its own until stopped
+bool SceneModel::StartSimulationThread(float stepsPerSecond)
+	{ // StartSimulationThread()
+	if (SimulationThreaded())
+		return false;
+	simulationRunning = true;
+	simulationThread = std::thread(&SceneModel::SimulationLoop, this, stepsPerSecond);
+	return true;
+	} // StartSimulationThread()
+
+// ends the game after a crash: publishes the step flagged as the last, and stops stepping
+void SceneModel::EndGame()
+	{ // EndGame()
+	gameOver = true;
+	PublishSnapshot();
+	} // EndGame()
+
+// stops the simulation thread and prints how the two sides kept up
+void SceneModel::StopSimulationThread()
+	{ // StopSimulationThread()
+	if (!SimulationThreaded())
+		return;
+	simulationRunning = false;
+	simulationThread.join();
+	std::cout << "Simulation thread: " << simulationSteps << " steps, " << snapshotsSkipped << " never drawn, "
+		<< snapshotsRepeated << " frames drew an old snapshot again" << std::endl;
+	} // StopSimulationThread()
+
+// stops every thread the scene started: the simulation, and the loading of ground tiles
+void SceneModel::Shutdown()
+	{ // Shutdown()
+	StopSimulationThread();
+	groundStreamer.Close();
+	} // Shutdown()
+
+// the simulation thread: steps the scene at a steady rate
+void SceneModel::SimulationLoop(float stepsPerSecond)
+	{ // SimulationLoop()
+	auto stepTime = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / stepsPerSecond));
+	// the time spent before the thread started is not a step
+	timer.restart();
+	auto nextStep = std::chrono::steady_clock::now();
+	// after a crash there is nothing more to step
+	while (simulationRunning && !gameOver)
+		{ // per step
+		Update();
+		// a step that overran starts the next at once, rather than running several to catch up
+		nextStep += stepTime;
+		auto now = std::chrono::steady_clock::now();
+		if (nextStep < now)
+			nextStep = now;
+		else
+			std::this_thread::sleep_until(nextStep);
+		} // per step
+	} // SimulationLoop()
+
+// sets the viewport size and the matching projection
+// we want a 90 degree vertical field of view, as wide as the window allows
+// and we want to see from just in front of us to 100km away
+void SceneModel::SetViewport(int width, int height)
+	{ // SetViewport()
+	viewportWidth = width;
+	viewportHeight = std::max(height, 1);
+	projectionMatrix = columnMajorMatrix::Perspective(90.0f, (float) viewportWidth / (float) viewportHeight, 1.0f, 100000.0f);
+	} // SetViewport()
+
+// queues a copy of a model unless its bounding sphere is outside the view
+void SceneModel::AddIfVisible(const HomogeneousFaceSurface &mesh, const columnMajorMatrix &modelViewMatrix,
+	const float *colour, const Frustum &eyeFrustum)
+	{ // AddIfVisible()
+	if (mesh.IsVisible(modelViewMatrix, eyeFrustum))
+		{ // visible
+		renderQueue.Add(mesh, modelViewMatrix, colour);
+		objectsDrawn++;
+		} // visible
+	else
+		objectsCulled++;
+	} // AddIfVisible()
+
+// routine to tell the scene to render itself, from the newest snapshot
 void SceneModel::Render()
 	{ // Render()
+	// take the newest step the simulation has published, and bring the ground mesh
+	// up to date with its edits, each only once; if there is nothing newer, the last
+	// one is drawn again
+	if (snapshots.Acquire())
+		{ // new snapshot
+		for (const TerrainPatch &patch : snapshots.ReadBuffer().terrainPatches)
+			groundModel.ApplyPatch(patch);
+		for (const StreamedTilePatch &tilePatch : snapshots.ReadBuffer().groundTilePatches)
+			tilePatch.terrain->ApplyPatch(tilePatch.patch);
+		} // new snapshot
+	else
+		snapshotsRepeated++;
+	const FrameSnapshot &snapshot = snapshots.ReadBuffer();
+	// the crash is drawn, and captured, before the window quits
+	if (snapshot.gameOver)
+		gameOverDrawn = true;
+
+	// buffers freed since the last frame, such as those of evicted terrain tiles,
+	// can only be deleted here, where the context is current
+	VertexBuffer::DeleteReleased();
+
+	// state goes through the cache, so that only the first frame (and any change) reaches OpenGL
+	glState.ResetCounts();
 
 	// enable Z-buffering
-	glEnable(GL_DEPTH_TEST);
+	glState.Enable(GL_DEPTH_TEST, true);
+
+	// retained meshes are transformed by the modelview matrix, normals included,
+	// and scaled models would otherwise be lit too brightly or too dimly
+	glState.Enable(GL_NORMALIZE, true);
 	
 	// set lighting parameters
-	glShadeModel(GL_FLAT);
-	glEnable(GL_LIGHT0);
-	glEnable(GL_LIGHTING);
-	glLightfv(GL_LIGHT0, GL_AMBIENT, sunAmbient);
-	glLightfv(GL_LIGHT0, GL_DIFFUSE, sunDiffuse);
-	glLightfv(GL_LIGHT0, GL_SPECULAR, blackColour);
-	glLightfv(GL_LIGHT0, GL_EMISSION, blackColour);
+	glState.ShadeModel(GL_FLAT);
+	glState.Enable(GL_LIGHT0, true);
+	glState.Enable(GL_LIGHTING, true);
+	glState.LightColour(GL_AMBIENT, sunAmbient);
+	glState.LightColour(GL_DIFFUSE, sunDiffuse);
+	glState.LightColour(GL_SPECULAR, blackColour);
 	
 	// background is sky-blue
 	glClearColor(0.8, 0.7, 1.0, 1.0);
@@ -321,7 +652,7 @@ void SceneModel::Render()
 	{
 		for(int j = 0; j < 3; j++)
 		{
-			rotationMatrix.coordinates[j * 4 + i] = m_camera->GetViewMatrix().coordinates[j * 4 + i];
+			rotationMatrix.coordinates[j * 4 + i] = snapshot.viewMatrix.coordinates[j * 4 + i];
 		}
 	}
 	// compute the light position, need to extract the top 3x3 matrix of view matrix
@@ -333,87 +664,67 @@ void SceneModel::Render()
 	glLightfv(GL_LIGHT0, GL_POSITION, &(lightDirection.x));
 
 	// and set a material colour for the ground
-	glMaterialfv(GL_FRONT, GL_AMBIENT_AND_DIFFUSE, groundColour);
-	glMaterialfv(GL_FRONT, GL_SPECULAR, blackColour);
-	glMaterialfv(GL_FRONT, GL_EMISSION, blackColour);
+	glState.Material(GL_AMBIENT_AND_DIFFUSE, groundColour);
+	glState.Material(GL_SPECULAR, blackColour);
+	glState.Material(GL_EMISSION, blackColour);
 
 	// actual render code goes here
 	// flip z in local space so positive z is up  so when we rotate 90 ccw from world matrix
 	// positive z points out of the screen	
 	columnMajorMatrix groundMatrix;
-	groundMatrix = m_camera->GetViewMatrix() * WorldMatrix * columnMajorMatrix::Scale(Cartesian3(1, 1, -1));
-	groundModel.Render(groundMatrix);
-
-	// Render the player
-	glMaterialfv(GL_FRONT, GL_AMBIENT_AND_DIFFUSE, planeColour);
-	glMaterialfv(GL_FRONT, GL_SPECULAR, blackColour);
-	glMaterialfv(GL_FRONT, GL_EMISSION, blackColour);
-	columnMajorMatrix playerMatrix;
-
-	// Set scale of the player and use it's model matrix, consisting of it's transformations for 
-	// rendering
-	m_player->SetScale(1.0f);
-	m_player->planeModel.Render(m_player->modelMatrix);
-	
-	// Render lava bombs
-	glMaterialfv(GL_FRONT, GL_AMBIENT_AND_DIFFUSE, lavaBombColour);
-	glMaterialfv(GL_FRONT, GL_SPECULAR, blackColour);
-	glMaterialfv(GL_FRONT, GL_EMISSION, blackColour);
-
-	// Set a timer to count 3 seconds and then spawn a new lava bomb
-	auto curr = std::chrono::high_resolution_clock::now();
-	float timeSinceLastSpawn = std::chrono::duration<float, std::chrono::seconds::period>(curr - lastSpawnTime).count();
-	if(timeSinceLastSpawn >= 3.0f)
-	{	
-		Particle* p = new Particle("./models/lavaBombModel.tri", random_directions[lastIndex], 2.0f, 1.0f);
-		p->CreateChildren(); // create children creates a smoke like particle effect
-		particles.push_back(p);
-		lastSpawnTime = curr; // set the spawn time
-		lastIndex >= random_directions.size() ? lastIndex = 0 : lastIndex++; // prepare a new position for next lava bomb
-	}
-
-	// Loop through all particles and render them
-	for(int i = 0; i < particles.size();)
+	groundMatrix = snapshot.viewMatrix * WorldMatrix * columnMajorMatrix::Scale(Cartesian3(1, 1, -1));
+	// the terrain picks its own level of detail: one unit at unit distance covers
+	// half the viewport height over the tangent of half the field of view
+	float errorScale = 0.5f * viewportHeight / std::tan(DEG2RAD(45.0f));
+	if (streamingGround)
+		TerrainStreamer::Render(snapshot.groundTiles, groundMatrix, projectionMatrix, errorScale);
+	else
+		groundModel.Render(groundMatrix, projectionMatrix, errorScale);
+
+	// the planes and lava bombs are gathered into the render queue below, and drawn
+	// together at the end, sorted by model and colour
+	// every model matrix already includes the view, so the projection alone gives the
+	// frustum to cull against, and anything outside it never reaches the queue
+	renderQueue.Clear();
+	Frustum eyeFrustum = Frustum::FromMatrix(projectionMatrix);
+	objectsDrawn = objectsCulled = 0;
+
+	// the player, the lava bombs and their smoke, the other planes and any benchmark bombs
+	for (const SnapshotObject &object : snapshot.objects)
+		AddIfVisible(*object.mesh, object.modelViewMatrix, object.colour, eyeFrustum);
+
+	// now draw each model once for all its copies
+	auto batchStart = std::chrono::steady_clock::now();
+	renderQueue.Render(glState);
+
+	if(!benchmarkPositions.empty())
 	{
-		// If the particle has life, it should be rendered 
-		if(particles[i]->GetShouldRender() == true)
+		// report every 120 frames, then switch to the other way of drawing
+		benchmarkMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - batchStart).count();
+		if(++benchmarkFrames == 120)
 		{
-			glMaterialfv(GL_FRONT, GL_AMBIENT_AND_DIFFUSE, particles[i]->GetColor());
-			glMaterialfv(GL_FRONT, GL_SPECULAR, blackColour);
-			glMaterialfv(GL_FRONT, GL_EMISSION, blackColour);
-			
-			particles[i]->lavaBombModel.Render(particles[i]->modelMatrix);
-
-			// Render child particles
-			for(auto& child : particles[i]->GetChildren())
-			{
-				glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-				glMaterialfv(GL_FRONT, GL_AMBIENT_AND_DIFFUSE, child->GetChildColor());
-				glMaterialfv(GL_FRONT, GL_SPECULAR, blackColour);
-				glMaterialfv(GL_FRONT, GL_EMISSION, blackColour);
-				
-				child->SetScale(0.5f);
-				child->lavaBombModel.Render(child->modelMatrix);
-			}
-			glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-			i++;
-		} else 
-		{
-			delete particles[i]; 
-			particles.erase(particles.begin() + i);
+			bool instanced = InstanceBatch::InstancingAvailable();
+			std::cout << (instanced ? "Instanced: " : "One draw per copy: ") << objectsDrawn << " copies (" << objectsCulled << " culled) in "
+				<< renderQueue.drawCalls << " draw calls, " << glState.changes << " state changes (" << glState.redundant << " redundant skipped), "
+				<< benchmarkMilliseconds / benchmarkFrames << " ms per frame submitting them" << std::endl;
+			InstanceBatch::SetInstancingEnabled(!instanced);
+			benchmarkFrames = 0;
+			benchmarkMilliseconds = 0.0;
 		}
 	}
-
-	// Render AI like planes in the sky 
-	for(int i = 0; i < planes.size(); i++)
-	{
-		glMaterialfv(GL_FRONT, GL_AMBIENT_AND_DIFFUSE, planes[i]->GetColor());
-		glMaterialfv(GL_FRONT, GL_SPECULAR, blackColour);
-		glMaterialfv(GL_FRONT, GL_EMISSION, blackColour);
-		planes[i]->planeModel.Render(planes[i]->modelMatrix);
-	}
 } // Render()	
 
+// fills the sky ahead of the player with count lava bombs for the instancing benchmark
+void SceneModel::StartInstanceBenchmark(long count)
+	{ // StartInstanceBenchmark()
+	// a square wall of bombs across the player's starting heading (down -z), a few kilometres ahead
+	long side = std::max(1L, (long) ceil(sqrt((double) count)));
+	Cartesian3 centre = m_player->GetPostion() + Cartesian3(0.0f, 0.0f, -8000.0f);
+	benchmarkPositions.clear();
+	for (long i = 0; i < count; i++)
+		benchmarkPositions.push_back(centre + Cartesian3(150.0f * (i % side - side / 2), 150.0f * (i / side - side / 2), 0.0f));
+	} // StartInstanceBenchmark()
+
 // Switches between follow camera and pilot camera
 void SceneModel::SwitchCamera()
 {
@@ -22,7 +22,16 @@
 #include <GL/glu.h>
 #endif
 #include "HomogeneousFaceSurface.h"
+#include "FrameSnapshot.h"
+#include "GLStateCache.h"
+#include "MeshCache.h"
+#include "ParticleSystem.h"
+#include "SpatialHash.h"
+#include "TrailEmitter.h"
+#include "RenderQueue.h"
 #include "Terrain.h"
+#include "TerrainStreamer.h"
+#include "TripleBuffer.h"
 
 #include "Matrix4.h"
 #include "Quaternion.h"
@@ -33,9 +42,18 @@
 #include <functional>
 #include "Random.h"
 #include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
 
 #include <QElapsedTimer>
 #define RANDOM_AMOUNT 100
+// the most lava bombs in the air at once, and the seconds before one that never lands is removed
+#define LAVA_BOMB_CAPACITY 256
+#define LAVA_BOMB_LIFETIME 60.0f
+
+// the controls, queued by the window and applied by the simulation
+enum SceneInput { YAW_LEFT, YAW_RIGHT, PITCH_UP, PITCH_DOWN, ROLL_LEFT, ROLL_RIGHT, SPEED_UP, SLOW_DOWN, SWITCH_CAMERA };
 
 class SceneModel										
 	{ // class SceneModel
@@ -44,41 +62,149 @@ class SceneModel
 	// one for the plane 
 	// and one for the lava bomb(s)
 	Terrain groundModel;
-	HomogeneousFaceSurface planeModel;
-	HomogeneousFaceSurface lavaBombModel;
+	// if a tile directory exists, the ground is streamed from it instead
+	TerrainStreamer groundStreamer;
+	bool streamingGround;
+	// the models shared by every plane and every lava bomb, from the mesh cache
+	MeshHandle planeModel;
+	MeshHandle lavaBombModel;
 	HomogeneousFaceSurface terrainAABBB;
 
+	// each Update() publishes what it leaves to draw here, and Render() draws the newest,
+	// so that the two can run on different threads without waiting for each other
+	TripleBuffer<FrameSnapshot> snapshots;
+	// snapshots published but overwritten before they were drawn, and frames that
+	// drew the same snapshot again because there was no newer one
+	long snapshotsSkipped, snapshotsRepeated;
+
+	// every plane and lava bomb drawn this frame, sorted so that each model is drawn in one batch
+	RenderQueue renderQueue;
+
+	// the fixed-function state last set, with the number of changes made and skipped each frame
+	GLStateCache glState;
+
+	// planes, lava bombs and smoke drawn and culled in the last frame
+	long objectsDrawn, objectsCulled;
+
+	// the benchmark scene: extra lava bombs hanging in the sky, empty unless asked for
+	std::vector<Cartesian3> benchmarkPositions;
+	// frames drawn since the benchmark last reported, and the time spent drawing the batches
+	long benchmarkFrames;
+	double benchmarkMilliseconds;
+
 	// a matrix that specifies the mapping from world coordinates to those assumed
 	// by OpenGL
 	columnMajorMatrix WorldMatrix;
 	columnMajorMatrix viewMatrix;
+	// the projection set by the widget, kept here for culling and level of detail
+	columnMajorMatrix projectionMatrix;
+	int viewportWidth, viewportHeight;
 	
 	// constructor
 	SceneModel(float x, float y, float z);
 	~SceneModel();
 
-	// routine that updates the scene for the next frame
+	// routine that updates the scene for the next frame, and publishes a snapshot of it
+	// touches only the simulation, never OpenGL
 	void Update();
 
-	// routine to tell the scene to render itself
+	// routine to tell the scene to render itself, from the newest snapshot published
+	// touches only the snapshots and the drawing state, never the simulation
 	void Render();
 
+	// runs Update() on a thread of its own, stepsPerSecond times a second, until stopped
+	// returns false if it is already running
+	bool StartSimulationThread(float stepsPerSecond);
+	// stops the simulation thread, if there is one, and prints how the two sides kept up
+	void StopSimulationThread();
+	// stops every thread the scene started: the simulation, and the loading of ground tiles
+	void Shutdown();
+	// true while Update() is being called by the simulation thread
+	bool SimulationThreaded() const	{ return simulationThread.joinable(); }
+
+	// true once Render() has drawn the step in which the player crashed, after which
+	// Update() does nothing, and the caller should stop and quit from its own thread
+	bool GameOverDrawn() const	{ return gameOverDrawn; }
+
+	// queues a control for the next Update(): safe to call from any thread
+	void QueueInput(SceneInput input);
+
+	// sets the viewport size and the matching projection
+	void SetViewport(int width, int height);
+
+	// queues a copy of a model unless its bounding sphere is outside the view,
+	// counting it as drawn or culled
+	void AddIfVisible(const HomogeneousFaceSurface &mesh, const columnMajorMatrix &modelViewMatrix,
+		const float *colour, const Frustum &eyeFrustum);
+
 	// Create the random directions for the particles up to max count
 	void RandomDirections();
 
+	// applies the controls queued since the last step
+	void ApplyInput();
+
+	// fills the write snapshot from the simulation and publishes it
+	void PublishSnapshot();
+
+	// ends the game after a crash: publishes the step flagged as the last, and stops stepping
+	// the process is left running, since the renderer may still be drawing, or capturing frames
+	void EndGame();
+
+	// adds an object to a snapshot
+	void AddToSnapshot(FrameSnapshot &snapshot, const HomogeneousFaceSurface &mesh, const columnMajorMatrix &modelViewMatrix, const float *colour);
+
+	// the simulation thread: steps the scene until simulationRunning is cleared
+	void SimulationLoop(float stepsPerSecond);
+
+	// fills the sky ahead of the player with count lava bombs, and reports the
+	// time spent drawing them, alternating between instanced drawing and one
+	// draw call per copy
+	void StartInstanceBenchmark(long count);
+
 	// Camera is part of the scene so we can switch between cameras
 	// using boolean
 	void SwitchCamera();
 
 	Camera* m_camera;
-	std::vector<Particle*> particles;
+	// the lava bombs, and the puffs of smoke trailing them, drawn like the bombs
+	ParticleSystem lavaBombs, smoke;
+	// where each bomb's puffs go
+	TrailEmitter smokeTrails;
+	// the broadphase for collisions between lava bombs, and the pairs it found this step
+	SpatialHash bombHash;
+	std::vector<CollisionPair> collisionPairs;
+	// the pairs listed by bomb, so that each bomb's pushes can be added up on its own
+	std::vector<long> contactStart, contacts;
+	// scratch array for the particles' modelview matrices
+	std::vector<columnMajorMatrix> particleMatrices;
 	std::vector<Cartesian3> random_directions;
+	// scratch array for the batched ground height queries
+	std::vector<float> groundHeights;
+	// scratch arrays for sweeping the particles' paths against the ground
+	std::vector<Cartesian3> segmentStarts, segmentEnds, segmentHitPoints;
+	std::vector<unsigned char> segmentHits;
 	QElapsedTimer timer;
 	std::vector<Plane*> planes;
 	Plane* m_player;
 	float deltaTime;
+	// if positive, each Update() advances the scene by this many seconds instead of the real time since the last
+	float fixedDeltaTime;
+	// scene time since the last lava bomb was spawned
+	float secondsSinceSpawn;
 	int lastIndex = 0;
 	bool m_switchCamera;
+
+	// the simulation thread, if there is one, and the flag that keeps it going
+	std::thread simulationThread;
+	std::atomic<bool> simulationRunning;
+	// simulation steps since construction
+	long simulationSteps;
+	// set by the simulation when the player crashes, and by the renderer once it has drawn that step
+	bool gameOver, gameOverDrawn;
+
+	// controls queued by QueueInput(), and the copy ApplyInput() works through
+	std::mutex inputMutex;
+	std::vector<SceneInput> queuedInput, appliedInput;
 	
 	}; // class SceneModel
 
@@ -0,0 +1,145 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	SpatialHash.cpp
+//	------------------------
+//
+//	A broadphase for spheres of one radius: space
+//	is cut into cubes as wide as the distance at
+//	which two spheres touch, and each cube hashed
+//	into a table rebuilt every step with a counting
+//	sort.  Spheres can only touch if their cubes
+//	are neighbours, so each is tested against the
+//	27 cubes around it rather than against every
+//	other sphere, and the cost grows with the
+//	number of spheres instead of its square.  The
+//	searches are split across the thread pool, and
+//	each task's pairs kept apart until they are
+//	joined in order, so that the pairs found are
+//	the same on any number of threads.
+//
+///////////////////////////////////////////////////
+
+#include "SpatialHash.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+
+// the bucket of the cube at a cell position
+unsigned long SpatialHash::Bucket(long cellX, long cellY, long cellZ) const
+	{ // Bucket()
+	// the primes of Teschner et al., "Optimized spatial hashing for collision detection of deformable objects"
+	return ((unsigned long) cellX * 73856093UL ^ (unsigned long) cellY * 19349663UL ^ (unsigned long) cellZ * 83492791UL) & bucketMask;
+	} // Bucket()
+
+// finds every pair of the count points closer together than distance
+void SpatialHash::FindPairs(const float *x, const float *y, const float *z, long count, float distance, std::vector<CollisionPair> &pairs)
+	{ // FindPairs()
+	pairs.clear();
+	if (count < 2)
+		return;
+
+	// at least twice as many buckets as points, so that few cubes share one
+	unsigned long buckets = 64;
+	while (buckets < 2 * (unsigned long) count)
+		buckets *= 2;
+	bucketMask = buckets - 1;
+	float cellsPerUnit = 1.0f / distance;
+
+	// the bucket of each point, then a counting sort of the points by bucket, keeping each bucket in index order
+	pointBucket.resize(count);
+	ThreadPool::Shared().ParallelFor(0, count, SPATIAL_HASH_POINTS_PER_TASK, [&](long first, long end)
+		{ // per task
+		for (long point = first; point < end; point++)
+			pointBucket[point] = Bucket((long) floorf(x[point] * cellsPerUnit), (long) floorf(y[point] * cellsPerUnit), (long) floorf(z[point] * cellsPerUnit));
+		}); // per task
+	bucketStart.assign(buckets + 1, 0);
+	for (long point = 0; point < count; point++)
+		bucketStart[pointBucket[point] + 1]++;
+	for (unsigned long bucket = 0; bucket < buckets; bucket++)
+		bucketStart[bucket + 1] += bucketStart[bucket];
+	bucketFill.assign(bucketStart.begin(), bucketStart.end() - 1);
+	entries.resize(count);
+	for (long point = 0; point < count; point++)
+		entries[bucketFill[pointBucket[point]]++] = point;
+
+	// each point looks in the 27 cubes around its own for points after it
+	// each task keeps its own pairs, so that they can be joined in order afterwards
+	long tasks = (count + SPATIAL_HASH_POINTS_PER_TASK - 1) / SPATIAL_HASH_POINTS_PER_TASK;
+	if ((long) taskPairs.size() < tasks)
+		{ // more tasks
+		taskPairs.resize(tasks);
+		taskNeighbours.resize(tasks);
+		} // more tasks
+	float distanceSquared = distance * distance;
+	ThreadPool::Shared().ParallelFor(0, count, SPATIAL_HASH_POINTS_PER_TASK, [&](long first, long end)
+		{ // per task
+		std::vector<CollisionPair> &found = taskPairs[first / SPATIAL_HASH_POINTS_PER_TASK];
+		std::vector<long> &neighbours = taskNeighbours[first / SPATIAL_HASH_POINTS_PER_TASK];
+		found.clear();
+		for (long point = first; point < end; point++)
+			{ // per point
+			long cellX = (long) floorf(x[point] * cellsPerUnit);
+			long cellY = (long) floorf(y[point] * cellsPerUnit);
+			long cellZ = (long) floorf(z[point] * cellsPerUnit);
+			unsigned long searched[27];
+			int searchedCount = 0;
+			neighbours.clear();
+			for (long offsetX = -1; offsetX <= 1; offsetX++)
+				for (long offsetY = -1; offsetY <= 1; offsetY++)
+					for (long offsetZ = -1; offsetZ <= 1; offsetZ++)
+						{ // per neighbouring cube
+						// two cubes may share a bucket, which must only be searched once
+						unsigned long bucket = Bucket(cellX + offsetX, cellY + offsetY, cellZ + offsetZ);
+						if (std::find(searched, searched + searchedCount, bucket) != searched + searchedCount)
+							continue;
+						searched[searchedCount++] = bucket;
+
+						// a bucket holds every cube hashed to it, but only points near enough pass the test
+						for (long entry = bucketStart[bucket]; entry < bucketStart[bucket + 1]; entry++)
+							{ // per point in the bucket
+							long other = entries[entry];
+							if (other <= point)
+								continue;
+							float dx = x[point] - x[other], dy = y[point] - y[other], dz = z[point] - z[other];
+							if (dx * dx + dy * dy + dz * dz < distanceSquared)
+								neighbours.push_back(other);
+							} // per point in the bucket
+						} // per neighbouring cube
+
+			// the buckets are visited out of order, so sort to match the all-pairs loop
+			std::sort(neighbours.begin(), neighbours.end());
+			for (long other : neighbours)
+				found.push_back({ point, other });
+			} // per point
+		}); // per task
+
+	// the tasks cover the points in order, and so do their pairs
+	for (long task = 0; task < tasks; task++)
+		pairs.insert(pairs.end(), taskPairs[task].begin(), taskPairs[task].end());
+	} // FindPairs()
+
+// lists the pairs by point, in the order of the pairs
+void SpatialHash::ContactLists(const std::vector<CollisionPair> &pairs, long count, std::vector<long> &contactStart, std::vector<long> &contacts)
+	{ // ContactLists()
+	// a counting sort of both ends of every pair by point, which keeps them in the order of the pairs
+	contactStart.assign(count + 1, 0);
+	for (const CollisionPair &pair : pairs)
+		{ // per pair
+		contactStart[pair.first + 1]++;
+		contactStart[pair.second + 1]++;
+		} // per pair
+	for (long point = 0; point < count; point++)
+		contactStart[point + 1] += contactStart[point];
+	contacts.resize(2 * pairs.size());
+	// the start of each list moves along as it fills, and is moved back after
+	for (const CollisionPair &pair : pairs)
+		{ // per pair
+		contacts[contactStart[pair.first]++] = pair.second;
+		contacts[contactStart[pair.second]++] = pair.first;
+		} // per pair
+	for (long point = count; point > 0; point--)
+		contactStart[point] = contactStart[point - 1];
+	contactStart[0] = 0;
+	} // ContactLists()
@@ -0,0 +1,67 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	SpatialHash.h
+//	------------------------
+//
+//	A broadphase for spheres of one radius: space
+//	is cut into cubes as wide as the distance at
+//	which two spheres touch, and each cube hashed
+//	into a table rebuilt every step with a counting
+//	sort.  Spheres can only touch if their cubes
+//	are neighbours, so each is tested against the
+//	27 cubes around it rather than against every
+//	other sphere, and the cost grows with the
+//	number of spheres instead of its square.  The
+//	searches are split across the thread pool, and
+//	each task's pairs kept apart until they are
+//	joined in order, so that the pairs found are
+//	the same on any number of threads.
+//
+///////////////////////////////////////////////////
+
+#ifndef _SPATIAL_HASH_H
+#define _SPATIAL_HASH_H
+
+#include <vector>
+
+// the points searched around by each task when the search is split across the thread pool
+#define SPATIAL_HASH_POINTS_PER_TASK 1024
+
+// two spheres closer than the distance, with first < second
+struct CollisionPair
+	{ // struct CollisionPair
+	long first, second;
+	}; // struct CollisionPair
+
+class SpatialHash
+	{ // class SpatialHash
+	public:
+	// finds every pair of the count points closer together than distance, as the
+	// all-pairs loop over i < j would, in the same order: by first, then by second
+	// the arrays are kept between calls, so once they have grown nothing is allocated
+	void FindPairs(const float *x, const float *y, const float *z, long count, float distance, std::vector<CollisionPair> &pairs);
+
+	// lists the pairs by point: the points touching point p are contacts[contactStart[p]] to
+	// contacts[contactStart[p + 1] - 1], in the order of the pairs, so that each point's
+	// contacts can be resolved on its own, on any thread, in the same order as the pairs
+	static void ContactLists(const std::vector<CollisionPair> &pairs, long count, std::vector<long> &contactStart, std::vector<long> &contacts);
+
+	private:
+	// the bucket of the cube at a cell position
+	unsigned long Bucket(long cellX, long cellY, long cellZ) const;
+
+	// the buckets in the table, less 1: always a power of 2 less 1
+	unsigned long bucketMask;
+	// the points in bucket b are entries[bucketStart[b]] to entries[bucketStart[b + 1] - 1], in order
+	std::vector<long> bucketStart, entries;
+	// the next free entry of each bucket while sorting
+	std::vector<long> bucketFill;
+	// the bucket of each point
+	std::vector<unsigned long> pointBucket;
+	// the pairs each task found, and the points it found near the current one, before sorting
+	std::vector<std::vector<CollisionPair> > taskPairs;
+	std::vector<std::vector<long> > taskNeighbours;
+	}; // class SpatialHash
+
+#endif
@@ -16,18 +16,145 @@
 //	
 ///////////////////////////////////////////////////
 
+// the shader functions are only declared by glext.h, and only if this comes before anything includes gl.h
+#define GL_GLEXT_PROTOTYPES
 #include <iostream>
 #include <fstream>
 #include <numeric>
 #include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#if defined(__SSE2__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
 #include "Terrain.h"
+#include "HeightfieldFile.h"
+#include "ThreadPool.h"
+
+#include <cfloat>
+#ifdef __APPLE__
+#include <OpenGL/gl.h>
+#else
+#include <GL/gl.h>
+#include <GL/glext.h>
+#endif
+
+// rows are shared out over the thread pool in blocks of about this many samples
+#define TERRAIN_SAMPLES_PER_TASK 16384
+
+// milliseconds elapsed since a given start time
+static double MillisecondsSince(std::chrono::steady_clock::time_point start)
+	{ // MillisecondsSince()
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	} // MillisecondsSince()
+
+// the face normal program: 0 until built, or if the context can't build it
+static GLuint faceNormalProgram = 0;
+static bool faceNormalChecked = false;
+
+// passes the position in eye coordinates on to the fragments
+static const char *faceNormalVertexShader =
+	"#version 120\n"
+	"varying vec3 eyePosition;\n"
+	"void main()\n"
+	"	{\n"
+	"	vec4 eye = gl_ModelViewMatrix * gl_Vertex;\n"
+	"	eyePosition = eye.xyz / eye.w;\n"
+	"	gl_Position = gl_ProjectionMatrix * eye;\n"
+	"	}\n";
+
+// lights each triangle by its own normal, as immediate mode does with glShadeModel(GL_FLAT):
+// the position only changes across the screen within the triangle's plane, so its
+// derivatives span the plane, and their cross product is the normal on the eye's side;
+// the triangle's own normal is on the other side when it winds anticlockwise on screen,
+// since the ground is flipped in z, and the light is directional, with no specular
+static const char *faceNormalFragmentShader =
+	"#version 120\n"
+	"varying vec3 eyePosition;\n"
+	"void main()\n"
+	"	{\n"
+	"	vec3 normal = normalize(cross(dFdx(eyePosition), dFdy(eyePosition)));\n"
+	"	if (gl_FrontFacing)\n"
+	"		normal = -normal;\n"
+	"	vec3 light = normalize(gl_LightSource[0].position.xyz);\n"
+	"	vec4 lit = gl_FrontLightModelProduct.sceneColor + gl_FrontLightProduct[0].ambient\n"
+	"		+ max(dot(normal, light), 0.0) * gl_FrontLightProduct[0].diffuse;\n"
+	"	gl_FragColor = vec4(clamp(lit.rgb, 0.0, 1.0), gl_FrontMaterial.diffuse.a);\n"
+	"	}\n";
+
+// compiles one stage of the face normal program, returns 0 on failure
+static GLuint CompileFaceNormalShader(GLenum stage, const char *source)
+	{ // CompileFaceNormalShader()
+	GLuint shader = glCreateShader(stage);
+	glShaderSource(shader, 1, &source, NULL);
+	glCompileShader(shader);
+	GLint compiled = GL_FALSE;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+	if (compiled == GL_TRUE)
+		return shader;
+	char log[1024] = "";
+	glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+	std::cout << "Terrain shader unavailable, drawing the ground in immediate mode: " << log << std::endl;
+	glDeleteShader(shader);
+	return 0;
+	} // CompileFaceNormalShader()
+
+// the program that lights the retained ground by face normals, or 0 if the context can't run it
+// must be called on the thread that owns the context
+static GLuint FaceNormalProgram()
+	{ // FaceNormalProgram()
+	if (faceNormalChecked)
+		return faceNormalProgram;
+	const char *version = (const char *) glGetString(GL_VERSION);
+	int major = 0, minor = 0;
+	if (version == NULL || sscanf(version, "%d.%d", &major, &minor) != 2)
+		return 0;
+	faceNormalChecked = true;
+	// GLSL 1.20 came with OpenGL 2.1
+	if (major < 2 || (major == 2 && minor < 1))
+		return 0;
+
+	GLuint vertexShader = CompileFaceNormalShader(GL_VERTEX_SHADER, faceNormalVertexShader);
+	GLuint fragmentShader = CompileFaceNormalShader(GL_FRAGMENT_SHADER, faceNormalFragmentShader);
+	if (vertexShader != 0 && fragmentShader != 0)
+		{ // link
+		faceNormalProgram = glCreateProgram();
+		glAttachShader(faceNormalProgram, vertexShader);
+		glAttachShader(faceNormalProgram, fragmentShader);
+		glLinkProgram(faceNormalProgram);
+		GLint linked = GL_FALSE;
+		glGetProgramiv(faceNormalProgram, GL_LINK_STATUS, &linked);
+		if (linked != GL_TRUE)
+			{ // link failed
+			char log[1024] = "";
+			glGetProgramInfoLog(faceNormalProgram, sizeof(log), NULL, log);
+			std::cout << "Terrain shader unavailable, drawing the ground in immediate mode: " << log << std::endl;
+			glDeleteProgram(faceNormalProgram);
+			faceNormalProgram = 0;
+			} // link failed
+		} // link
+
+	// the program keeps the shaders alive for as long as it needs them
+	if (vertexShader != 0)
+		glDeleteShader(vertexShader);
+	if (fragmentShader != 0)
+		glDeleteShader(fragmentShader);
+	return faceNormalProgram;
+	} // FaceNormalProgram()
 
 // constructor will initialise to safe values
 Terrain::Terrain()
 	:  
-	HomogeneousFaceSurface(),
-	xyScale(1)
+	IndexedFaceSurface(),
+	xyScale(1),
+	loadTimes(),
+	inverseXYScale(1),
+	columnOffset(0),
+	rowOffset(0),
+	maxColumn(0),
+	maxRow(0)
 	{ // constructor
 	// terrain vector will default to empty
 	// so no additional work required here
@@ -37,6 +164,47 @@ Terrain::Terrain()
 // xyScale gives the scale factor to use in the x-y directions
 bool Terrain::ReadFileTerrainData(const char *fileName, float XYScale)
 	{ // ReadFileTerrainData()
+	// read the height values in whichever format the file uses
+	auto start = std::chrono::steady_clock::now();
+	if (!ReadHeightValues(fileName, XYScale))
+		return false;
+	loadTimes.heights = MillisecondsSince(start);
+
+	// and turn them into triangles
+	BuildMesh();
+
+	// return success
+	return true;
+	} // ReadFileTerrainData()
+
+// reads just the height values, from either the text .dem format or the
+// binary heightfield format, which is detected from the file header
+// binary files carry their own xyScale, so XYScale is only used for text
+bool Terrain::ReadHeightValues(const char *fileName, float XYScale)
+	{ // ReadHeightValues()
+	// binary files are mapped, not parsed
+	if (MappedHeightfieldFile::IsHeightfieldFile(fileName))
+		{ // binary heightfield
+		MappedHeightfieldFile heightfieldFile;
+		if (!heightfieldFile.Open(fileName))
+			return false;
+
+		xyScale = heightfieldFile.XYScale();
+		m_width = heightfieldFile.Width();
+		m_height = heightfieldFile.Height();
+
+		// copy the rows straight out of the mapping, faulting the pages in on every core
+		heightValues.Resize(m_width, m_height);
+		ThreadPool::Shared().ParallelFor(0, m_height, std::max(1, TERRAIN_SAMPLES_PER_TASK / m_width), [&](long firstRow, long endRow)
+			{ // per block of rows
+			for (long row = firstRow; row < endRow; row++)
+				heightValues.SetRow(row, heightfieldFile.Row(row));
+			}); // per block of rows
+		UpdateQueryConstants();
+		heightPyramid.Build(heightValues);
+		return true;
+		} // binary heightfield
+
 	// open a file stream
 	std::ifstream inFile(fileName);
 	if (inFile.bad())
@@ -58,115 +226,308 @@ bool Terrain::ReadFileTerrainData(const char *fileName, float XYScale)
 // 	std::cout << "Width:  " << width << std::endl; 
 
 	// now allocate the memory and read in the data values
-	heightValues.resize(height);
+	heightValues.Resize(width, height);
+	std::vector<float> rowValues(width);
 
 	// the read / compute loop	
 	for (int row = 0; row < height; row++)
 		{ // per row
-		// allocate the row
-		heightValues[row].resize(width);
-
 		// loop along the row
 		for (int col = 0; col < width; col++)
 			// read in a value
-			inFile >> heightValues[row][col];
+			inFile >> rowValues[col];
+
+		// and store it in the grid
+		heightValues.SetRow(row, rowValues.data());
 		} // per row
-	
-	// now, we want the triangles to be centred on the origin, but with the zero elevation set
-	// at 0 z, so we have to juggle things somewhat
-	// compute a temporary midpoint for the data so that it will end up centred on the or
-	Cartesian3 midPoint;
-	midPoint.x		= xyScale * (width / 2);
-	midPoint.y		= xyScale * (height / 2);
-	// we will set the z value to be the average value of the data
-	midPoint.z		= 0.0;
-	
-	// each square of data is two triangles, but the end values don't have squares,
-	// so we don't need quite as many vertices
+
+	UpdateQueryConstants();
+	heightPyramid.Build(heightValues);
+	return true;
+	} // ReadHeightValues()
+
+// writes the height values out in the binary heightfield format
+// returns true on success, false otherwise
+bool Terrain::WriteFileTerrainBinary(const char *fileName)
+	{ // WriteFileTerrainBinary()
+	// untile the grid into a single row-major block for writing
+	std::vector<float> rowMajorValues((size_t) m_width * m_height);
+	for (int row = 0; row < m_height; row++)
+		heightValues.GetRow(row, rowMajorValues.data() + (size_t) row * m_width);
+
+	return WriteHeightfieldFile(fileName, m_width, m_height, xyScale, rowMajorValues.data());
+	} // WriteFileTerrainBinary()
+
+// builds the triangle mesh from the height values
+// there is one vertex per height sample, shared by up to six triangles
+void Terrain::BuildMesh()
+	{ // BuildMesh()
+	long height = m_height, width = m_width;
+	ThreadPool &threadPool = ThreadPool::Shared();
+	long rowsPerTask = std::max(1L, TERRAIN_SAMPLES_PER_TASK / std::max(1L, width));
+
+	// one vertex per sample, in row-major order, each block of rows on its own thread
+	auto start = std::chrono::steady_clock::now();
+	vertices.resize(width * height);
+	threadPool.ParallelFor(0, height, rowsPerTask, [&](long firstRow, long endRow)
+		{ // per block of rows
+		UpdateVertices(TerrainRegion(firstRow, endRow - 1, 0, width - 1));
+		}); // per block of rows
+	loadTimes.vertices = MillisecondsSince(start);
+
+	// each square of data is two triangles, but the end values don't have squares
+	start = std::chrono::steady_clock::now();
 	int nTriangles = (height-1)*(width-1) * 2;
-	vertices.resize(3 * nTriangles);
-
-	// add an extra loop counter for the vertex ID
-	int vertex = 0;
-
-	// now that we have read in all the data, we can create the triangles
-	for (int row = 0; row < height-1; row++)
-		for (int col = 0; col < width-1; col++)
-			{ // loop through squares
-			// first triangle
-			vertices[vertex++] = Cartesian3(	(xyScale * col) 		- midPoint.x , 		(midPoint.y - (xyScale * row		)), 	heightValues[row]		[col]);
-			vertices[vertex++] = Cartesian3(	(xyScale * (col+1)) 	- midPoint.x , 		(midPoint.y - (xyScale * (row+1)	)), 	heightValues[row+1]	[col+1]);
-			vertices[vertex++] = Cartesian3(	(xyScale * (col+1))	- midPoint.x , 		(midPoint.y - (xyScale * row		)), 	heightValues[row]		[col+1]);
-
-			// second triangle			
-			vertices[vertex++] = Cartesian3(	(xyScale * col) 		- midPoint.x , 		(midPoint.y - (xyScale * row		)), 	heightValues[row]		[col]);
-			vertices[vertex++] = Cartesian3(	(xyScale * col)	 	- midPoint.x , 		(midPoint.y - (xyScale * (row+1)	)), 	heightValues[row+1]	[col]);
-			vertices[vertex++] = Cartesian3(	(xyScale * (col+1))	- midPoint.x , 		(midPoint.y - (xyScale * (row+1)	)), 	heightValues[row+1]	[col+1]);
-			} // loop through squares
+	indices.resize(3 * nTriangles);
+
+	// now that we have the vertices, we can create the triangles
+	// every row of squares has a fixed place in the index array, so rows are independent
+	threadPool.ParallelFor(0, height - 1, rowsPerTask, [&](long firstRow, long endRow)
+		{ // per block of rows
+		for (long row = firstRow; row < endRow; row++)
+			{ // per row
+			// add an extra loop counter for the index ID
+			long index = 6 * row * (width - 1);
+			for (long col = 0; col < width-1; col++)
+				{ // loop through squares
+				// the four corners of the square
+				unsigned int upperLeft = row * width + col;
+				unsigned int upperRight = upperLeft + 1;
+				unsigned int lowerLeft = upperLeft + width;
+				unsigned int lowerRight = lowerLeft + 1;
+
+				// first triangle
+				indices[index++] = upperLeft;
+				indices[index++] = lowerRight;
+				indices[index++] = upperRight;
+
+				// second triangle
+				indices[index++] = upperLeft;
+				indices[index++] = lowerLeft;
+				indices[index++] = lowerRight;
+				} // loop through squares
+			} // per row
+		}); // per block of rows
+	loadTimes.triangles = MillisecondsSince(start);
 
 // 	std::cout << "Vertices: " << vertices.size() << std::endl;
 
 	// call the routine to compute normals
+	start = std::chrono::steady_clock::now();
 	ComputeUnitNormalVectors();
-	
-	// return success
-	return true;
-	} // ReadFileTerrainData()
-	
-// and a function to find the height at a known (x,y) coordinate
-float Terrain::getHeight(float x, float y)
-	{ // getHeight()
-// 	std::cout << "Getting height at " << std::fixed << x << ", " << y << std::endl;
-	float height = 0.0;
+	loadTimes.normals = MillisecondsSince(start);
+
+	// and the level of detail tree over the new vertices
+	start = std::chrono::steady_clock::now();
+	quadtree.Build(vertices, width, height);
+	loadTimes.quadtree = MillisecondsSince(start);
+
+	// the mesh now matches the grid, and any buffers are out of date
+	dirtyRegions.clear();
+	vertexBuffer.Release();
+	staleBufferRegions.clear();
+	} // BuildMesh()
+
+// rewrites the vertices of a block of samples from the height values
+void Terrain::UpdateVertices(const TerrainRegion &samples)
+	{ // UpdateVertices()
+	// now, we want the triangles to be centred on the origin, but with the zero elevation set
+	// at 0 z, so we have to juggle things somewhat
+	// the midpoint is the sample at the origin cached by UpdateQueryConstants(), so that
+	// the mesh and every query agree on where (0,0) is
+	Cartesian3 midPoint;
+	midPoint.x		= xyScale * columnOffset;
+	midPoint.y		= xyScale * rowOffset;
+	// we will set the z value to be the average value of the data
+	midPoint.z		= 0.0;
 
+	for (int row = samples.firstRow; row <= samples.lastRow; row++)
+		for (int col = samples.firstColumn; col <= samples.lastColumn; col++)
+			vertices[row * m_width + col] = Cartesian3(	(xyScale * col) - midPoint.x, 	(midPoint.y - (xyScale * row)), 	heightValues.At(row, col));
+	} // UpdateVertices()
+
+// brings the vertices and normals up to date with any edits to the height values
+// each edited sample is written once, and only the cells touching it get new normals
+void Terrain::UpdateMesh()
+	{ // UpdateMesh()
+	for (const TerrainRegion &samples : dirtyRegions)
+		{ // per dirty region
+		UpdateVertices(samples);
+		RefreshMesh(samples);
+		} // per dirty region
+	dirtyRegions.clear();
+	} // UpdateMesh()
+
+// rebuilds everything derived from the vertices of a block of samples
+void Terrain::RefreshMesh(const TerrainRegion &samples)
+	{ // RefreshMesh()
+	// the cells that have one of the samples as a corner
+	long cellsPerRow = m_width - 1;
+	TerrainRegion cells(	std::max(0L, samples.firstRow - 1),			std::min((long) m_height - 2, samples.lastRow),
+							std::max(0L, samples.firstColumn - 1),		std::min(cellsPerRow - 1, samples.lastColumn));
+	for (long row = cells.firstRow; row <= cells.lastRow; row++)
+		ComputeUnitNormalVectors(2 * (row * cellsPerRow + cells.firstColumn), 2 * (row * cellsPerRow + cells.lastColumn) + 2);
+
+	// the chunk bounds and errors over the samples
+	quadtree.Refresh(vertices, samples);
+
+	// and the buffers, if there are any yet
+	if (vertexBuffer.IsAllocated())
+		staleBufferRegions.push_back(samples);
+	} // RefreshMesh()
+
+// copies the heights of the dirty regions into patches and clears them
+// called by the thread editing the heights; the patches then go to the drawing thread
+void Terrain::TakePatches(std::vector<TerrainPatch> &patches)
+	{ // TakePatches()
+	for (const TerrainRegion &samples : dirtyRegions)
+		{ // per dirty region
+		patches.emplace_back(samples);
+		std::vector<float> &heights = patches.back().heights;
+		heights.reserve((samples.lastRow - samples.firstRow + 1) * (samples.lastColumn - samples.firstColumn + 1));
+		for (long row = samples.firstRow; row <= samples.lastRow; row++)
+			for (long col = samples.firstColumn; col <= samples.lastColumn; col++)
+				heights.push_back(heightValues.At(row, col));
+		} // per dirty region
+	dirtyRegions.clear();
+	} // TakePatches()
+
+// writes a patch's heights into the vertices and refreshes the mesh around it
+// reads nothing but the patch and the mesh, so the height values may be edited meanwhile
+void Terrain::ApplyPatch(const TerrainPatch &patch)
+	{ // ApplyPatch()
+	const TerrainRegion &samples = patch.samples;
+	const float *height = patch.heights.data();
+	for (long row = samples.firstRow; row <= samples.lastRow; row++)
+		for (long col = samples.firstColumn; col <= samples.lastColumn; col++)
+			vertices[row * m_width + col].z = *height++;
+	RefreshMesh(samples);
+	} // ApplyPatch()
+
+// records that a block of height samples has changed
+// overlapping regions are merged so that no cell is rebuilt twice
+void Terrain::MarkDirty(TerrainRegion samples)
+	{ // MarkDirty()
+	for (size_t region = 0; region < dirtyRegions.size(); )
+		{ // per existing region
+		if (dirtyRegions[region].Overlaps(samples))
+			{ // absorb it and start again, since the union may now touch others
+			samples.Include(dirtyRegions[region]);
+			dirtyRegions.erase(dirtyRegions.begin() + region);
+			region = 0;
+			} // absorb it and start again
+		else
+			region++;
+		} // per existing region
+	dirtyRegions.push_back(samples);
+	} // MarkDirty()
+
+// routine to render: the mesh is refreshed from the grid first
+void Terrain::Render(columnMajorMatrix &viewMatrix)
+	{ // Render()
+	UpdateMesh();
+	IndexedFaceSurface::Render(viewMatrix);
+	} // Render()
+
+// routine to render through the quadtree: only the chunks in the view frustum are
+// drawn, each at the coarsest level whose error stays under the quadtree's pixel tolerance
+// the mesh is not refreshed here, since it may be patched from another thread's edits
+void Terrain::Render(columnMajorMatrix &viewMatrix, const columnMajorMatrix &projectionMatrix, float errorScale)
+	{ // Render()
+	// immediate mode transforms every vertex of every chunk on the CPU, and is also
+	// the fallback where the context can't light the triangles by their face normals
+	if (!VertexBuffer::Available() || FaceNormalProgram() == 0)
+		{ // immediate mode
+		quadtree.Render(vertices, viewMatrix, projectionMatrix, errorScale);
+		return;
+		} // immediate mode
+
+	// retained: the grid stays on the card, and the card applies the matrix
+	// the vertices are shared by triangles at every level of detail, so they can't carry
+	// a face normal the way a model's provoking vertices do, and the program finds it instead
+	UploadBuffers();
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glLoadMatrixf(viewMatrix.coordinates);
+
+	glEnableClientState(GL_VERTEX_ARRAY);
+	vertexBuffer.Bind();
+	glVertexPointer(4, GL_FLOAT, sizeof(Homogeneous4), NULL);
+	vertexBuffer.Unbind();
+
+	glUseProgram(FaceNormalProgram());
+	quadtree.RenderBuffers(viewMatrix, projectionMatrix, errorScale);
+	glUseProgram(0);
+
+	glDisableClientState(GL_VERTEX_ARRAY);
+	glPopMatrix();
+	} // Render()
+
+// brings the buffers up to date with the vertices
+// the first call uploads the whole grid; after that, only the samples in edited regions
+void Terrain::UploadBuffers()
+	{ // UploadBuffers()
+	long width = m_width;
+	if (!vertexBuffer.IsAllocated())
+		{ // whole grid
+		vertexBuffer.Allocate(vertices.size() * sizeof(Homogeneous4), vertices.data());
+		staleBufferRegions.clear();
+		return;
+		} // whole grid
+
+	for (const TerrainRegion &samples : staleBufferRegions)
+		{ // per edited region
+		// each row of the region is a contiguous run of the buffer
+		long columns = samples.lastColumn - samples.firstColumn + 1;
+		for (long row = samples.firstRow; row <= samples.lastRow; row++)
+			vertexBuffer.Update((row * width + samples.firstColumn) * sizeof(Homogeneous4), columns * sizeof(Homogeneous4), &vertices[row * width + samples.firstColumn]);
+		} // per edited region
+	staleBufferRegions.clear();
+	} // UploadBuffers()
+
+// caches the grid geometry used by every height query, so that getHeight()
+// does not recompute the array origin and extent each call
+void Terrain::UpdateQueryConstants()
+	{ // UpdateQueryConstants()
 	// retrieve the number of rows and columns of the data
-	long nRows = heightValues.size(), nColumns = heightValues[0].size();
-	
-//	std::cout << "nRows: " << nRows << " nColumns: " << nColumns << std::endl;
-	
-	// Use this to compute the logical size of the map
-	long totalHeight = (nRows - 1) * xyScale;
-	long totalWidth = (nColumns - 1) * xyScale;
-
-// 	std::cout << "totalHeight: " << totalHeight << " totalWidth: " << totalWidth << std::endl;
-
-	// this returns the height at a known point.
-	// we start by noting that (0,0) is in the dead centre, which is located at
-	// x = nRows / 2 (integer), y = nRows / 2 (integer)
-	// BUT that's only because of how I wrote the code to generate the data
-	long arrayOrigin_i = nRows / 2;
-	long arrayOrigin_j = nColumns / 2;
+	long nRows = heightValues.Height(), nColumns = heightValues.Width();
 
-// 	std::cout << "Array Origin " << arrayOrigin_i << ", " << arrayOrigin_j << " or " << arrayOrigin_i * xyScale << ", " << arrayOrigin_j * xyScale << std::endl; 
+	// (0,0) is in the dead centre, which is located at
+	// row = nRows / 2 (integer), column = nColumns / 2 (integer)
+	// and rows run downwards, so y is flipped
+	// the mesh, the edits and the ray casts all use this origin too
+	inverseXYScale = 1.0f / xyScale;
+	columnOffset = nColumns / 2;
+	rowOffset = nRows / 2;
 
-	// now correct x and y for this offset (note rows are y, columns are x)
-	x = x + arrayOrigin_j * xyScale;
-	y = y + arrayOrigin_i * xyScale;
+	// the last sample index in each direction, and the last cell
+	maxColumn = nColumns - 1;
+	maxRow = nRows - 1;
+	} // UpdateQueryConstants()
 
-// 	std::cout << "x, y now " << x << ", " << y << std::endl;
-
-	// we need to flip coordinates vertically because the rows start at the top
-	y = totalHeight - y;
-
-// 	std::cout << "x, y now " << x << ", " << y << std::endl;
+// and a function to find the height at a known (x,y) coordinate
+// points off the edge of the terrain are clamped to the nearest edge
+float Terrain::getHeight(float x, float y)
+	{ // getHeight()
+	// convert to grid units: columns are x, rows are y counted from the top
+	float u = x * inverseXYScale + columnOffset;
+	float v = rowOffset - y * inverseXYScale;
 
-	// now divide by the x-y scale to get the index 
-	long x_integer	=	x / xyScale;
-	long y_integer 	= 	y / xyScale;
+	// clamp to the grid, so that the cell is always valid
+	u = std::min(std::max(u, 0.0f), maxColumn);
+	v = std::min(std::max(v, 0.0f), maxRow);
 
-// 	std::cout << "Integer Portions: " << x_integer << ", " << y_integer << std::endl;
+	// the integer parts give the cell, the last sample belongs to the last cell
+	long column	=	std::min((long) u, (long) maxColumn - 1);
+	long row	=	std::min((long) v, (long) maxRow - 1);
 
 	// now work out the fractional parts
-	float x_remainder	=	(float)(x - (xyScale * x_integer))/xyScale;
-	float y_remainder	=	(float)(y - (xyScale * y_integer))/xyScale;
-
-// 	std::cout << "Fractional Portions: " << x_remainder << ", " << y_remainder << std::endl;
-
-	// now we can find the row and column easily
-	long row	=	y_integer;
-	long column	=	x_integer; 
+	float x_remainder	=	u - column;
+	float y_remainder	=	v - row;
 
-// 	std::cout << "Row & Column: " << row << ", " << column << std::endl;
+	// fetch all four corners of the cell at once from the grid
+	float upperLeft, upperRight, lowerLeft, lowerRight;
+	heightValues.CellCorners(row, column, upperLeft, upperRight, lowerLeft, lowerRight);
 
 	// OK. There are two possibilities - above or below the TL-BR diagonal
 	// Since this is the line x = y, it's easy to check
@@ -178,46 +539,358 @@ float Terrain::getHeight(float x, float y)
 		// (1.0 - y_remainder) * x_remainder is beta, the barycentric coordinate for the LR corner
 		// (1.0 - y_remainder) * (1.0 - x_remainder) is gamma, the barycentric coordinate for the LL corner
 		float alpha = y_remainder;
-		float beta = (1.0 - y_remainder) * x_remainder;
-		float gamma = 1.0 - alpha - beta;
+		float beta = (1.0f - y_remainder) * x_remainder;
+		float gamma = 1.0f - alpha - beta;
 		
 		// compute and return
-		height = alpha * heightValues[row][column] + beta * heightValues[row+1][column+1] + gamma * heightValues[row+1][column];
+		return alpha * upperLeft + beta * lowerRight + gamma * lowerLeft;
 		} // LL triangle
 	else
 		{ // UR triangle
 		// (1.0 - x_remainder) is alpha, the barycentric coordinate for the UL corner
 		// x_remainder * y_remainder is beta, the barycentric coordinate for the LR corner
 		// x_remainder * (1.0 - y_remainder) is gamma, the barycentric coordinate for the UR corner
-		float alpha = 1.0 - y_remainder;
+		float alpha = 1.0f - y_remainder;
 		float beta = x_remainder * y_remainder;
-		float gamma = 1.0 - alpha - beta;
+		float gamma = 1.0f - alpha - beta;
 		
 		// compute and return
-		height = alpha * heightValues[row][column] + beta * heightValues[row+1][column+1] + gamma * heightValues[row][column+1];
+		return alpha * upperLeft + beta * lowerRight + gamma * upperRight;
 		} // UR triangle
-
-// 	std::cout << "Row:    " << row << " Column: " << column << std::endl;
-// 	std::cout << "x:      " << x_remainder << " y:      " << y_remainder << std::endl;
-// 	std::cout << "Height: " << height << std::endl;
-	
-	// return the height
-	return height;
 	} // getHeight()
 
-
+// finds the heights at a batch of (x,y) coordinates, given as separate arrays
+// gives the same results as calling getHeight() on each point in turn
+void Terrain::getHeightBatch(const float *xs, const float *ys, float *heights, long count)
+	{ // getHeightBatch()
+	long point = 0;
+
+#if defined(__AVX2__)
+	// eight points at a time, with the grid corners fetched by gathers
+	const __m256 inverseScale = _mm256_set1_ps(inverseXYScale);
+	const __m256 uOffset = _mm256_set1_ps(columnOffset);
+	const __m256 vOffset = _mm256_set1_ps(rowOffset);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 uMax = _mm256_set1_ps(maxColumn);
+	const __m256 vMax = _mm256_set1_ps(maxRow);
+	const __m256i lastCellColumn = _mm256_set1_epi32((int) maxColumn - 1);
+	const __m256i lastCellRow = _mm256_set1_epi32((int) maxRow - 1);
+	const __m256i stride = _mm256_set1_epi32((int) heightValues.Stride());
+	const __m256i right = _mm256_set1_epi32(1);
+	const float *values = heightValues.Data();
+
+	for (; point + 8 <= count; point += 8)
+		{ // per block of eight
+		// grid coordinates, clamped to the grid
+		__m256 u = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(xs + point), inverseScale), uOffset);
+		__m256 v = _mm256_sub_ps(vOffset, _mm256_mul_ps(_mm256_loadu_ps(ys + point), inverseScale));
+		u = _mm256_min_ps(_mm256_max_ps(u, zero), uMax);
+		v = _mm256_min_ps(_mm256_max_ps(v, zero), vMax);
+
+		// cells: truncation is floor since u and v are not negative
+		__m256i column = _mm256_min_epi32(_mm256_cvttps_epi32(u), lastCellColumn);
+		__m256i row = _mm256_min_epi32(_mm256_cvttps_epi32(v), lastCellRow);
+		__m256 xRemainder = _mm256_sub_ps(u, _mm256_cvtepi32_ps(column));
+		__m256 yRemainder = _mm256_sub_ps(v, _mm256_cvtepi32_ps(row));
+
+		// index of the upper left corner, as in Heightfield::Index(); the lower corners are a row on
+		__m256i upperLeftIndex = _mm256_add_epi32(_mm256_mullo_epi32(row, stride), column);
+		__m256i down = stride;
+
+		// gather the corners
+		__m256 upperLeft = _mm256_i32gather_ps(values, upperLeftIndex, 4);
+		__m256 upperRight = _mm256_i32gather_ps(values, _mm256_add_epi32(upperLeftIndex, right), 4);
+		__m256 lowerLeft = _mm256_i32gather_ps(values, _mm256_add_epi32(upperLeftIndex, down), 4);
+		__m256 lowerRight = _mm256_i32gather_ps(values, _mm256_add_epi32(_mm256_add_epi32(upperLeftIndex, down), right), 4);
+
+		// weights for both triangles, then select per lane
+		__m256 lowerAlpha = yRemainder;
+		__m256 lowerBeta = _mm256_mul_ps(_mm256_sub_ps(one, yRemainder), xRemainder);
+		__m256 lowerGamma = _mm256_sub_ps(_mm256_sub_ps(one, lowerAlpha), lowerBeta);
+		__m256 upperAlpha = _mm256_sub_ps(one, yRemainder);
+		__m256 upperBeta = _mm256_mul_ps(xRemainder, yRemainder);
+		__m256 upperGamma = _mm256_sub_ps(_mm256_sub_ps(one, upperAlpha), upperBeta);
+
+		__m256 inLower = _mm256_cmp_ps(xRemainder, yRemainder, _CMP_LT_OQ);
+		__m256 alpha = _mm256_blendv_ps(upperAlpha, lowerAlpha, inLower);
+		__m256 beta = _mm256_blendv_ps(upperBeta, lowerBeta, inLower);
+		__m256 gamma = _mm256_blendv_ps(upperGamma, lowerGamma, inLower);
+		__m256 third = _mm256_blendv_ps(upperRight, lowerLeft, inLower);
+
+		__m256 height = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(alpha, upperLeft), _mm256_mul_ps(beta, lowerRight)), _mm256_mul_ps(gamma, third));
+		_mm256_storeu_ps(heights + point, height);
+		} // per block of eight
+#elif defined(__SSE2__)
+	// four points at a time: SSE has no gathers, so the corners are fetched in scalar code
+	const __m128 inverseScale = _mm_set1_ps(inverseXYScale);
+	const __m128 uOffset = _mm_set1_ps(columnOffset);
+	const __m128 vOffset = _mm_set1_ps(rowOffset);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 uMax = _mm_set1_ps(maxColumn);
+	const __m128 vMax = _mm_set1_ps(maxRow);
+	const __m128 uLastCell = _mm_set1_ps(maxColumn - 1.0f);
+	const __m128 vLastCell = _mm_set1_ps(maxRow - 1.0f);
+
+	for (; point + 4 <= count; point += 4)
+		{ // per block of four
+		__m128 u = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(xs + point), inverseScale), uOffset);
+		__m128 v = _mm_sub_ps(vOffset, _mm_mul_ps(_mm_loadu_ps(ys + point), inverseScale));
+		u = _mm_min_ps(_mm_max_ps(u, zero), uMax);
+		v = _mm_min_ps(_mm_max_ps(v, zero), vMax);
+
+		// cells: truncation is floor since u and v are not negative
+		__m128 columnFloat = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(u)), uLastCell);
+		__m128 rowFloat = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(v)), vLastCell);
+		__m128 xRemainder = _mm_sub_ps(u, columnFloat);
+		__m128 yRemainder = _mm_sub_ps(v, rowFloat);
+
+		alignas(16) int columns[4], rows[4];
+		alignas(16) float upperLefts[4], upperRights[4], lowerLefts[4], lowerRights[4];
+		_mm_store_si128((__m128i *) columns, _mm_cvttps_epi32(columnFloat));
+		_mm_store_si128((__m128i *) rows, _mm_cvttps_epi32(rowFloat));
+		for (int lane = 0; lane < 4; lane++)
+			heightValues.CellCorners(rows[lane], columns[lane], upperLefts[lane], upperRights[lane], lowerLefts[lane], lowerRights[lane]);
+		__m128 upperLeft = _mm_load_ps(upperLefts);
+		__m128 upperRight = _mm_load_ps(upperRights);
+		__m128 lowerLeft = _mm_load_ps(lowerLefts);
+		__m128 lowerRight = _mm_load_ps(lowerRights);
+
+		// weights for both triangles, then select per lane with masks
+		__m128 lowerAlpha = yRemainder;
+		__m128 lowerBeta = _mm_mul_ps(_mm_sub_ps(one, yRemainder), xRemainder);
+		__m128 lowerGamma = _mm_sub_ps(_mm_sub_ps(one, lowerAlpha), lowerBeta);
+		__m128 upperAlpha = _mm_sub_ps(one, yRemainder);
+		__m128 upperBeta = _mm_mul_ps(xRemainder, yRemainder);
+		__m128 upperGamma = _mm_sub_ps(_mm_sub_ps(one, upperAlpha), upperBeta);
+
+		__m128 inLower = _mm_cmplt_ps(xRemainder, yRemainder);
+		__m128 alpha = _mm_or_ps(_mm_and_ps(inLower, lowerAlpha), _mm_andnot_ps(inLower, upperAlpha));
+		__m128 beta = _mm_or_ps(_mm_and_ps(inLower, lowerBeta), _mm_andnot_ps(inLower, upperBeta));
+		__m128 gamma = _mm_or_ps(_mm_and_ps(inLower, lowerGamma), _mm_andnot_ps(inLower, upperGamma));
+		__m128 third = _mm_or_ps(_mm_and_ps(inLower, lowerLeft), _mm_andnot_ps(inLower, upperRight));
+
+		__m128 height = _mm_add_ps(_mm_add_ps(_mm_mul_ps(alpha, upperLeft), _mm_mul_ps(beta, lowerRight)), _mm_mul_ps(gamma, third));
+		_mm_storeu_ps(heights + point, height);
+		} // per block of four
+#endif
+
+	// whatever is left over, one at a time
+	for (; point < count; point++)
+		heights[point] = getHeight(xs[point], ys[point]);
+	} // getHeightBatch()
+
+// deforms the terrain around a lava bomb impact
+// the crater is applied to the height values, which collision reads directly,
+// and the mesh catches up on the next UpdateMesh()
+// only the grid samples within reach of the hitpoint are visited
 void Terrain::EditMesh(const Cartesian3& hitpoint, float radius, const columnMajorMatrix& matrix)
-{
-	for(auto& vertex: vertices)
-	{    
-		float x = vertex.x - hitpoint.x;
-		float y = vertex.y - hitpoint.z;
-		float dist = sqrt(x*x + y*y);
-		float force = 8.0f;
-		if(dist <= radius * force)
-		{
-			float a = ((radius - dist) / radius) * force;
-			vertex.z += a * 1.0f;
-		}
-	}	
-}
+	{ // EditMesh()
+	float force = 8.0f;
+	// samples further away than this are left alone
+	float reach = radius * force;
+
+	// the mesh is centred on the origin exactly as in UpdateVertices()
+	float midPointX = xyScale * columnOffset;
+	float midPointY = xyScale * rowOffset;
+
+	// the block of grid samples that could be in reach, clamped to the grid
+	// mesh x is the column direction, mesh y runs against the rows
+	TerrainRegion samples(	std::max(0L,					(long) ceil((midPointY - hitpoint.z - reach) / xyScale)),
+							std::min((long) m_height - 1,	(long) floor((midPointY - hitpoint.z + reach) / xyScale)),
+							std::max(0L,					(long) ceil((hitpoint.x - reach + midPointX) / xyScale)),
+							std::min((long) m_width - 1,	(long) floor((hitpoint.x + reach + midPointX) / xyScale)));
+	if (samples.IsEmpty())
+		return;
+
+	for (long row = samples.firstRow; row <= samples.lastRow; row++)
+		for (long col = samples.firstColumn; col <= samples.lastColumn; col++)
+			{ // per grid sample
+			float x = ((xyScale * col) - midPointX) - hitpoint.x;
+			float y = (midPointY - (xyScale * row)) - hitpoint.z;
+			float dist = sqrt(x*x + y*y);
+			if (dist <= reach)
+				heightValues.At(row, col) += ((radius - dist) / radius) * force;
+			} // per grid sample
+
+	// ray queries see the crater straight away
+	heightPyramid.Refresh(heightValues, samples);
+	MarkDirty(samples);
+	} // EditMesh()
+
+// clips a ray parameter interval to one axis of a box
+// returns false if the interval is empty
+static inline bool ClipToSlab(float origin, float direction, float inverseDirection, float low, float high, float &entry, float &exit)
+	{ // ClipToSlab()
+	// parallel to the slab: either always inside it or never
+	if (fabs(direction) < FLT_MIN)
+		return origin >= low && origin <= high;
+	float nearParameter = (low - origin) * inverseDirection, farParameter = (high - origin) * inverseDirection;
+	if (nearParameter > farParameter)
+		std::swap(nearParameter, farParameter);
+	entry = std::max(entry, nearParameter);
+	exit = std::min(exit, farParameter);
+	return entry <= exit;
+	} // ClipToSlab()
+
+// Moller-Trumbore ray / triangle intersection
+// returns true if the ray meets the triangle at a parameter below bestParameter, which is updated
+static inline bool RayTriangle(const float origin[3], const float direction[3], const float a[3], const float b[3], const float c[3], float &bestParameter)
+	{ // RayTriangle()
+	float edge1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+	float edge2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+	float p[3] = {	direction[1] * edge2[2] - direction[2] * edge2[1],
+					direction[2] * edge2[0] - direction[0] * edge2[2],
+					direction[0] * edge2[1] - direction[1] * edge2[0] };
+	float determinant = edge1[0] * p[0] + edge1[1] * p[1] + edge1[2] * p[2];
+	if (fabs(determinant) < 1.0e-12f)
+		return false;
+	float inverse = 1.0f / determinant;
+	float s[3] = { origin[0] - a[0], origin[1] - a[1], origin[2] - a[2] };
+	float alpha = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inverse;
+	if (alpha < 0.0f || alpha > 1.0f)
+		return false;
+	float q[3] = {	s[1] * edge1[2] - s[2] * edge1[1],
+					s[2] * edge1[0] - s[0] * edge1[2],
+					s[0] * edge1[1] - s[1] * edge1[0] };
+	float beta = (direction[0] * q[0] + direction[1] * q[1] + direction[2] * q[2]) * inverse;
+	if (beta < 0.0f || alpha + beta > 1.0f)
+		return false;
+	float parameter = (edge2[0] * q[0] + edge2[1] * q[1] + edge2[2] * q[2]) * inverse;
+	if (parameter < 0.0f || parameter > bestParameter)
+		return false;
+	bestParameter = parameter;
+	return true;
+	} // RayTriangle()
+
+// finds the first point where a ray meets the terrain's triangles
+// the ray is walked down the height pyramid, nearest block first, and any block it
+// passes wholly above or below is skipped with everything inside it
+// the triangles tested are the ones drawn, split along the same diagonal as the mesh
+bool Terrain::IntersectRay(const Cartesian3 &origin, const Cartesian3 &direction, float maxParameter, float &hitParameter) const
+	{ // IntersectRay()
+	if (heightPyramid.Levels() == 0)
+		return false;
+
+	// the ray in grid units: u along the columns, v down the rows, and the height
+	// the parameter along the ray is the same in both
+	float rayOrigin[3] = { origin.x * inverseXYScale + columnOffset, rowOffset - origin.z * inverseXYScale, origin.y };
+	float rayDirection[3] = { direction.x * inverseXYScale, -direction.z * inverseXYScale, direction.y };
+	float inverseDirection[3];
+	for (int axis = 0; axis < 3; axis++)
+		inverseDirection[axis] = fabs(rayDirection[axis]) < FLT_MIN ? 0.0f : 1.0f / rayDirection[axis];
+	long cellsWide = heightPyramid.LevelWidth(0), cellsHigh = heightPyramid.LevelHeight(0);
+
+	// blocks still to visit, with the parameter at which the ray enters them
+	// each visit pops one and pushes at most four, so three per level is enough
+	struct PyramidBlock { int level; long row, col; float entry; };
+	PyramidBlock stack[3 * 32 + 1];
+	int stackSize = 0;
+	float bestParameter = maxParameter;
+	bool hit = false;
+
+	// the parameters over which the ray is inside a block's box
+	auto ClipToBlock = [&](int level, long row, long col, float &entry) -> bool
+		{ // ClipToBlock()
+		long size = 1L << level;
+		const HeightRange &range = heightPyramid.Range(level, row, col);
+		float exit = bestParameter;
+		entry = 0.0f;
+		return	ClipToSlab(rayOrigin[0], rayDirection[0], inverseDirection[0], col * size, std::min((col + 1) * size, cellsWide), entry, exit)
+			&&	ClipToSlab(rayOrigin[1], rayDirection[1], inverseDirection[1], row * size, std::min((row + 1) * size, cellsHigh), entry, exit)
+			&&	ClipToSlab(rayOrigin[2], rayDirection[2], inverseDirection[2], range.low, range.high, entry, exit);
+		}; // ClipToBlock()
+
+	// start from the smallest block holding both ends, so that short segments
+	// do not walk down from the root; ends off the grid are pulled onto it
+	auto CellOf = [](float coordinate, long cells) -> long
+		{ return (long) std::min(std::max(coordinate, 0.0f), (float) (cells - 1)); };
+	long startCol = CellOf(rayOrigin[0], cellsWide), startRow = CellOf(rayOrigin[1], cellsHigh);
+	long endCol = CellOf(rayOrigin[0] + rayDirection[0] * maxParameter, cellsWide);
+	long endRow = CellOf(rayOrigin[1] + rayDirection[1] * maxParameter, cellsHigh);
+	int startLevel = 0;
+	while (startLevel < heightPyramid.Levels() - 1 && ((startCol >> startLevel) != (endCol >> startLevel) || (startRow >> startLevel) != (endRow >> startLevel)))
+		startLevel++;
+	float startEntry;
+	if (!ClipToBlock(startLevel, startRow >> startLevel, startCol >> startLevel, startEntry))
+		return false;
+	stack[stackSize++] = { startLevel, startRow >> startLevel, startCol >> startLevel, startEntry };
+
+	while (stackSize > 0)
+		{ // per block
+		PyramidBlock block = stack[--stackSize];
+		// something nearer has already been hit
+		if (block.entry > bestParameter)
+			continue;
+
+		if (block.level == 0)
+			{ // single cell: test its two triangles
+			float upperLeftHeight, upperRightHeight, lowerLeftHeight, lowerRightHeight;
+			heightValues.CellCorners(block.row, block.col, upperLeftHeight, upperRightHeight, lowerLeftHeight, lowerRightHeight);
+			float upperLeft[3] = { (float) block.col, (float) block.row, upperLeftHeight };
+			float upperRight[3] = { (float) block.col + 1, (float) block.row, upperRightHeight };
+			float lowerLeft[3] = { (float) block.col, (float) block.row + 1, lowerLeftHeight };
+			float lowerRight[3] = { (float) block.col + 1, (float) block.row + 1, lowerRightHeight };
+			if (RayTriangle(rayOrigin, rayDirection, upperLeft, lowerRight, upperRight, bestParameter))
+				hit = true;
+			if (RayTriangle(rayOrigin, rayDirection, upperLeft, lowerLeft, lowerRight, bestParameter))
+				hit = true;
+			continue;
+			} // single cell: test its two triangles
+
+		// the quadrants the ray passes through, sorted so the nearest is visited first
+		PyramidBlock children[4];
+		int childCount = 0;
+		int level = block.level - 1;
+		for (long row = 2 * block.row; row < std::min(2 * block.row + 2, heightPyramid.LevelHeight(level)); row++)
+			for (long col = 2 * block.col; col < std::min(2 * block.col + 2, heightPyramid.LevelWidth(level)); col++)
+				{ // per quadrant
+				float entry;
+				if (!ClipToBlock(level, row, col, entry))
+					continue;
+				// insert, keeping the furthest first
+				int slot = childCount++;
+				while (slot > 0 && children[slot - 1].entry < entry)
+					{ // shuffle along
+					children[slot] = children[slot - 1];
+					slot--;
+					} // shuffle along
+				children[slot] = { level, row, col, entry };
+				} // per quadrant
+		for (int child = 0; child < childCount; child++)
+			stack[stackSize++] = children[child];
+		} // per block
+
+	if (hit)
+		hitParameter = bestParameter;
+	return hit;
+	} // IntersectRay()
+
+// finds the first point where the segment from start to end meets the terrain
+bool Terrain::IntersectSegment(const Cartesian3 &start, const Cartesian3 &end, Cartesian3 &hitPoint) const
+	{ // IntersectSegment()
+	Cartesian3 direction = end - start;
+	float parameter;
+	if (!IntersectRay(start, direction, 1.0f, parameter))
+		return false;
+	hitPoint = start + direction * parameter;
+	return true;
+	} // IntersectSegment()
+
+// intersects count segments, spread over the thread pool
+void Terrain::IntersectSegments(const Cartesian3 *starts, const Cartesian3 *ends, Cartesian3 *hitPoints, unsigned char *hits, long count) const
+	{ // IntersectSegments()
+	ThreadPool::Shared().ParallelFor(0, count, 256, [&](long first, long end)
+		{ // per block of segments
+		for (long segment = first; segment < end; segment++)
+			hits[segment] = IntersectSegment(starts[segment], ends[segment], hitPoints[segment]);
+		}); // per block of segments
+	} // IntersectSegments()
+
+// true if no part of the terrain lies between two points
+bool Terrain::HasLineOfSight(const Cartesian3 &from, const Cartesian3 &to) const
+	{ // HasLineOfSight()
+	float parameter;
+	return !IntersectRay(from, to - from, 1.0f, parameter);
+	} // HasLineOfSight()
@@ -7,7 +7,7 @@
 //	Terrain.h
 //	------------------------
 //	
-//	A subclass of HomogeneousFaceSurface for terrain
+//	A subclass of IndexedFaceSurface for terrain
 //	
 ///////////////////////////////////////////////////
 
@@ -16,27 +16,144 @@
 
 #include <vector>
 
-#include "HomogeneousFaceSurface.h"
+#include "IndexedFaceSurface.h"
+#include "Heightfield.h"
+#include "TerrainQuadtree.h"
+#include "HeightPyramid.h"
+#include "VertexBuffer.h"
 
-class Terrain : public HomogeneousFaceSurface
+// time taken by each phase of the last load, in milliseconds
+struct TerrainLoadTimes
+	{ // struct TerrainLoadTimes
+	double heights, vertices, triangles, normals, quadtree;
+	}; // struct TerrainLoadTimes
+
+// the heights of a block of samples, copied so that one thread can update the
+// mesh from them while another goes on editing the height values
+struct TerrainPatch
+	{ // struct TerrainPatch
+	TerrainRegion samples;
+	// row by row across the block
+	std::vector<float> heights;
+
+	TerrainPatch(const TerrainRegion &Samples)
+		: samples(Samples)
+		{}
+	}; // struct TerrainPatch
+
+class Terrain : public IndexedFaceSurface
 	{ // class Terrain
 	public:
-	// array to store the terrain data
-	std::vector<std::vector<float>> heightValues;
+	// contiguous grid to store the terrain data
+	// this is the one authoritative copy of the terrain shape: collision reads it
+	// directly, and the vertices are derived from it by UpdateMesh()
+	Heightfield heightValues;
+
+	// blocks of height samples edited since the triangles were last updated
+	std::vector<TerrainRegion> dirtyRegions;
+
+	// chunked level of detail over the vertices, for drawing
+	TerrainQuadtree quadtree;
+
+	// min/max pyramid over the height values, for ray queries
+	// kept up to date with every edit, unlike the vertices
+	HeightPyramid heightPyramid;
+	
+	// the vertices, on the card for retained rendering
+	// uploaded whole by the first retained Render(), and then only where edited
+	VertexBuffer vertexBuffer;
+
+	// blocks of samples whose vertices changed since the buffers were brought up to date
+	std::vector<TerrainRegion> staleBufferRegions;
 	
 	// keep track of the xy scale that we are told about
 	float xyScale;
 
+	// how long the last ReadFileTerrainData() spent on each phase
+	TerrainLoadTimes loadTimes;
+
 	// constructor will initialise to safe values
 	Terrain();
+
+	// applies a crater to the height values and marks them dirty
 	void EditMesh(const Cartesian3& hitpoint, float radius, const columnMajorMatrix& matrix);
 	// read routine returns true on success, failure otherwise
 	// xyScale gives the scale factor to use in the x-y directions
 	bool ReadFileTerrainData(const char *fileName, float XYScale);
+
+	// reads the height values only, from a text .dem or a binary heightfield
+	bool ReadHeightValues(const char *fileName, float XYScale);
+
+	// writes the height values as a binary heightfield, returns true on success
+	bool WriteFileTerrainBinary(const char *fileName);
+
+	// builds the triangles and normals from the height values
+	// rows and triangles are shared out over the thread pool
+	void BuildMesh();
+
+	// rewrites the vertices of a block of samples from the height values
+	void UpdateVertices(const TerrainRegion &samples);
+
+	// brings the vertices and normals up to date with the dirty regions
+	void UpdateMesh();
+
+	// records that a block of height samples has changed
+	void MarkDirty(TerrainRegion samples);
+
+	// rebuilds the normals, quadtree bounds and stale buffer list around a block
+	// of samples whose vertices have just been rewritten
+	void RefreshMesh(const TerrainRegion &samples);
+
+	// copies the heights of the dirty regions into patches and clears them, for
+	// a mesh drawn on another thread: the vertices are then only updated by ApplyPatch()
+	void TakePatches(std::vector<TerrainPatch> &patches);
+
+	// writes a patch's heights into the vertices and refreshes the mesh around it
+	void ApplyPatch(const TerrainPatch &patch);
+
+	// routine to render, updating the mesh first
+	void Render(columnMajorMatrix &viewMatrix);
+
+	// brings the buffers up to date with the vertices
+	void UploadBuffers();
+
+	// routine to render through the quadtree, drawing only the chunks in view
+	// at a level of detail chosen for the projection
+	// the mesh is drawn as it is: call UpdateMesh() or ApplyPatch() first for any edits
+	// uses vertex buffers where the context has them, and immediate mode otherwise
+	// errorScale is the number of pixels covered by one unit at unit distance
+	void Render(columnMajorMatrix &viewMatrix, const columnMajorMatrix &projectionMatrix, float errorScale);
 	
 	// A function to find the height at a known (x,y) coordinate
 	float getHeight(float x, float y);
 
+	// finds the heights at count (x,y) coordinates given as separate arrays
+	// uses AVX2 or SSE2 where the compiler allows, and matches getHeight()
+	void getHeightBatch(const float *xs, const float *ys, float *heights, long count);
+
+	// finds the first point where a ray meets the terrain's triangles
+	// origin and direction are scene (x, height, z); the ray is origin + t * direction
+	// for t from 0 to maxParameter, and on a hit t is returned in hitParameter
+	bool IntersectRay(const Cartesian3 &origin, const Cartesian3 &direction, float maxParameter, float &hitParameter) const;
+
+	// finds the first point where the segment from start to end meets the terrain
+	bool IntersectSegment(const Cartesian3 &start, const Cartesian3 &end, Cartesian3 &hitPoint) const;
+
+	// intersects count segments, spread over the thread pool
+	// hits[i] is set to 1, and hitPoints[i] filled in, where segment i meets the terrain
+	void IntersectSegments(const Cartesian3 *starts, const Cartesian3 *ends, Cartesian3 *hitPoints, unsigned char *hits, long count) const;
+
+	// true if no part of the terrain lies between two points
+	bool HasLineOfSight(const Cartesian3 &from, const Cartesian3 &to) const;
+
+	// caches the grid geometry used by the height queries
+	void UpdateQueryConstants();
+
+	// grid geometry cached by UpdateQueryConstants()
+	float inverseXYScale;
+	float columnOffset, rowOffset;
+	float maxColumn, maxRow;
+
 	int m_width = 0;
 	int m_height = 0;
 	
@@ -0,0 +1,538 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	TerrainQuadtree.cpp
+//	------------------------
+//
+//	Chunked level of detail for the terrain.  The
+//	grid is covered by a quadtree whose leaves are
+//	chunks of TERRAIN_CHUNK_CELLS cells on a side.
+//	Every node draws its area with the same number
+//	of cells, so a node one level up skips every
+//	other sample.  Each frame, nodes outside the
+//	view frustum are skipped, and the coarsest
+//	nodes whose error stays under a pixel tolerance
+//	on screen are drawn, split further wherever
+//	a neighbour is more than one level finer.  A
+//	node's edge next to a coarser neighbour drops
+//	every other sample, so that the two meet
+//	without cracks: its triangles are rewritten in
+//	place whenever its stitched edges change.  Each
+//	node's triangles are laid out in strips of
+//	columns narrow enough for the vertex cache to
+//	keep the row above.
+//
+///////////////////////////////////////////////////
+
+#include "TerrainQuadtree.h"
+#include "MeshOptimiser.h"
+#include <math.h>
+#include <algorithm>
+#ifdef __APPLE__
+#include <OpenGL/gl.h>
+#else
+#include <GL/gl.h>
+#endif
+
+// the width of the strips a node's cells are laid out in: a row of the strip loads this many
+// plus one vertices into the FIFO cache, and the row above must outlast a row and one more
+#define TERRAIN_STRIP_CELLS (MESH_OPTIMISER_CACHE_SIZE / 2 - 2)
+
+// constructor will initialise to an empty tree
+TerrainQuadtree::TerrainQuadtree()
+	:
+	indexBuffer(VertexBuffer::INDEX_DATA),
+	pixelTolerance(2.0f),
+	nodesDrawn(0),
+	nodesCulled(0),
+	trianglesDrawn(0),
+	width(0),
+	height(0),
+	chunksAcross(0),
+	chunksDown(0)
+	{ // constructor
+	} // constructor
+
+// builds the tree over a row-major grid of vertices, with heights in z
+void TerrainQuadtree::Build(const std::vector<Homogeneous4> &vertices, long Width, long Height)
+	{ // Build()
+	width = Width;
+	height = Height;
+	nodes.clear();
+	lodIndices.clear();
+	indexBuffer.Release();
+	if (width < 2 || height < 2)
+		return;
+
+	// the root is the smallest power-of-two multiple of a chunk that covers the grid
+	long span = TERRAIN_CHUNK_CELLS;
+	while (span < std::max(width - 1, height - 1))
+		span *= 2;
+
+	chunksAcross = (width - 2) / TERRAIN_CHUNK_CELLS + 1;
+	chunksDown = (height - 2) / TERRAIN_CHUNK_CELLS + 1;
+	BuildNode(vertices, 0, 0, span);
+	} // Build()
+
+// builds a node and its descendants, returns -1 if it lies off the grid
+int TerrainQuadtree::BuildNode(const std::vector<Homogeneous4> &vertices, long firstRow, long firstColumn, long span)
+	{ // BuildNode()
+	// quadrants past the last cell have nothing to draw
+	if (firstRow >= height - 1 || firstColumn >= width - 1)
+		return -1;
+
+	TerrainQuadtreeNode node;
+	node.firstRow = firstRow;
+	node.firstColumn = firstColumn;
+	node.span = span;
+	node.step = span / TERRAIN_CHUNK_CELLS;
+	node.geometricError = 0.0f;
+	for (int child = 0; child < 4; child++)
+		node.children[child] = -1;
+	node.firstIndex = lodIndices.size();
+
+	// the node's triangles, two to each coarse cell
+	node.stitches = 0;
+	node.indexCount = 6 * ((std::min(firstRow + span, height - 1) - firstRow + node.step - 1) / node.step)
+		* ((std::min(firstColumn + span, width - 1) - firstColumn + node.step - 1) / node.step);
+	lodIndices.resize(node.firstIndex + node.indexCount);
+	NodeTriangles(node, 0, &lodIndices[node.firstIndex]);
+
+	// the vector may grow while the children are built, so work by index
+	int nodeIndex = nodes.size();
+	nodes.push_back(node);
+
+	if (span == TERRAIN_CHUNK_CELLS)
+		{ // leaf
+		LeafBounds(vertices, nodes[nodeIndex]);
+		return nodeIndex;
+		} // leaf
+
+	// build the four quadrants, and take the bounds and error from them
+	long half = span / 2;
+	bool first = true;
+	for (int child = 0; child < 4; child++)
+		{ // per quadrant
+		int childIndex = BuildNode(vertices, firstRow + (child / 2) * half, firstColumn + (child % 2) * half, half);
+		nodes[nodeIndex].children[child] = childIndex;
+		if (childIndex < 0)
+			continue;
+		const TerrainQuadtreeNode &childNode = nodes[childIndex];
+		TerrainQuadtreeNode &parent = nodes[nodeIndex];
+		if (first)
+			{ // first quadrant sets the bounds
+			parent.minCorner = childNode.minCorner;
+			parent.maxCorner = childNode.maxCorner;
+			first = false;
+			} // first quadrant sets the bounds
+		for (int axis = 0; axis < 3; axis++)
+			{ // grow the bounds
+			parent.minCorner[axis] = std::min(parent.minCorner[axis], childNode.minCorner[axis]);
+			parent.maxCorner[axis] = std::max(parent.maxCorner[axis], childNode.maxCorner[axis]);
+			} // grow the bounds
+		parent.geometricError = std::max(parent.geometricError, childNode.geometricError);
+		} // per quadrant
+
+	// and the node's own error over its whole area
+	TerrainRegion area(firstRow, std::min(firstRow + span, height - 1), firstColumn, std::min(firstColumn + span, width - 1));
+	nodes[nodeIndex].geometricError = std::max(nodes[nodeIndex].geometricError, NodeError(vertices, nodes[nodeIndex], area));
+	return nodeIndex;
+	} // BuildNode()
+
+// writes a node's triangles, with the samples on its stitched edges moved onto the coarser neighbour's
+void TerrainQuadtree::NodeTriangles(const TerrainQuadtreeNode &node, int stitches, unsigned int *indices) const
+	{ // NodeTriangles()
+	std::vector<long> rows, columns;
+	NodeSamples(node.firstRow, node.span, node.step, height - 1, rows);
+	NodeSamples(node.firstColumn, node.span, node.step, width - 1, columns);
+
+	// a whole row of a chunk is too long for the vertex cache to keep the row above, so the
+	// cells go down narrow strips instead, which is as good as reordering for a regular grid;
+	// without the optimisation, the strip is the whole row
+	size_t stripCells = MeshOptimisationEnabled() ? TERRAIN_STRIP_CELLS : columns.size();
+	for (size_t stripStart = 0; stripStart + 1 < columns.size(); stripStart += stripCells)
+		{ // per strip
+		size_t stripEnd = std::min(stripStart + stripCells, columns.size() - 1);
+		for (size_t row = 0; row + 1 < rows.size(); row++)
+			for (size_t col = stripStart; col < stripEnd; col++)
+				{ // per coarse cell
+				unsigned int upperLeft = StitchedSample(node, stitches, rows[row], columns[col]);
+				unsigned int upperRight = StitchedSample(node, stitches, rows[row], columns[col + 1]);
+				unsigned int lowerLeft = StitchedSample(node, stitches, rows[row + 1], columns[col]);
+				unsigned int lowerRight = StitchedSample(node, stitches, rows[row + 1], columns[col + 1]);
+
+				// first triangle, split along the same diagonal as the full grid
+				*indices++ = upperLeft;
+				*indices++ = lowerRight;
+				*indices++ = upperRight;
+
+				// second triangle
+				*indices++ = upperLeft;
+				*indices++ = lowerLeft;
+				*indices++ = lowerRight;
+				} // per coarse cell
+		} // per strip
+	} // NodeTriangles()
+
+// the index of a sample of a node, moved back along a stitched edge if the coarser neighbour lacks it
+// the neighbour has every other sample, and the last on the grid; the sample slides onto the one
+// before, which it has, and the triangles between the two collapse, but stay in the buffer
+unsigned int TerrainQuadtree::StitchedSample(const TerrainQuadtreeNode &node, int stitches, long row, long col) const
+	{ // StitchedSample()
+	if (stitches != 0)
+		{ // stitched
+		long coarseStep = 2 * node.step;
+		bool onRow = (row == node.firstRow && (stitches & TERRAIN_EDGE_TOP))
+			|| (row == std::min(node.firstRow + node.span, height - 1) && (stitches & TERRAIN_EDGE_BOTTOM));
+		bool onColumn = (col == node.firstColumn && (stitches & TERRAIN_EDGE_LEFT))
+			|| (col == std::min(node.firstColumn + node.span, width - 1) && (stitches & TERRAIN_EDGE_RIGHT));
+		if (onRow && col % coarseStep != 0 && col != width - 1)
+			col -= node.step;
+		else if (onColumn && row % coarseStep != 0 && row != height - 1)
+			row -= node.step;
+		} // stitched
+	return row * width + col;
+	} // StitchedSample()
+
+// rewrites a node's triangles in the index buffer, and on the card once they are there
+void TerrainQuadtree::StitchNode(int nodeIndex, int stitches)
+	{ // StitchNode()
+	TerrainQuadtreeNode &node = nodes[nodeIndex];
+	node.stitches = stitches;
+	NodeTriangles(node, stitches, &lodIndices[node.firstIndex]);
+	if (indexBuffer.IsAllocated())
+		indexBuffer.Update(node.firstIndex * sizeof(unsigned int), node.indexCount * sizeof(unsigned int), &lodIndices[node.firstIndex]);
+	} // StitchNode()
+
+// the samples a node draws in one direction: every step-th, plus the last
+void TerrainQuadtree::NodeSamples(long first, long span, long step, long lastSample, std::vector<long> &samples) const
+	{ // NodeSamples()
+	samples.clear();
+	long last = std::min(first + span, lastSample);
+	for (long sample = first; sample < last; sample += step)
+		samples.push_back(sample);
+	samples.push_back(last);
+	} // NodeSamples()
+
+// largest error of a node's coarse cells that touch a block of samples
+// each fine sample in those cells is compared with the coarse triangle above it
+float TerrainQuadtree::NodeError(const std::vector<Homogeneous4> &vertices, const TerrainQuadtreeNode &node, const TerrainRegion &samples) const
+	{ // NodeError()
+	// the full resolution chunks match the grid exactly
+	if (node.step == 1)
+		return 0.0f;
+
+	std::vector<long> rows, columns;
+	NodeSamples(node.firstRow, node.span, node.step, height - 1, rows);
+	NodeSamples(node.firstColumn, node.span, node.step, width - 1, columns);
+
+	float error = 0.0f;
+	for (size_t row = 0; row + 1 < rows.size(); row++)
+		{ // per row of coarse cells
+		long top = rows[row], bottom = rows[row + 1];
+		if (bottom < samples.firstRow || top > samples.lastRow)
+			continue;
+		for (size_t col = 0; col + 1 < columns.size(); col++)
+			{ // per coarse cell
+			long left = columns[col], right = columns[col + 1];
+			if (right < samples.firstColumn || left > samples.lastColumn)
+				continue;
+
+			float upperLeft = vertices[top * width + left].z;
+			float upperRight = vertices[top * width + right].z;
+			float lowerLeft = vertices[bottom * width + left].z;
+			float lowerRight = vertices[bottom * width + right].z;
+			for (long fineRow = top; fineRow <= bottom; fineRow++)
+				for (long fineColumn = left; fineColumn <= right; fineColumn++)
+					{ // per fine sample
+					// position in the coarse cell
+					float fx = (float) (fineColumn - left) / (right - left);
+					float fy = (float) (fineRow - top) / (bottom - top);
+					// interpolate in whichever triangle holds the sample
+					float coarse = (fx < fy)
+						? upperLeft * (1.0f - fy) + lowerLeft * (fy - fx) + lowerRight * fx
+						: upperLeft * (1.0f - fx) + upperRight * (fx - fy) + lowerRight * fy;
+					error = std::max(error, (float) fabs(vertices[fineRow * width + fineColumn].z - coarse));
+					} // per fine sample
+			} // per coarse cell
+		} // per row of coarse cells
+	return error;
+	} // NodeError()
+
+// recomputes the bounding box of a leaf from the vertices
+void TerrainQuadtree::LeafBounds(const std::vector<Homogeneous4> &vertices, TerrainQuadtreeNode &node) const
+	{ // LeafBounds()
+	long lastRow = std::min(node.firstRow + node.span, height - 1);
+	long lastColumn = std::min(node.firstColumn + node.span, width - 1);
+
+	// x and y come from the corners, z from every sample
+	const Homogeneous4 &upperLeft = vertices[node.firstRow * width + node.firstColumn];
+	const Homogeneous4 &lowerRight = vertices[lastRow * width + lastColumn];
+	node.minCorner = Cartesian3(std::min(upperLeft.x, lowerRight.x), std::min(upperLeft.y, lowerRight.y), upperLeft.z);
+	node.maxCorner = Cartesian3(std::max(upperLeft.x, lowerRight.x), std::max(upperLeft.y, lowerRight.y), upperLeft.z);
+	for (long row = node.firstRow; row <= lastRow; row++)
+		for (long col = node.firstColumn; col <= lastColumn; col++)
+			{ // per sample
+			float z = vertices[row * width + col].z;
+			node.minCorner.z = std::min(node.minCorner.z, z);
+			node.maxCorner.z = std::max(node.maxCorner.z, z);
+			} // per sample
+	} // LeafBounds()
+
+// updates bounds and errors after the heights of a block of samples changed
+void TerrainQuadtree::Refresh(const std::vector<Homogeneous4> &vertices, const TerrainRegion &samples)
+	{ // Refresh()
+	if (!nodes.empty())
+		RefreshNode(0, vertices, samples);
+	} // Refresh()
+
+// walks the tree for Refresh()
+// leaf bounds are recomputed exactly; a coarser node's error is only ever raised,
+// by the worst of its coarse cells that the edit touched
+void TerrainQuadtree::RefreshNode(int nodeIndex, const std::vector<Homogeneous4> &vertices, const TerrainRegion &samples)
+	{ // RefreshNode()
+	TerrainQuadtreeNode &node = nodes[nodeIndex];
+	TerrainRegion area(node.firstRow, std::min(node.firstRow + node.span, height - 1), node.firstColumn, std::min(node.firstColumn + node.span, width - 1));
+	if (!area.Overlaps(samples))
+		return;
+
+	if (node.children[0] < 0 && node.children[1] < 0 && node.children[2] < 0 && node.children[3] < 0)
+		{ // leaf
+		LeafBounds(vertices, node);
+		return;
+		} // leaf
+
+	bool first = true;
+	for (int child = 0; child < 4; child++)
+		{ // per quadrant
+		if (node.children[child] < 0)
+			continue;
+		RefreshNode(node.children[child], vertices, samples);
+		const TerrainQuadtreeNode &childNode = nodes[node.children[child]];
+		if (first)
+			{ // first quadrant sets the bounds
+			node.minCorner = childNode.minCorner;
+			node.maxCorner = childNode.maxCorner;
+			first = false;
+			} // first quadrant sets the bounds
+		for (int axis = 0; axis < 3; axis++)
+			{ // grow the bounds
+			node.minCorner[axis] = std::min(node.minCorner[axis], childNode.minCorner[axis]);
+			node.maxCorner[axis] = std::max(node.maxCorner[axis], childNode.maxCorner[axis]);
+			} // grow the bounds
+		node.geometricError = std::max(node.geometricError, childNode.geometricError);
+		} // per quadrant
+	node.geometricError = std::max(node.geometricError, NodeError(vertices, node, samples));
+	} // RefreshNode()
+
+// chooses the nodes to draw for a view, no more than one level apart where they meet,
+// and the edges of each that meet a coarser node, as TERRAIN_EDGE_ bits
+// errorScale converts an error at unit distance to pixels
+void TerrainQuadtree::Select(const columnMajorMatrix &modelViewMatrix, const Frustum &frustum, float errorScale, std::vector<int> &selected, std::vector<int> &stitches)
+	{ // Select()
+	selected.clear();
+	stitches.clear();
+	nodesCulled = 0;
+	if (nodes.empty())
+		return;
+	SelectNode(0, modelViewMatrix, frustum, errorScale, selected);
+
+	// an edge can only be stitched to a node one level coarser, which skips every other
+	// sample; a node coarser still is split into its quadrants, which may in turn be
+	// more than a level coarser than their other neighbours, so repeat until none is
+	splitting.assign(nodes.size(), false);
+	for (bool split = true; split; )
+		{ // until nothing is split
+		MarkDrawnChunks(selected);
+		split = false;
+		for (int nodeIndex : selected)
+			for (int edge = TERRAIN_EDGE_TOP; edge <= TERRAIN_EDGE_RIGHT; edge *= 2)
+				{ // per edge
+				int neighbour = DrawnNeighbour(nodes[nodeIndex], edge);
+				if (neighbour >= 0 && nodes[neighbour].step > 2 * nodes[nodeIndex].step)
+					split = splitting[neighbour] = true;
+				} // per edge
+		if (!split)
+			break;
+
+		// the quadrants replace the node, except those out of view
+		size_t kept = selected.size();
+		for (size_t index = 0; index < kept; index++)
+			{ // per selected node
+			int nodeIndex = selected[index];
+			if (!splitting[nodeIndex])
+				continue;
+			splitting[nodeIndex] = false;
+			selected[index] = -1;
+			for (int child = 0; child < 4; child++)
+				{ // per quadrant
+				int childIndex = nodes[nodeIndex].children[child];
+				if (childIndex < 0)
+					continue;
+				if (frustum.IntersectsBox(nodes[childIndex].minCorner, nodes[childIndex].maxCorner))
+					selected.push_back(childIndex);
+				else
+					nodesCulled++;
+				} // per quadrant
+			} // per selected node
+
+		// nodes are stored in the order they are selected, which keeps runs of them together in the buffer
+		selected.erase(std::remove(selected.begin(), selected.end(), -1), selected.end());
+		std::sort(selected.begin(), selected.end());
+		} // until nothing is split
+
+	// the neighbours left coarser are exactly one level up
+	for (int nodeIndex : selected)
+		{ // per selected node
+		int edges = 0;
+		for (int edge = TERRAIN_EDGE_TOP; edge <= TERRAIN_EDGE_RIGHT; edge *= 2)
+			{ // per edge
+			int neighbour = DrawnNeighbour(nodes[nodeIndex], edge);
+			if (neighbour >= 0 && nodes[neighbour].step > nodes[nodeIndex].step)
+				edges |= edge;
+			} // per edge
+		stitches.push_back(edges);
+		} // per selected node
+	} // Select()
+
+// records which selected node covers each leaf chunk
+void TerrainQuadtree::MarkDrawnChunks(const std::vector<int> &selected)
+	{ // MarkDrawnChunks()
+	drawnNodes.assign(chunksAcross * chunksDown, -1);
+	for (int nodeIndex : selected)
+		{ // per selected node
+		const TerrainQuadtreeNode &node = nodes[nodeIndex];
+		long firstChunkRow = node.firstRow / TERRAIN_CHUNK_CELLS, firstChunkColumn = node.firstColumn / TERRAIN_CHUNK_CELLS;
+		long endChunkRow = std::min(firstChunkRow + node.span / TERRAIN_CHUNK_CELLS, chunksDown);
+		long endChunkColumn = std::min(firstChunkColumn + node.span / TERRAIN_CHUNK_CELLS, chunksAcross);
+		for (long chunkRow = firstChunkRow; chunkRow < endChunkRow; chunkRow++)
+			for (long chunkColumn = firstChunkColumn; chunkColumn < endChunkColumn; chunkColumn++)
+				drawnNodes[chunkRow * chunksAcross + chunkColumn] = nodeIndex;
+		} // per selected node
+	} // MarkDrawnChunks()
+
+// the selected node across one edge of a node, or -1 if none is drawn there
+// a coarser neighbour covers the whole edge, so the chunk across from the first is enough to find it
+int TerrainQuadtree::DrawnNeighbour(const TerrainQuadtreeNode &node, int edge) const
+	{ // DrawnNeighbour()
+	long chunkRow = node.firstRow / TERRAIN_CHUNK_CELLS, chunkColumn = node.firstColumn / TERRAIN_CHUNK_CELLS;
+	long chunks = node.span / TERRAIN_CHUNK_CELLS;
+	if (edge == TERRAIN_EDGE_TOP)
+		chunkRow--;
+	else if (edge == TERRAIN_EDGE_BOTTOM)
+		chunkRow += chunks;
+	else if (edge == TERRAIN_EDGE_LEFT)
+		chunkColumn--;
+	else
+		chunkColumn += chunks;
+	if (chunkRow < 0 || chunkRow >= chunksDown || chunkColumn < 0 || chunkColumn >= chunksAcross)
+		return -1;
+	return drawnNodes[chunkRow * chunksAcross + chunkColumn];
+	} // DrawnNeighbour()
+
+// walks the tree for Select()
+void TerrainQuadtree::SelectNode(int nodeIndex, const columnMajorMatrix &modelViewMatrix, const Frustum &frustum, float errorScale, std::vector<int> &selected)
+	{ // SelectNode()
+	const TerrainQuadtreeNode &node = nodes[nodeIndex];
+
+	// nothing in this node can be seen
+	if (!frustum.IntersectsBox(node.minCorner, node.maxCorner))
+		{ // culled
+		nodesCulled++;
+		return;
+		} // culled
+
+	// distance from the eye to the nearest point the box could have
+	Cartesian3 centre = (node.minCorner + node.maxCorner) * 0.5f;
+	float halfDiagonal = (node.maxCorner - node.minCorner).length() * 0.5f;
+	Homogeneous4 eyeCentre = modelViewMatrix * Homogeneous4(centre);
+	float distance = std::max(eyeCentre.Vector().length() - halfDiagonal, 1.0f);
+
+	// draw this node if its error is small enough on screen, or it is a leaf
+	bool leaf = node.children[0] < 0 && node.children[1] < 0 && node.children[2] < 0 && node.children[3] < 0;
+	if (leaf || node.geometricError * errorScale / distance <= pixelTolerance)
+		{ // draw it
+		selected.push_back(nodeIndex);
+		return;
+		} // draw it
+
+	// otherwise the quadrants need more detail
+	for (int child = 0; child < 4; child++)
+		if (node.children[child] >= 0)
+			SelectNode(node.children[child], modelViewMatrix, frustum, errorScale, selected);
+	} // SelectNode()
+
+// renders the nodes chosen for a view
+void TerrainQuadtree::Render(const std::vector<Homogeneous4> &vertices, columnMajorMatrix &modelViewMatrix, const columnMajorMatrix &projectionMatrix, float errorScale)
+	{ // Render()
+	// the frustum in the terrain's own coordinates
+	Frustum frustum = Frustum::FromMatrix(projectionMatrix * modelViewMatrix);
+	Select(modelViewMatrix, frustum, errorScale, selectedNodes, selectedStitches);
+
+	nodesDrawn = selectedNodes.size();
+	trianglesDrawn = 0;
+
+	// walk through the faces rendering each one
+	glBegin(GL_TRIANGLES);
+	for (size_t selected = 0; selected < selectedNodes.size(); selected++)
+		{ // per node
+		if (nodes[selectedNodes[selected]].stitches != selectedStitches[selected])
+			StitchNode(selectedNodes[selected], selectedStitches[selected]);
+		const TerrainQuadtreeNode &node = nodes[selectedNodes[selected]];
+		for (unsigned int index = node.firstIndex; index < node.firstIndex + node.indexCount; index += 3)
+			{ // per triangle
+			// triangles collapsed by stitching have no area, and no normal
+			if (lodIndices[index] == lodIndices[index + 1] || lodIndices[index + 1] == lodIndices[index + 2] || lodIndices[index + 2] == lodIndices[index])
+				continue;
+			const Homogeneous4 &p = vertices[lodIndices[index]];
+			const Homogeneous4 &q = vertices[lodIndices[index + 1]];
+			const Homogeneous4 &r = vertices[lodIndices[index + 2]];
+
+			// coarse triangles have no stored normal, so compute it here
+			Cartesian3 normal = (q.Point() - p.Point()).cross(r.Point() - p.Point()).unit();
+			Homogeneous4 viewNormal = modelViewMatrix * Homogeneous4(normal.x, normal.y, normal.z, 0.0);
+			Homogeneous4 vertexP = modelViewMatrix * p;
+			Homogeneous4 vertexQ = modelViewMatrix * q;
+			Homogeneous4 vertexR = modelViewMatrix * r;
+
+			glNormal3fv(&viewNormal.x);
+			glVertex4fv(&vertexP.x);
+			glVertex4fv(&vertexQ.x);
+			glVertex4fv(&vertexR.x);
+			} // per triangle
+		trianglesDrawn += node.indexCount / 3;
+		} // per node
+	glEnd();
+	} // Render()
+
+// renders the nodes chosen for a view from the index buffer
+// nodes are stored parent first and then each quadrant in turn, so chosen nodes
+// that sit next to each other in the buffer are drawn with a single call
+void TerrainQuadtree::RenderBuffers(const columnMajorMatrix &modelViewMatrix, const columnMajorMatrix &projectionMatrix, float errorScale)
+	{ // RenderBuffers()
+	Frustum frustum = Frustum::FromMatrix(projectionMatrix * modelViewMatrix);
+	Select(modelViewMatrix, frustum, errorScale, selectedNodes, selectedStitches);
+
+	nodesDrawn = selectedNodes.size();
+	trianglesDrawn = 0;
+
+	if (!indexBuffer.IsAllocated())
+		indexBuffer.Allocate(lodIndices.size() * sizeof(unsigned int), lodIndices.data());
+	// nodes whose neighbours changed level are rewritten before the buffer is bound for drawing
+	for (size_t selected = 0; selected < selectedNodes.size(); selected++)
+		if (nodes[selectedNodes[selected]].stitches != selectedStitches[selected])
+			StitchNode(selectedNodes[selected], selectedStitches[selected]);
+
+	indexBuffer.Bind();
+	for (size_t selected = 0; selected < selectedNodes.size(); )
+		{ // per run of nodes
+		unsigned int firstIndex = nodes[selectedNodes[selected]].firstIndex;
+		unsigned int indexCount = nodes[selectedNodes[selected]].indexCount;
+		for (selected++; selected < selectedNodes.size() && nodes[selectedNodes[selected]].firstIndex == firstIndex + indexCount; selected++)
+			indexCount += nodes[selectedNodes[selected]].indexCount;
+
+		glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, (const void *) (firstIndex * sizeof(unsigned int)));
+		trianglesDrawn += indexCount / 3;
+		} // per run of nodes
+	indexBuffer.Unbind();
+	} // RenderBuffers()
@@ -0,0 +1,152 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	TerrainQuadtree.h
+//	------------------------
+//
+//	Chunked level of detail for the terrain.  The
+//	grid is covered by a quadtree whose leaves are
+//	chunks of TERRAIN_CHUNK_CELLS cells on a side.
+//	Every node draws its area with the same number
+//	of cells, so a node one level up skips every
+//	other sample.  Each frame, nodes outside the
+//	view frustum are skipped, and the coarsest
+//	nodes whose error stays under a pixel tolerance
+//	on screen are drawn, split further wherever
+//	a neighbour is more than one level finer.  A
+//	node's edge next to a coarser neighbour drops
+//	every other sample, so that the two meet
+//	without cracks: its triangles are rewritten in
+//	place whenever its stitched edges change.
+//
+///////////////////////////////////////////////////
+
+#ifndef _TERRAIN_QUADTREE_H
+#define _TERRAIN_QUADTREE_H
+
+#include <vector>
+
+#include "Cartesian3.h"
+#include "Homogeneous4.h"
+#include "Matrix4.h"
+#include "Frustum.h"
+#include "Heightfield.h"
+#include "VertexBuffer.h"
+
+// size of a leaf chunk, in cells along each side
+#define TERRAIN_CHUNK_CELLS 64
+
+// the edges of a node, as bits of the stitches chosen by Select()
+#define TERRAIN_EDGE_TOP 1
+#define TERRAIN_EDGE_BOTTOM 2
+#define TERRAIN_EDGE_LEFT 4
+#define TERRAIN_EDGE_RIGHT 8
+
+// one square of the quadtree
+struct TerrainQuadtreeNode
+	{ // struct TerrainQuadtreeNode
+	// the upper left sample of the node
+	long firstRow, firstColumn;
+	// the cells covered along each side, and the spacing of the samples drawn
+	long span, step;
+	// bounding box of the node, in the terrain's own coordinates
+	Cartesian3 minCorner, maxCorner;
+	// largest height difference between this node's triangles and the full grid
+	float geometricError;
+	// the four quadrants, or -1 where a quadrant lies off the grid
+	int children[4];
+	// this node's triangles, as a range of the quadtree's index buffer
+	unsigned int firstIndex, indexCount;
+	// the edges whose samples are moved onto a coarser neighbour's in the index buffer, as TERRAIN_EDGE_ bits
+	int stitches;
+	}; // struct TerrainQuadtreeNode
+
+class TerrainQuadtree
+	{ // class TerrainQuadtree
+	public:
+	// the nodes, with the root first
+	std::vector<TerrainQuadtreeNode> nodes;
+
+	// triangles of all the nodes, at their own level of detail
+	std::vector<unsigned int> lodIndices;
+
+	// the same triangles on the card, uploaded by the first RenderBuffers()
+	// edits only move the vertices, so only a node's stitched edges change them after Build()
+	VertexBuffer indexBuffer;
+
+	// largest error allowed on screen, in pixels
+	float pixelTolerance;
+
+	// counts from the last call to Render()
+	long nodesDrawn, nodesCulled, trianglesDrawn;
+
+	// constructor will initialise to an empty tree
+	TerrainQuadtree();
+
+	// builds the tree over a row-major grid of vertices, with heights in z
+	void Build(const std::vector<Homogeneous4> &vertices, long Width, long Height);
+
+	// updates bounds and errors after the heights of a block of samples changed
+	void Refresh(const std::vector<Homogeneous4> &vertices, const TerrainRegion &samples);
+
+	// chooses the nodes to draw for a view, no more than one level apart where they meet,
+	// and the edges of each that meet a coarser node, as TERRAIN_EDGE_ bits
+	// errorScale converts an error at unit distance to pixels
+	void Select(const columnMajorMatrix &modelViewMatrix, const Frustum &frustum, float errorScale, std::vector<int> &selected, std::vector<int> &stitches);
+
+	// renders the nodes chosen for a view
+	void Render(const std::vector<Homogeneous4> &vertices, columnMajorMatrix &modelViewMatrix, const columnMajorMatrix &projectionMatrix, float errorScale);
+
+	// renders the nodes chosen for a view from the index buffer
+	// the caller sets up the vertex and normal arrays, and the modelview matrix
+	void RenderBuffers(const columnMajorMatrix &modelViewMatrix, const columnMajorMatrix &projectionMatrix, float errorScale);
+
+	private:
+	// builds a node and its descendants, returns -1 if it lies off the grid
+	int BuildNode(const std::vector<Homogeneous4> &vertices, long firstRow, long firstColumn, long span);
+
+	// writes a node's triangles, with the samples on its stitched edges moved onto the coarser neighbour's
+	void NodeTriangles(const TerrainQuadtreeNode &node, int stitches, unsigned int *indices) const;
+
+	// the index of a sample of a node, moved back along a stitched edge if the coarser neighbour lacks it
+	unsigned int StitchedSample(const TerrainQuadtreeNode &node, int stitches, long row, long col) const;
+
+	// rewrites a node's triangles in the index buffer, and on the card once they are there
+	void StitchNode(int nodeIndex, int stitches);
+
+	// the samples a node draws in one direction: every step-th, plus the last
+	void NodeSamples(long first, long span, long step, long lastSample, std::vector<long> &samples) const;
+
+	// largest error of a node's coarse cells that touch a block of samples
+	float NodeError(const std::vector<Homogeneous4> &vertices, const TerrainQuadtreeNode &node, const TerrainRegion &samples) const;
+
+	// recomputes the bounding box of a leaf from the vertices
+	void LeafBounds(const std::vector<Homogeneous4> &vertices, TerrainQuadtreeNode &node) const;
+
+	// walks the tree for Select()
+	void SelectNode(int nodeIndex, const columnMajorMatrix &modelViewMatrix, const Frustum &frustum, float errorScale, std::vector<int> &selected);
+
+	// records which selected node covers each leaf chunk
+	void MarkDrawnChunks(const std::vector<int> &selected);
+
+	// the selected node across one edge of a node, or -1 if none is drawn there
+	int DrawnNeighbour(const TerrainQuadtreeNode &node, int edge) const;
+
+	// walks the tree for Refresh()
+	void RefreshNode(int nodeIndex, const std::vector<Homogeneous4> &vertices, const TerrainRegion &samples);
+
+	// size of the grid
+	long width, height;
+
+	// leaf chunks across and down the grid
+	long chunksAcross, chunksDown;
+
+	// scratch lists of the nodes chosen each frame, and their stitched edges
+	std::vector<int> selectedNodes, selectedStitches;
+	// the selected node over each leaf chunk, or -1
+	std::vector<int> drawnNodes;
+	// whether each node is to be split into its quadrants
+	std::vector<bool> splitting;
+	}; // class TerrainQuadtree
+
+#endif
@@ -0,0 +1,522 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	TerrainStreamer.cpp
+//	------------------------
+//
+//	Out-of-core terrain.  The world is cut into
+//	square tiles stored on disk as binary
+//	heightfields, and only the tiles near the
+//	player are kept in memory.  A background thread
+//	loads tiles around and ahead of the player and
+//	builds their meshes; the simulation only picks
+//	up finished tiles and never waits for the disk.
+//	Tiles over a byte budget are evicted, least
+//	recently used first, and the craters made in
+//	each tile are kept so that they are made again
+//	when it is next loaded.  The streamer belongs
+//	to the simulation, which hands each step's tiles
+//	and their edits to the renderer in a snapshot.
+//
+//	Tiles are tileSize cells on a side, so they hold
+//	tileSize + 1 samples and neighbours share their
+//	edge samples.  Samples past the end of the world
+//	repeat the last row or column.
+//
+///////////////////////////////////////////////////
+
+#include "TerrainStreamer.h"
+#include "HeightfieldFile.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <math.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// the path of one tile in a tile directory
+std::string TerrainStreamer::TilePath(const std::string &directory, long tileRow, long tileColumn)
+	{ // TilePath()
+	return directory + "/tile_" + std::to_string(tileRow) + "_" + std::to_string(tileColumn) + ".hfb";
+	} // TilePath()
+
+// estimate of the memory a loaded tile holds
+static size_t TileBytes(const Terrain &terrain)
+	{ // TileBytes()
+	return	terrain.vertices.capacity() * sizeof(Homogeneous4)
+		+	terrain.normals.capacity() * sizeof(Homogeneous4)
+		+	terrain.indices.capacity() * sizeof(unsigned int)
+		+	terrain.quadtree.lodIndices.capacity() * sizeof(unsigned int)
+		+	terrain.quadtree.nodes.capacity() * sizeof(TerrainQuadtreeNode)
+		+	(size_t) terrain.m_width * terrain.m_height * sizeof(float);
+	} // TileBytes()
+
+// constructor will initialise to a closed streamer
+TerrainStreamer::TerrainStreamer()
+	:
+	residentRadius(1),
+	lookAheadTiles(3),
+	byteBudget(256 << 20),
+	fallbackHeight(0.0f),
+	tilesLoaded(0),
+	tilesEvicted(0),
+	heightMisses(0),
+	residentBytes(0),
+	worldWidth(0),
+	worldHeight(0),
+	tileSize(0),
+	tilesX(0),
+	tilesY(0),
+	xyScale(1.0f),
+	originRow(0),
+	originColumn(0),
+	frame(0),
+	loadingTile(-1),
+	stopping(false)
+	{ // constructor
+	} // constructor
+
+// destructor stops the loading thread
+TerrainStreamer::~TerrainStreamer()
+	{ // destructor
+	Close();
+	} // destructor
+
+// reads the manifest of a tile directory and starts the loading thread
+// returns true on success, false otherwise
+bool TerrainStreamer::Open(const char *Directory)
+	{ // Open()
+	Close();
+
+	// the manifest gives the size of the whole world and of the tiles
+	std::ifstream manifest(std::string(Directory) + "/" + TERRAIN_TILE_MANIFEST);
+	std::string magic, kind;
+	int version = 0;
+	long width = 0, height = 0, cells = 0;
+	float scale = 0.0f;
+	if (!(manifest >> magic >> kind >> version >> width >> height >> scale >> cells)
+		|| magic != HEIGHTFIELD_FILE_MAGIC || kind != "tiles" || version != 1
+		|| width < 2 || height < 2 || scale <= 0.0f || cells < 2 || cells % 2 != 0)
+		return false;
+
+	directory = Directory;
+	worldWidth = width;
+	worldHeight = height;
+	xyScale = scale;
+	tileSize = cells;
+	tilesX = std::max(1L, (worldWidth - 1 + tileSize - 1) / tileSize);
+	tilesY = std::max(1L, (worldHeight - 1 + tileSize - 1) / tileSize);
+	// the scene origin is where it would be if the world were one Terrain
+	originColumn = worldWidth / 2;
+	originRow = worldHeight / 2;
+
+	tilesLoaded = tilesEvicted = heightMisses = 0;
+	residentBytes = 0;
+	frame = 0;
+	stopping = false;
+	loadingTile = -1;
+	loader = std::thread(&TerrainStreamer::LoadTiles, this);
+	return true;
+	} // Open()
+
+// stops the loading thread and releases all tiles
+void TerrainStreamer::Close()
+	{ // Close()
+	if (loader.joinable())
+		{ // stop the loading thread
+			{ // tell it to stop
+			std::lock_guard<std::mutex> lock(queueMutex);
+			stopping = true;
+			requestedTiles.clear();
+			} // tell it to stop
+		queueCondition.notify_all();
+		loader.join();
+		} // stop the loading thread
+
+	finishedTiles.clear();
+	resident.clear();
+	tileCraters.clear();
+	missingTiles.clear();
+	wantedTiles.clear();
+	residentBytes = 0;
+	tileSize = 0;
+	} // Close()
+
+// true if a scene (x, z) position lies over the streamed world
+bool TerrainStreamer::Contains(float x, float z) const
+	{ // Contains()
+	if (!IsOpen())
+		return false;
+	float u = x / xyScale + originColumn;
+	float v = originRow - z / xyScale;
+	return u >= 0.0f && u <= worldWidth - 1 && v >= 0.0f && v <= worldHeight - 1;
+	} // Contains()
+
+// the key of the tile under a scene (x, z) position, clamped to the world
+long TerrainStreamer::TileAt(float x, float z) const
+	{ // TileAt()
+	float u = x / xyScale + originColumn;
+	float v = originRow - z / xyScale;
+	long tileColumn = std::min(std::max((long) floor(u / tileSize), 0L), tilesX - 1);
+	long tileRow = std::min(std::max((long) floor(v / tileSize), 0L), tilesY - 1);
+	return TileKey(tileRow, tileColumn);
+	} // TileAt()
+
+// the scene (x, z) position of the centre of a tile's mesh
+// a tile's mesh is centred on its middle sample, as Terrain does for the whole grid
+void TerrainStreamer::TileCentre(long key, float &x, float &z) const
+	{ // TileCentre()
+	long tileRow = key / tilesX, tileColumn = key % tilesX;
+	x = xyScale * (tileColumn * tileSize + tileSize / 2 - originColumn);
+	z = xyScale * (originRow - tileRow * tileSize - tileSize / 2);
+	} // TileCentre()
+
+// reads a tile and builds its mesh: safe to call from any thread
+// returns NULL if the tile could not be read
+std::unique_ptr<Terrain> TerrainStreamer::LoadTile(long key) const
+	{ // LoadTile()
+	std::unique_ptr<Terrain> terrain(new Terrain);
+	if (!terrain->ReadFileTerrainData(TilePath(directory, key / tilesX, key % tilesX).c_str(), xyScale))
+		return std::unique_ptr<Terrain>();
+	return terrain;
+	} // LoadTile()
+
+// takes ownership of a loaded tile on the simulation's thread
+// the tile is read as it was written, so any craters made in it before are made again;
+// they go to the renderer as patches, like any other edit
+void TerrainStreamer::AdoptTile(long key, std::unique_ptr<Terrain> terrain)
+	{ // AdoptTile()
+	// a tile that failed to load is not asked for again
+	if (!terrain)
+		{ // missing
+		missingTiles.insert(key);
+		return;
+		} // missing
+	if (resident.count(key))
+		return;
+
+	auto craters = tileCraters.find(key);
+	if (craters != tileCraters.end())
+		for (const TileCrater &crater : craters->second)
+			EditTile(key, *terrain, crater);
+
+	ResidentTile &tile = resident[key];
+	tile.bytes = TileBytes(*terrain);
+	tile.terrain = std::move(terrain);
+	tile.lastUsed = frame;
+	residentBytes += tile.bytes;
+	tilesLoaded++;
+	} // AdoptTile()
+
+// applies a crater to one loaded tile, in the tile's own coordinates
+void TerrainStreamer::EditTile(long key, Terrain &terrain, const TileCrater &crater) const
+	{ // EditTile()
+	float centreX, centreZ;
+	TileCentre(key, centreX, centreZ);
+	terrain.EditMesh(Cartesian3(crater.hitpoint.x - centreX, crater.hitpoint.y, crater.hitpoint.z - centreZ), crater.radius, columnMajorMatrix());
+	} // EditTile()
+
+// evicts least recently used tiles until under the budget
+// tiles wanted this frame are never evicted, so the budget may be exceeded
+// if it is too small for them
+void TerrainStreamer::EvictTiles()
+	{ // EvictTiles()
+	while (residentBytes > byteBudget)
+		{ // over budget
+		auto oldest = resident.end();
+		for (auto tile = resident.begin(); tile != resident.end(); ++tile)
+			if (tile->second.lastUsed < frame && (oldest == resident.end() || tile->second.lastUsed < oldest->second.lastUsed))
+				oldest = tile;
+		if (oldest == resident.end())
+			break;
+		residentBytes -= oldest->second.bytes;
+		resident.erase(oldest);
+		tilesEvicted++;
+		} // over budget
+	} // EvictTiles()
+
+// adds a tile to the wanted list once
+void TerrainStreamer::WantTile(long key)
+	{ // WantTile()
+	if (std::find(wantedTiles.begin(), wantedTiles.end(), key) == wantedTiles.end())
+		wantedTiles.push_back(key);
+	} // WantTile()
+
+// loads the tile under a position on the calling thread, for start-up
+void TerrainStreamer::Prime(const Cartesian3 &position)
+	{ // Prime()
+	if (!IsOpen())
+		return;
+	long key = TileAt(position.x, position.z);
+	if (!resident.count(key) && !missingTiles.count(key))
+		AdoptTile(key, LoadTile(key));
+	} // Prime()
+
+// called once a step from the simulation's thread
+// the queue lock is only tried, never waited for: if the loading thread
+// holds it, finished tiles are picked up and requests made next frame
+void TerrainStreamer::Update(const Cartesian3 &position, const Cartesian3 &heading)
+	{ // Update()
+	if (!IsOpen())
+		return;
+	frame++;
+
+	// the tiles around the player, nearest first
+	wantedTiles.clear();
+	long centre = TileAt(position.x, position.z);
+	long centreRow = centre / tilesX, centreColumn = centre % tilesX;
+	for (long ring = 0; ring <= residentRadius; ring++)
+		for (long row = centreRow - ring; row <= centreRow + ring; row++)
+			for (long col = centreColumn - ring; col <= centreColumn + ring; col++)
+				if (std::max(labs(row - centreRow), labs(col - centreColumn)) == ring
+					&& row >= 0 && row < tilesY && col >= 0 && col < tilesX)
+					WantTile(TileKey(row, col));
+
+	// and the tiles along the heading, over the ground
+	float headingLength = sqrt(heading.x * heading.x + heading.z * heading.z);
+	if (headingLength > 0.0f)
+		for (long step = 1; step <= lookAheadTiles; step++)
+			{ // per step ahead
+			float distance = step * tileSize * xyScale / headingLength;
+			float x = position.x + heading.x * distance;
+			float z = position.z + heading.z * distance;
+			if (Contains(x, z))
+				WantTile(TileAt(x, z));
+			} // per step ahead
+
+	// wanted tiles that are loaded count as used this frame
+	for (long key : wantedTiles)
+		{ // per wanted tile
+		auto tile = resident.find(key);
+		if (tile != resident.end())
+			tile->second.lastUsed = frame;
+		} // per wanted tile
+
+	std::unique_lock<std::mutex> lock(queueMutex, std::try_to_lock);
+	if (lock.owns_lock())
+		{ // exchange with the loading thread
+		for (auto &finished : finishedTiles)
+			AdoptTile(finished.first, std::move(finished.second));
+		finishedTiles.clear();
+
+		// the request queue is replaced, so tiles we have flown away from are dropped
+		requestedTiles.clear();
+		for (long key : wantedTiles)
+			if (key != loadingTile && !resident.count(key) && !missingTiles.count(key))
+				requestedTiles.push_back(key);
+		bool requested = !requestedTiles.empty();
+		lock.unlock();
+		if (requested)
+			queueCondition.notify_one();
+		} // exchange with the loading thread
+
+	EvictTiles();
+	} // Update()
+
+// the loading thread: reads requested tiles and builds their meshes
+// the lock is released while the disk is read
+void TerrainStreamer::LoadTiles()
+	{ // LoadTiles()
+	std::unique_lock<std::mutex> lock(queueMutex);
+	while (true)
+		{ // per request
+		queueCondition.wait(lock, [this] { return stopping || !requestedTiles.empty(); });
+		if (stopping)
+			return;
+		loadingTile = requestedTiles.front();
+		requestedTiles.pop_front();
+
+		lock.unlock();
+		std::unique_ptr<Terrain> terrain = LoadTile(loadingTile);
+		lock.lock();
+
+		finishedTiles.emplace_back(loadingTile, std::move(terrain));
+		loadingTile = -1;
+		} // per request
+	} // LoadTiles()
+
+// the height at a scene (x, z) position, or fallbackHeight if its tile is not loaded
+float TerrainStreamer::getHeight(float x, float z)
+	{ // getHeight()
+	if (!IsOpen())
+		return fallbackHeight;
+	long key = TileAt(x, z);
+	auto tile = resident.find(key);
+	if (tile == resident.end())
+		{ // not loaded yet
+		heightMisses++;
+		return fallbackHeight;
+		} // not loaded yet
+	tile->second.lastUsed = frame;
+
+	// the tile answers in its own coordinates, and clamps to its own edges
+	float centreX, centreZ;
+	TileCentre(key, centreX, centreZ);
+	return tile->second.terrain->getHeight(x - centreX, z - centreZ);
+	} // getHeight()
+
+// finds the first point where a segment meets any loaded tile
+// tiles whose ground area the segment cannot cross are skipped
+bool TerrainStreamer::IntersectSegment(const Cartesian3 &start, const Cartesian3 &end, Cartesian3 &hitPoint)
+	{ // IntersectSegment()
+	Cartesian3 direction = end - start;
+	float halfTile = 0.5f * tileSize * xyScale;
+	float bestParameter = 1.0f;
+	bool hit = false;
+	for (auto &tile : resident)
+		{ // per loaded tile
+		float centreX, centreZ;
+		TileCentre(tile.first, centreX, centreZ);
+		if (std::max(start.x, end.x) < centreX - halfTile || std::min(start.x, end.x) > centreX + halfTile
+			|| std::max(start.z, end.z) < centreZ - halfTile || std::min(start.z, end.z) > centreZ + halfTile)
+			continue;
+		// each tile is queried in its own coordinates, only as far as the nearest hit so far
+		float parameter;
+		if (tile.second.terrain->IntersectRay(Cartesian3(start.x - centreX, start.y, start.z - centreZ), direction, bestParameter, parameter))
+			{ // nearer hit
+			bestParameter = parameter;
+			hit = true;
+			} // nearer hit
+		} // per loaded tile
+	if (hit)
+		hitPoint = start + direction * bestParameter;
+	return hit;
+	} // IntersectSegment()
+
+// applies a crater to every loaded tile it reaches, and remembers it for every tile it reaches
+// shared edge samples are edited in both tiles, so the seams stay closed, and a tile
+// loaded later has the crater made again, so it matches the neighbours that had it
+void TerrainStreamer::EditMesh(const Cartesian3 &hitpoint, float radius)
+	{ // EditMesh()
+	if (!IsOpen())
+		return;
+	// Terrain::EditMesh() reaches this far from the hitpoint
+	float reach = radius * 8.0f;
+	float halfTile = 0.5f * tileSize * xyScale;
+
+	// the tiles under the corners of the reach, and one more each way for the shared edges
+	long firstKey = TileAt(hitpoint.x - reach, hitpoint.z + reach), lastKey = TileAt(hitpoint.x + reach, hitpoint.z - reach);
+	long firstRow = std::max(firstKey / tilesX - 1, 0L), lastRow = std::min(lastKey / tilesX + 1, tilesY - 1);
+	long firstColumn = std::max(firstKey % tilesX - 1, 0L), lastColumn = std::min(lastKey % tilesX + 1, tilesX - 1);
+	TileCrater crater = { hitpoint, radius };
+	for (long row = firstRow; row <= lastRow; row++)
+		for (long col = firstColumn; col <= lastColumn; col++)
+			{ // per tile
+			long key = TileKey(row, col);
+			float centreX, centreZ;
+			TileCentre(key, centreX, centreZ);
+			if (fabs(hitpoint.x - centreX) > halfTile + reach || fabs(hitpoint.z - centreZ) > halfTile + reach)
+				continue;
+			tileCraters[key].push_back(crater);
+			auto tile = resident.find(key);
+			if (tile != resident.end())
+				EditTile(key, *tile->second.terrain, crater);
+			} // per tile
+	} // EditMesh()
+
+// lists the loaded tiles for the renderer, and adds the heights edited in them since the last call
+void TerrainStreamer::TakeTiles(std::vector<StreamedTile> &tiles, std::vector<StreamedTilePatch> &patches)
+	{ // TakeTiles()
+	tiles.clear();
+	std::vector<TerrainPatch> tilePatches;
+	for (auto &tile : resident)
+		{ // per loaded tile
+		StreamedTile streamed;
+		streamed.terrain = tile.second.terrain;
+		TileCentre(tile.first, streamed.centreX, streamed.centreZ);
+		tiles.push_back(streamed);
+
+		tilePatches.clear();
+		tile.second.terrain->TakePatches(tilePatches);
+		for (TerrainPatch &patch : tilePatches)
+			patches.emplace_back(tile.second.terrain, std::move(patch));
+		} // per loaded tile
+	} // TakeTiles()
+
+// renders tiles listed by TakeTiles(), each through its own quadtree
+// the tile meshes are centred on their own middles, so each is moved into place first
+void TerrainStreamer::Render(const std::vector<StreamedTile> &tiles, columnMajorMatrix &viewMatrix, const columnMajorMatrix &projectionMatrix, float errorScale)
+	{ // Render()
+	for (const StreamedTile &tile : tiles)
+		{ // per tile
+		// mesh x is scene x, and mesh y is scene z
+		columnMajorMatrix tileMatrix = viewMatrix * columnMajorMatrix::Translate(Cartesian3(tile.centreX, tile.centreZ, 0.0f));
+		tile.terrain->Render(tileMatrix, projectionMatrix, errorScale);
+		} // per tile
+	} // Render()
+
+// cuts a text .dem or binary heightfield into a tile directory
+// returns true on success, false otherwise
+bool TerrainStreamer::WriteTiles(const char *sourceFileName, float xyScale, const char *directory, long tileSize)
+	{ // WriteTiles()
+	if (tileSize < 2 || tileSize % 2 != 0)
+		return false;
+
+	// binary sources are used through the mapping, text ones have to be read in
+	MappedHeightfieldFile mapped;
+	std::vector<float> textValues;
+	std::vector<const float *> rows;
+	long width, height;
+	if (MappedHeightfieldFile::IsHeightfieldFile(sourceFileName))
+		{ // binary heightfield
+		if (!mapped.Open(sourceFileName))
+			return false;
+		width = mapped.Width();
+		height = mapped.Height();
+		xyScale = mapped.XYScale();
+		for (long row = 0; row < height; row++)
+			rows.push_back(mapped.Row(row));
+		} // binary heightfield
+	else
+		{ // text .dem
+		Terrain source;
+		if (!source.ReadHeightValues(sourceFileName, xyScale))
+			return false;
+		width = source.m_width;
+		height = source.m_height;
+		textValues.resize((size_t) width * height);
+		for (long row = 0; row < height; row++)
+			{ // per row
+			source.heightValues.GetRow(row, textValues.data() + (size_t) row * width);
+			rows.push_back(textValues.data() + (size_t) row * width);
+			} // per row
+		} // text .dem
+	if (width < 2 || height < 2)
+		return false;
+
+	// an existing directory is fine: its tiles are overwritten
+#ifdef _WIN32
+	_mkdir(directory);
+#else
+	mkdir(directory, 0755);
+#endif
+
+	long tilesX = std::max(1L, (width - 1 + tileSize - 1) / tileSize);
+	long tilesY = std::max(1L, (height - 1 + tileSize - 1) / tileSize);
+	long samples = tileSize + 1;
+	std::vector<float> tile((size_t) samples * samples);
+	for (long tileRow = 0; tileRow < tilesY; tileRow++)
+		for (long tileColumn = 0; tileColumn < tilesX; tileColumn++)
+			{ // per tile
+			// copy the tile out, repeating the last row and column past the edge
+			for (long row = 0; row < samples; row++)
+				{ // per row
+				const float *source = rows[std::min(tileRow * tileSize + row, height - 1)];
+				for (long col = 0; col < samples; col++)
+					tile[(size_t) row * samples + col] = source[std::min(tileColumn * tileSize + col, width - 1)];
+				} // per row
+			if (!WriteHeightfieldFile(TilePath(directory, tileRow, tileColumn).c_str(), samples, samples, xyScale, tile.data()))
+				return false;
+			} // per tile
+
+	// and the manifest last, so a partial directory is never opened
+	std::ofstream manifest(std::string(directory) + "/" + TERRAIN_TILE_MANIFEST);
+	manifest << HEIGHTFIELD_FILE_MAGIC << " tiles 1" << std::endl;
+	manifest << width << " " << height << " " << xyScale << " " << tileSize << std::endl;
+	return manifest.good();
+	} // WriteTiles()
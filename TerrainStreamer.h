@@ -0,0 +1,209 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	TerrainStreamer.h
+//	------------------------
+//
+//	Out-of-core terrain.  The world is cut into
+//	square tiles stored on disk as binary
+//	heightfields, and only the tiles near the
+//	player are kept in memory.  A background thread
+//	loads tiles around and ahead of the player and
+//	builds their meshes; the simulation only picks
+//	up finished tiles and never waits for the disk.
+//	Tiles over a byte budget are evicted, least
+//	recently used first, and the craters made in
+//	each tile are kept so that they are made again
+//	when it is next loaded.  The streamer belongs
+//	to the simulation, which hands each step's tiles
+//	and their edits to the renderer in a snapshot.
+//
+///////////////////////////////////////////////////
+
+#ifndef _TERRAIN_STREAMER_H
+#define _TERRAIN_STREAMER_H
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "Terrain.h"
+
+// name of the file describing a tile directory
+#define TERRAIN_TILE_MANIFEST "tiles.txt"
+
+// a loaded tile, as handed to the renderer
+struct StreamedTile
+	{ // struct StreamedTile
+	// shared with the streamer, so that a tile evicted meanwhile lasts until it is no longer drawn
+	std::shared_ptr<Terrain> terrain;
+	// the scene (x, z) position of the centre of its mesh
+	float centreX, centreZ;
+	}; // struct StreamedTile
+
+// the heights of a block of samples edited in a loaded tile
+struct StreamedTilePatch
+	{ // struct StreamedTilePatch
+	std::shared_ptr<Terrain> terrain;
+	TerrainPatch patch;
+
+	StreamedTilePatch(const std::shared_ptr<Terrain> &Terrain, TerrainPatch &&Patch)
+		: terrain(Terrain), patch(std::move(Patch))
+		{}
+	}; // struct StreamedTilePatch
+
+class TerrainStreamer
+	{ // class TerrainStreamer
+	public:
+	// tiles in each direction around the player's tile that are kept loaded
+	long residentRadius;
+	// how many tile widths ahead of the player's heading to prefetch
+	long lookAheadTiles;
+	// resident tiles beyond this many bytes are evicted
+	size_t byteBudget;
+	// height reported where the tile is not loaded yet
+	float fallbackHeight;
+
+	// counters since Open()
+	long tilesLoaded, tilesEvicted, heightMisses;
+	// estimated memory held by the resident tiles
+	size_t residentBytes;
+
+	// constructor will initialise to a closed streamer
+	TerrainStreamer();
+	// destructor stops the loading thread
+	~TerrainStreamer();
+
+	// reads the manifest of a tile directory and starts the loading thread
+	// returns true on success, false otherwise
+	bool Open(const char *directory);
+
+	// stops the loading thread and releases all tiles
+	void Close();
+
+	// true between a successful Open() and Close()
+	bool IsOpen() const	{ return tileSize > 0; }
+
+	// true if a scene (x, z) position lies over the streamed world
+	bool Contains(float x, float z) const;
+
+	// loads the tile under a position on the calling thread, for start-up
+	void Prime(const Cartesian3 &position);
+
+	// called once a step from the simulation's thread: picks up finished tiles,
+	// requests the tiles around and ahead of the player, and evicts old ones
+	void Update(const Cartesian3 &position, const Cartesian3 &heading);
+
+	// the height at a scene (x, z) position, or fallbackHeight if its tile is not loaded
+	float getHeight(float x, float z);
+
+	// finds the first point where a segment meets any loaded tile
+	bool IntersectSegment(const Cartesian3 &start, const Cartesian3 &end, Cartesian3 &hitPoint);
+
+	// applies a crater to every loaded tile it reaches, and remembers it
+	// for every tile it reaches, so that the tiles not loaded get it when they are
+	void EditMesh(const Cartesian3 &hitpoint, float radius);
+
+	// lists the loaded tiles for the renderer, and adds the heights edited in them
+	// since the last call to patches; the tile meshes are then only changed by the patches
+	void TakeTiles(std::vector<StreamedTile> &tiles, std::vector<StreamedTilePatch> &patches);
+
+	// renders tiles listed by TakeTiles(), each through its own quadtree
+	// apply their patches first: this touches only the meshes, never the heights
+	static void Render(const std::vector<StreamedTile> &tiles, columnMajorMatrix &viewMatrix, const columnMajorMatrix &projectionMatrix, float errorScale);
+
+	// number of tiles in memory
+	long ResidentTileCount() const	{ return resident.size(); }
+
+	// cuts a text .dem or binary heightfield into a tile directory
+	// tileSize is in cells and must be even; binary sources are read through
+	// a mapping, so they need not fit in memory
+	// returns true on success, false otherwise
+	static bool WriteTiles(const char *sourceFileName, float xyScale, const char *directory, long tileSize);
+
+	// the path of one tile in a tile directory
+	static std::string TilePath(const std::string &directory, long tileRow, long tileColumn);
+
+	private:
+	// no copying: we own a thread
+	TerrainStreamer(const TerrainStreamer &);
+	TerrainStreamer &operator =(const TerrainStreamer &);
+
+	// a tile in memory
+	struct ResidentTile
+		{ // struct ResidentTile
+		std::shared_ptr<Terrain> terrain;
+		// the frame the tile was last wanted or queried
+		long lastUsed;
+		size_t bytes;
+		}; // struct ResidentTile
+
+	// a crater, in scene coordinates
+	struct TileCrater
+		{ // struct TileCrater
+		Cartesian3 hitpoint;
+		float radius;
+		}; // struct TileCrater
+
+	// tiles are keyed by row * tilesX + column
+	long TileKey(long tileRow, long tileColumn) const	{ return tileRow * tilesX + tileColumn; }
+
+	// the key of the tile under a scene (x, z) position, clamped to the world
+	long TileAt(float x, float z) const;
+
+	// the scene (x, z) position of the centre of a tile's mesh
+	void TileCentre(long key, float &x, float &z) const;
+
+	// reads a tile and builds its mesh: safe to call from any thread
+	std::unique_ptr<Terrain> LoadTile(long key) const;
+
+	// takes ownership of a loaded tile on the simulation's thread, and makes its craters again
+	void AdoptTile(long key, std::unique_ptr<Terrain> terrain);
+
+	// applies a crater to one loaded tile
+	void EditTile(long key, Terrain &terrain, const TileCrater &crater) const;
+
+	// evicts least recently used tiles until under the budget
+	void EvictTiles();
+
+	// adds a tile to the wanted list once
+	void WantTile(long key);
+
+	// the loading thread
+	void LoadTiles();
+
+	// the tile set, fixed by Open()
+	std::string directory;
+	long worldWidth, worldHeight;
+	long tileSize, tilesX, tilesY;
+	float xyScale;
+	// the sample at the scene origin
+	long originRow, originColumn;
+
+	// owned by the simulation's thread
+	std::unordered_map<long, ResidentTile> resident;
+	// the craters made in each tile, loaded or not, oldest first
+	std::unordered_map<long, std::vector<TileCrater> > tileCraters;
+	std::unordered_set<long> missingTiles;
+	std::vector<long> wantedTiles;
+	long frame;
+
+	// shared with the loading thread, under queueMutex
+	std::mutex queueMutex;
+	std::condition_variable queueCondition;
+	std::deque<long> requestedTiles;
+	std::vector<std::pair<long, std::unique_ptr<Terrain> > > finishedTiles;
+	long loadingTile;
+	bool stopping;
+
+	std::thread loader;
+	}; // class TerrainStreamer
+
+#endif
@@ -0,0 +1,223 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	ThreadPool.cpp
+//	------------------------
+//
+//	A fixed set of worker threads for splitting
+//	loops across cores.  ParallelFor() cuts a range
+//	into chunks and gives each thread, the caller
+//	included, an equal run of them.  Each thread
+//	takes chunks from the front of its own run, so
+//	that neighbouring chunks stay on one core, and
+//	when its run is done steals the back half of
+//	the longest run left, so that a thread that was
+//	slow to wake or given heavy chunks holds no one
+//	up.  It returns once every chunk is done.
+//
+///////////////////////////////////////////////////
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+// set while a thread is running chunks, so that nested loops run inline
+static thread_local bool insideLoop = false;
+
+// a run of chunks [front, back) packed into one word, and unpacked
+static unsigned long long PackRun(unsigned long long front, unsigned long long back)
+	{ return front << 32 | back; }
+static long RunFront(unsigned long long run)
+	{ return run >> 32; }
+static long RunBack(unsigned long long run)
+	{ return run & 0xffffffffULL; }
+
+// starts threadCount - 1 workers, since the caller works too
+ThreadPool::ThreadPool(int threadCount)
+	:
+	body(NULL),
+	loopBegin(0),
+	loopEnd(0),
+	loopGrain(1),
+	stolenChunks(0),
+	generation(0),
+	busyWorkers(0),
+	stopping(false)
+	{ // constructor
+	StartWorkers(threadCount);
+	} // constructor
+
+// destructor stops the workers
+ThreadPool::~ThreadPool()
+	{ // destructor
+	StopWorkers();
+	} // destructor
+
+// stops the workers and starts threadCount - 1 new ones
+void ThreadPool::Resize(int threadCount)
+	{ // Resize()
+	std::lock_guard<std::mutex> caller(callerMutex);
+	StopWorkers();
+	StartWorkers(threadCount);
+	} // Resize()
+
+// starts the workers
+void ThreadPool::StartWorkers(int threadCount)
+	{ // StartWorkers()
+	if (threadCount <= 0)
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	stopping = false;
+	runs.reset(new ChunkRun[threadCount]);
+	for (int run = 0; run < threadCount; run++)
+		runs[run].chunks = 0;
+	for (int worker = 1; worker < threadCount; worker++)
+		workers.emplace_back(&ThreadPool::WorkerLoop, this, worker);
+	} // StartWorkers()
+
+// stops the workers
+void ThreadPool::StopWorkers()
+	{ // StopWorkers()
+		{ // tell them to stop
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+		} // tell them to stop
+	wake.notify_all();
+	for (std::thread &worker : workers)
+		worker.join();
+	workers.clear();
+	} // StopWorkers()
+
+// the worker thread: waits for a new loop, helps with it, and waits again
+void ThreadPool::WorkerLoop(int index)
+	{ // WorkerLoop()
+	std::unique_lock<std::mutex> lock(mutex);
+	unsigned long seen = generation;
+	while (true)
+		{ // per loop
+		wake.wait(lock, [&] { return stopping || generation != seen; });
+		if (stopping)
+			return;
+		seen = generation;
+		busyWorkers++;
+
+		lock.unlock();
+		RunChunks(index);
+		lock.lock();
+
+		if (--busyWorkers == 0)
+			finished.notify_all();
+		} // per loop
+	} // WorkerLoop()
+
+// runs chunks of the current loop, its own and then stolen, until there are none left
+void ThreadPool::RunChunks(int index)
+	{ // RunChunks()
+	insideLoop = true;
+	while (true)
+		{ // per chunk
+		long chunk = TakeChunk(index);
+		if (chunk < 0)
+			chunk = StealChunks(index);
+		if (chunk < 0)
+			break;
+		long first = loopBegin + chunk * loopGrain;
+		(*body)(first, std::min(first + loopGrain, loopEnd));
+		} // per chunk
+	insideLoop = false;
+	} // RunChunks()
+
+// takes the next chunk from the front of a thread's own run, or returns -1 if it is done
+long ThreadPool::TakeChunk(int index)
+	{ // TakeChunk()
+	std::atomic<unsigned long long> &chunks = runs[index].chunks;
+	unsigned long long run = chunks;
+	// a thief may shorten the run from the back at the same time, in which case the swap fails and we look again
+	while (RunFront(run) < RunBack(run))
+		if (chunks.compare_exchange_weak(run, PackRun(RunFront(run) + 1, RunBack(run))))
+			return RunFront(run);
+	return -1;
+	} // TakeChunk()
+
+// moves the back half of the longest other run to a thread's own, and returns the first chunk of it to run
+long ThreadPool::StealChunks(int index)
+	{ // StealChunks()
+	while (true)
+		{ // per attempt
+		// the longest run has the most work to share
+		int victim = -1;
+		unsigned long long victimRun = 0;
+		long longest = 0;
+		for (int other = 0; other < ThreadCount(); other++)
+			{ // per other run
+			unsigned long long run = runs[other].chunks;
+			if (other != index && RunBack(run) - RunFront(run) > longest)
+				{ // longer
+				victim = other;
+				victimRun = run;
+				longest = RunBack(run) - RunFront(run);
+				} // longer
+			} // per other run
+		if (victim < 0)
+			return -1;
+
+		// take the back half, rounding up so that a single chunk can be taken
+		long front = RunFront(victimRun), back = RunBack(victimRun), middle = back - (longest + 1) / 2;
+		if (!runs[victim].chunks.compare_exchange_strong(victimRun, PackRun(front, middle)))
+			continue;
+
+		// our own run is empty, and so no thief will touch it until it has chunks again
+		runs[index].chunks = PackRun(middle + 1, back);
+		stolenChunks += back - middle;
+		return middle;
+		} // per attempt
+	} // StealChunks()
+
+// calls body(first, end) over [begin, end) in chunks of at most grain
+void ThreadPool::ParallelFor(long begin, long end, long grain, const std::function<void(long, long)> &Body)
+	{ // ParallelFor()
+	if (end <= begin)
+		return;
+	grain = std::max(grain, 1L);
+
+	// small loops, nested loops and loops on a busy pool run here and now
+	std::unique_lock<std::mutex> caller(callerMutex, std::try_to_lock);
+	if (workers.empty() || end - begin <= grain || insideLoop || !caller.owns_lock())
+		{ // inline
+		for (long first = begin; first < end; first += grain)
+			Body(first, std::min(first + grain, end));
+		return;
+		} // inline
+
+	// publish the loop and wake the workers
+		{ // new loop
+		// a worker that woke late for the last loop must leave it first
+		std::unique_lock<std::mutex> lock(mutex);
+		finished.wait(lock, [this] { return busyWorkers == 0; });
+		body = &Body;
+		loopBegin = begin;
+		loopEnd = end;
+		loopGrain = grain;
+		// an equal run for every thread, with the caller's first
+		long chunkCount = (end - begin + grain - 1) / grain;
+		for (int run = 0; run < ThreadCount(); run++)
+			runs[run].chunks = PackRun(chunkCount * run / ThreadCount(), chunkCount * (run + 1) / ThreadCount());
+		generation++;
+		} // new loop
+	wake.notify_all();
+
+	// work alongside them
+	RunChunks(0);
+
+	// and wait for any still finishing a chunk; workers that wake late find
+	// no chunks left, and leave without touching the body
+	std::unique_lock<std::mutex> lock(mutex);
+	finished.wait(lock, [this] { return busyWorkers == 0; });
+	body = NULL;
+	} // ParallelFor()
+
+// the pool shared by the whole program
+ThreadPool &ThreadPool::Shared()
+	{ // Shared()
+	static ThreadPool sharedPool;
+	return sharedPool;
+	} // Shared()
@@ -0,0 +1,107 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	ThreadPool.h
+//	------------------------
+//
+//	A fixed set of worker threads for splitting
+//	loops across cores.  ParallelFor() cuts a range
+//	into chunks and gives each thread, the caller
+//	included, an equal run of them.  Each thread
+//	takes chunks from the front of its own run, so
+//	that neighbouring chunks stay on one core, and
+//	when its run is done steals the back half of
+//	the longest run left, so that a thread that was
+//	slow to wake or given heavy chunks holds no one
+//	up.  It returns once every chunk is done.
+//
+///////////////////////////////////////////////////
+
+#ifndef _THREAD_POOL_H
+#define _THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+	{ // class ThreadPool
+	public:
+	// starts threadCount - 1 workers, since the caller works too
+	// a count of 0 means one thread per hardware core
+	explicit ThreadPool(int threadCount = 0);
+	// destructor stops the workers
+	~ThreadPool();
+
+	// number of threads that share a loop, counting the caller
+	int ThreadCount() const	{ return workers.size() + 1; }
+
+	// stops the workers and starts threadCount - 1 new ones
+	void Resize(int threadCount);
+
+	// calls body(first, end) over [begin, end) in chunks of at most grain
+	// the chunks run in no particular order and must not depend on each other
+	// runs on the calling thread alone if the range is a single chunk, if called
+	// from inside another loop, or if another thread is using the pool
+	void ParallelFor(long begin, long end, long grain, const std::function<void(long, long)> &body);
+
+	// chunks run by a thread other than the one first given them, since the pool started
+	long StolenChunks() const	{ return stolenChunks; }
+
+	// the pool shared by the whole program
+	static ThreadPool &Shared();
+
+	private:
+	// no copying: we own threads
+	ThreadPool(const ThreadPool &);
+	ThreadPool &operator =(const ThreadPool &);
+
+	// starts and stops the workers
+	void StartWorkers(int threadCount);
+	void StopWorkers();
+
+	// the worker thread, which owns run index of each loop; the caller owns run 0
+	void WorkerLoop(int index);
+
+	// runs chunks of the current loop, its own and then stolen, until there are none left
+	void RunChunks(int index);
+
+	// takes the next chunk from the front of a thread's own run, or returns -1 if it is done
+	long TakeChunk(int index);
+
+	// moves the back half of the longest other run to a thread's own, and returns the first
+	// chunk of it to run, or -1 if every run is done
+	long StealChunks(int index);
+
+	// the chunks [front, back) of one thread's run, packed as front << 32 | back so that
+	// the owner and a thief can both change it with one compare-and-swap
+	// each is on a cache line of its own, so that threads taking chunks do not slow each other
+	struct alignas(64) ChunkRun
+		{ // struct ChunkRun
+		std::atomic<unsigned long long> chunks;
+		}; // struct ChunkRun
+	std::unique_ptr<ChunkRun[]> runs;
+
+	std::vector<std::thread> workers;
+
+	// only one loop at a time
+	std::mutex callerMutex;
+
+	// the current loop, set under the mutex before the workers are woken
+	std::mutex mutex;
+	std::condition_variable wake, finished;
+	const std::function<void(long, long)> *body;
+	long loopBegin, loopEnd, loopGrain;
+	std::atomic<long> stolenChunks;
+	// bumped for each loop, so that workers know there is new work
+	unsigned long generation;
+	// workers still inside the current loop
+	int busyWorkers;
+	bool stopping;
+	}; // class ThreadPool
+
+#endif
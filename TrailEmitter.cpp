@@ -0,0 +1,139 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	TrailEmitter.cpp
+//	------------------------
+//
+//	The smoke trailing each lava bomb.  Every trail
+//	keeps a small ring buffer of where its bomb has
+//	been, sampled at a fixed interval, and puts one
+//	puff of smoke on each sample, swirled about it
+//	by an offset from a table computed once, so
+//	that a step costs a few additions per puff and
+//	no calls to rand(), cos() or sin().  A trail
+//	finds its bomb by the bomb's handle, and ends
+//	when the bomb is removed.
+//
+///////////////////////////////////////////////////
+
+#include "TrailEmitter.h"
+
+#include <math.h>
+
+// the radius of the first puff's swirl; each puff further back swirls this much wider
+#define TRAIL_SWIRL_RADIUS 20.0f
+
+// constructor will initialise to no trails, with room for Capacity, sampling every SampleInterval seconds
+TrailEmitter::TrailEmitter(long Capacity, float SampleInterval)
+	:
+	capacity(Capacity),
+	sampleInterval(SampleInterval),
+	secondsSinceSample(0.0f),
+	phase(0)
+	{ // constructor
+	handles.reserve(capacity);
+	newest.reserve(capacity);
+	sampleX.reserve(TRAIL_SAMPLES * capacity);
+	sampleY.reserve(TRAIL_SAMPLES * capacity);
+	sampleZ.reserve(TRAIL_SAMPLES * capacity);
+
+	// successive angles a golden fraction of a turn apart cover the circle evenly
+	// without any pattern the eye picks up as the swirl hops through the table
+	const float goldenTurn = 0.5f * (3.0f - sqrtf(5.0f));
+	for (int entry = 0; entry < TRAIL_SWIRL_TABLE_SIZE; entry++)
+		{ // per entry
+		float angle = 2.0f * (float) M_PI * fmodf(entry * goldenTurn, 1.0f);
+		swirlX[entry] = cosf(angle);
+		swirlZ[entry] = sinf(angle);
+		} // per entry
+	} // constructor
+
+// starts a trail behind the particle with a handle, with every sample at its position
+bool TrailEmitter::Add(long long handle, const Cartesian3 &position)
+	{ // Add()
+	if (Count() >= capacity)
+		return false;
+	handles.push_back(handle);
+	newest.push_back(0);
+	for (int sample = 0; sample < TRAIL_SAMPLES; sample++)
+		{ // per sample
+		sampleX.push_back(position.x);
+		sampleY.push_back(position.y);
+		sampleZ.push_back(position.z);
+		} // per sample
+	return true;
+	} // Add()
+
+// removes a trail by moving the last trail into its place
+void TrailEmitter::Remove(long trail)
+	{ // Remove()
+	long last = Count() - 1;
+	if (trail != last)
+		{ // move the last trail down
+		handles[trail] = handles[last];
+		newest[trail] = newest[last];
+		for (int sample = 0; sample < TRAIL_SAMPLES; sample++)
+			{ // per sample
+			sampleX[TRAIL_SAMPLES * trail + sample] = sampleX[TRAIL_SAMPLES * last + sample];
+			sampleY[TRAIL_SAMPLES * trail + sample] = sampleY[TRAIL_SAMPLES * last + sample];
+			sampleZ[TRAIL_SAMPLES * trail + sample] = sampleZ[TRAIL_SAMPLES * last + sample];
+			} // per sample
+		} // move the last trail down
+	handles.pop_back();
+	newest.pop_back();
+	sampleX.resize(TRAIL_SAMPLES * last);
+	sampleY.resize(TRAIL_SAMPLES * last);
+	sampleZ.resize(TRAIL_SAMPLES * last);
+	} // Remove()
+
+// ends the trails whose particles have been removed, and advances the others by dt seconds
+void TrailEmitter::Update(const ParticleSystem &particles, float dt)
+	{ // Update()
+	phase++;
+	secondsSinceSample += dt;
+	bool sampling = secondsSinceSample >= sampleInterval;
+	if (sampling)
+		secondsSinceSample = 0.0f;
+
+	for (long trail = 0; trail < Count(); )
+		{ // per trail
+		long particle = particles.Find(handles[trail]);
+		if (particle < 0)
+			{ // particle removed
+			// the last trail moves here, and is looked at next
+			Remove(trail);
+			continue;
+			} // particle removed
+
+		if (sampling)
+			{ // take a sample
+			// the oldest sample is overwritten
+			int sample = newest[trail] = (newest[trail] + 1) % TRAIL_SAMPLES;
+			sampleX[TRAIL_SAMPLES * trail + sample] = particles.positionX[particle];
+			sampleY[TRAIL_SAMPLES * trail + sample] = particles.positionY[particle];
+			sampleZ[TRAIL_SAMPLES * trail + sample] = particles.positionZ[particle];
+			} // take a sample
+		trail++;
+		} // per trail
+	} // Update()
+
+// sets smoke to TRAIL_SAMPLES puffs per trail, newest sample first, drawn at half size
+void TrailEmitter::EmitPuffs(ParticleSystem &smoke) const
+	{ // EmitPuffs()
+	smoke.Resize(TRAIL_SAMPLES * Count());
+	for (long trail = 0; trail < Count(); trail++)
+		for (int puff = 0; puff < TRAIL_SAMPLES; puff++)
+			{ // per puff
+			long smokeIndex = TRAIL_SAMPLES * trail + puff;
+			long sample = TRAIL_SAMPLES * trail + (newest[trail] + TRAIL_SAMPLES - puff) % TRAIL_SAMPLES;
+			// each puff hops to a different swirl every step, and puffs further back swirl wider;
+			// the handle keeps neighbouring trails from swirling in step
+			unsigned long entry = (97 * phase + 31 * (unsigned long) handles[trail] + 53 * puff) & (TRAIL_SWIRL_TABLE_SIZE - 1);
+			float radius = TRAIL_SWIRL_RADIUS * (puff + 1);
+			smoke.positionX[smokeIndex] = sampleX[sample] + radius * swirlX[entry];
+			smoke.positionY[smokeIndex] = sampleY[sample];
+			smoke.positionZ[smokeIndex] = sampleZ[sample] + radius * swirlZ[entry];
+			smoke.SetColour(smokeIndex, 1.0f, 1.0f, 1.0f, 1.0f);
+			smoke.scale[smokeIndex] = 0.5f;
+			} // per puff
+	} // EmitPuffs()
@@ -0,0 +1,72 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	TrailEmitter.h
+//	------------------------
+//
+//	The smoke trailing each lava bomb.  Every trail
+//	keeps a small ring buffer of where its bomb has
+//	been, sampled at a fixed interval, and puts one
+//	puff of smoke on each sample, swirled about it
+//	by an offset from a table computed once, so
+//	that a step costs a few additions per puff and
+//	no calls to rand(), cos() or sin().  A trail
+//	finds its bomb by the bomb's handle, and ends
+//	when the bomb is removed.
+//
+///////////////////////////////////////////////////
+
+#ifndef _TRAIL_EMITTER_H
+#define _TRAIL_EMITTER_H
+
+#include <vector>
+
+#include "Cartesian3.h"
+#include "ParticleSystem.h"
+
+// the samples, and so the puffs, in each trail
+#define TRAIL_SAMPLES 5
+// the swirl offsets in the table: a power of 2
+#define TRAIL_SWIRL_TABLE_SIZE 256
+
+class TrailEmitter
+	{ // class TrailEmitter
+	public:
+	// constructor will initialise to no trails, with room for Capacity, sampling every SampleInterval seconds
+	TrailEmitter(long Capacity, float SampleInterval = 0.1f);
+
+	// the number of trails
+	long Count() const	{ return handles.size(); }
+
+	// starts a trail behind the particle with a handle, with every sample at its position
+	// returns false if there are already as many trails as the capacity
+	bool Add(long long handle, const Cartesian3 &position);
+
+	// ends the trails whose particles have been removed, and advances the others by dt seconds,
+	// recording where their particles are whenever the sample interval has passed
+	void Update(const ParticleSystem &particles, float dt);
+
+	// sets smoke to TRAIL_SAMPLES puffs per trail, newest sample first, drawn at half size
+	void EmitPuffs(ParticleSystem &smoke) const;
+
+	private:
+	long capacity;
+	float sampleInterval;
+	// scene time since the last sample, and the steps taken, which turn the swirl
+	float secondsSinceSample;
+	unsigned long phase;
+
+	// the handle of each trail's particle
+	std::vector<long long> handles;
+	// the samples of trail t are TRAIL_SAMPLES * t onwards, as a ring with its newest at newest[t]
+	std::vector<float> sampleX, sampleY, sampleZ;
+	std::vector<int> newest;
+
+	// offsets in the ground plane, at angles scattered around the circle, of unit length
+	float swirlX[TRAIL_SWIRL_TABLE_SIZE], swirlZ[TRAIL_SWIRL_TABLE_SIZE];
+
+	// removes a trail by moving the last trail into its place
+	void Remove(long trail);
+	}; // class TrailEmitter
+
+#endif
@@ -0,0 +1,177 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	TransformKernels.cpp
+//	------------------------
+//
+//	Applies one columnMajorMatrix to a whole array
+//	of points or vectors at once, with SSE or AVX
+//	where the compiler allows.  Each result matches
+//	columnMajorMatrix::operator* up to rounding.
+//
+//	The array-of-structures kernels broadcast each
+//	coordinate of a vertex across a register and
+//	sum the matrix columns it scales.  The SoA
+//	kernel transforms four or eight points a lane
+//	each, with the matrix entries broadcast.
+//
+///////////////////////////////////////////////////
+
+#include "TransformKernels.h"
+
+#if defined(__SSE__) || defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+// the vector kernels load a whole vertex at once
+static_assert(sizeof(Homogeneous4) == 4 * sizeof(float), "Homogeneous4 must be four packed floats");
+
+// the remaining vertices of an array, one at a time, as operator* does
+static inline void TransformTail(const float *m, const Homogeneous4 *in, Homogeneous4 *out, long first, long count, bool translate)
+	{ // TransformTail()
+	for (long vertex = first; vertex < count; vertex++)
+		{ // per vertex
+		Homogeneous4 v = in[vertex];
+		float w = translate ? v.w : 0.0f;
+		out[vertex].x = m[0] * v.x + m[4] * v.y + m[8] * v.z + m[12] * w;
+		out[vertex].y = m[1] * v.x + m[5] * v.y + m[9] * v.z + m[13] * w;
+		out[vertex].z = m[2] * v.x + m[6] * v.y + m[10] * v.z + m[14] * w;
+		out[vertex].w = translate ? m[3] * v.x + m[7] * v.y + m[11] * v.z + m[15] * w : 0.0f;
+		} // per vertex
+	} // TransformTail()
+
+#if defined(__AVX__)
+// a * b + c, fused where the machine allows
+static inline __m256 MultiplyAdd(__m256 a, __m256 b, __m256 c)
+	{ // MultiplyAdd()
+#if defined(__FMA__)
+	return _mm256_fmadd_ps(a, b, c);
+#else
+	return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+	} // MultiplyAdd()
+#endif
+
+#if defined(__SSE__)
+static inline __m128 MultiplyAdd(__m128 a, __m128 b, __m128 c)
+	{ // MultiplyAdd()
+#if defined(__FMA__)
+	return _mm_fmadd_ps(a, b, c);
+#else
+	return _mm_add_ps(_mm_mul_ps(a, b), c);
+#endif
+	} // MultiplyAdd()
+#endif
+
+// the AoS kernel shared by points and normals
+// for normals the fourth column is skipped and the w row is zeroed
+static inline void TransformAoS(const columnMajorMatrix &matrix, const Homogeneous4 *in, Homogeneous4 *out, long count, bool translate)
+	{ // TransformAoS()
+	const float *m = matrix.coordinates;
+	long vertex = 0;
+
+#if defined(__AVX__)
+	// two vertices at a time, one in each half of the register
+	__m256 column0 = _mm256_setr_ps(m[0], m[1], m[2], translate ? m[3] : 0.0f, m[0], m[1], m[2], translate ? m[3] : 0.0f);
+	__m256 column1 = _mm256_setr_ps(m[4], m[5], m[6], translate ? m[7] : 0.0f, m[4], m[5], m[6], translate ? m[7] : 0.0f);
+	__m256 column2 = _mm256_setr_ps(m[8], m[9], m[10], translate ? m[11] : 0.0f, m[8], m[9], m[10], translate ? m[11] : 0.0f);
+	__m256 column3 = translate ? _mm256_setr_ps(m[12], m[13], m[14], m[15], m[12], m[13], m[14], m[15]) : _mm256_setzero_ps();
+	for (; vertex + 2 <= count; vertex += 2)
+		{ // per pair of vertices
+		__m256 v = _mm256_loadu_ps(&in[vertex].x);
+		// each coordinate copied across its own half
+		__m256 x = _mm256_permute_ps(v, 0x00);
+		__m256 y = _mm256_permute_ps(v, 0x55);
+		__m256 z = _mm256_permute_ps(v, 0xAA);
+		__m256 w = _mm256_permute_ps(v, 0xFF);
+		__m256 result = MultiplyAdd(column3, w, MultiplyAdd(column2, z, MultiplyAdd(column1, y, _mm256_mul_ps(column0, x))));
+		_mm256_storeu_ps(&out[vertex].x, result);
+		} // per pair of vertices
+#elif defined(__SSE__)
+	// one vertex at a time, all four rows at once
+	__m128 column0 = _mm_setr_ps(m[0], m[1], m[2], translate ? m[3] : 0.0f);
+	__m128 column1 = _mm_setr_ps(m[4], m[5], m[6], translate ? m[7] : 0.0f);
+	__m128 column2 = _mm_setr_ps(m[8], m[9], m[10], translate ? m[11] : 0.0f);
+	__m128 column3 = translate ? _mm_loadu_ps(m + 12) : _mm_setzero_ps();
+	for (; vertex < count; vertex++)
+		{ // per vertex
+		__m128 v = _mm_loadu_ps(&in[vertex].x);
+		__m128 x = _mm_shuffle_ps(v, v, 0x00);
+		__m128 y = _mm_shuffle_ps(v, v, 0x55);
+		__m128 z = _mm_shuffle_ps(v, v, 0xAA);
+		__m128 w = _mm_shuffle_ps(v, v, 0xFF);
+		__m128 result = MultiplyAdd(column3, w, MultiplyAdd(column2, z, MultiplyAdd(column1, y, _mm_mul_ps(column0, x))));
+		_mm_storeu_ps(&out[vertex].x, result);
+		} // per vertex
+#endif
+
+	TransformTail(m, in, out, vertex, count, translate);
+	} // TransformAoS()
+
+// out[i] = matrix * in[i] for count homogeneous points or vectors
+void TransformHomogeneous(const columnMajorMatrix &matrix, const Homogeneous4 *in, Homogeneous4 *out, long count)
+	{ // TransformHomogeneous()
+	TransformAoS(matrix, in, out, count, true);
+	} // TransformHomogeneous()
+
+// transforms count normal vectors by the upper 3x3 of the matrix only
+void TransformNormals(const columnMajorMatrix &matrix, const Homogeneous4 *in, Homogeneous4 *out, long count)
+	{ // TransformNormals()
+	TransformAoS(matrix, in, out, count, false);
+	} // TransformNormals()
+
+// transforms count points held as separate x, y and z arrays, with w taken as 1
+void TransformPointsSoA(const columnMajorMatrix &matrix, const float *xs, const float *ys, const float *zs,
+						float *outXs, float *outYs, float *outZs, long count)
+	{ // TransformPointsSoA()
+	const float *m = matrix.coordinates;
+	long point = 0;
+
+#if defined(__AVX__)
+	// eight points at a time
+	__m256 m0 = _mm256_set1_ps(m[0]), m4 = _mm256_set1_ps(m[4]), m8 = _mm256_set1_ps(m[8]), m12 = _mm256_set1_ps(m[12]);
+	__m256 m1 = _mm256_set1_ps(m[1]), m5 = _mm256_set1_ps(m[5]), m9 = _mm256_set1_ps(m[9]), m13 = _mm256_set1_ps(m[13]);
+	__m256 m2 = _mm256_set1_ps(m[2]), m6 = _mm256_set1_ps(m[6]), m10 = _mm256_set1_ps(m[10]), m14 = _mm256_set1_ps(m[14]);
+	for (; point + 8 <= count; point += 8)
+		{ // per block of eight
+		__m256 x = _mm256_loadu_ps(xs + point), y = _mm256_loadu_ps(ys + point), z = _mm256_loadu_ps(zs + point);
+		_mm256_storeu_ps(outXs + point, MultiplyAdd(m8, z, MultiplyAdd(m4, y, MultiplyAdd(m0, x, m12))));
+		_mm256_storeu_ps(outYs + point, MultiplyAdd(m9, z, MultiplyAdd(m5, y, MultiplyAdd(m1, x, m13))));
+		_mm256_storeu_ps(outZs + point, MultiplyAdd(m10, z, MultiplyAdd(m6, y, MultiplyAdd(m2, x, m14))));
+		} // per block of eight
+#elif defined(__SSE__)
+	// four points at a time
+	__m128 m0 = _mm_set1_ps(m[0]), m4 = _mm_set1_ps(m[4]), m8 = _mm_set1_ps(m[8]), m12 = _mm_set1_ps(m[12]);
+	__m128 m1 = _mm_set1_ps(m[1]), m5 = _mm_set1_ps(m[5]), m9 = _mm_set1_ps(m[9]), m13 = _mm_set1_ps(m[13]);
+	__m128 m2 = _mm_set1_ps(m[2]), m6 = _mm_set1_ps(m[6]), m10 = _mm_set1_ps(m[10]), m14 = _mm_set1_ps(m[14]);
+	for (; point + 4 <= count; point += 4)
+		{ // per block of four
+		__m128 x = _mm_loadu_ps(xs + point), y = _mm_loadu_ps(ys + point), z = _mm_loadu_ps(zs + point);
+		_mm_storeu_ps(outXs + point, MultiplyAdd(m8, z, MultiplyAdd(m4, y, MultiplyAdd(m0, x, m12))));
+		_mm_storeu_ps(outYs + point, MultiplyAdd(m9, z, MultiplyAdd(m5, y, MultiplyAdd(m1, x, m13))));
+		_mm_storeu_ps(outZs + point, MultiplyAdd(m10, z, MultiplyAdd(m6, y, MultiplyAdd(m2, x, m14))));
+		} // per block of four
+#endif
+
+	for (; point < count; point++)
+		{ // per remaining point
+		float x = xs[point], y = ys[point], z = zs[point];
+		outXs[point] = m[0] * x + m[4] * y + m[8] * z + m[12];
+		outYs[point] = m[1] * x + m[5] * y + m[9] * z + m[13];
+		outZs[point] = m[2] * x + m[6] * y + m[10] * z + m[14];
+		} // per remaining point
+	} // TransformPointsSoA()
+
+// name of the instruction set the kernels were compiled for
+const char *TransformKernelName()
+	{ // TransformKernelName()
+#if defined(__AVX__) && defined(__FMA__)
+	return "AVX+FMA";
+#elif defined(__AVX__)
+	return "AVX";
+#elif defined(__SSE__)
+	return "SSE";
+#else
+	return "scalar";
+#endif
+	} // TransformKernelName()
@@ -0,0 +1,37 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	TransformKernels.h
+//	------------------------
+//
+//	Applies one columnMajorMatrix to a whole array
+//	of points or vectors at once, with SSE or AVX
+//	where the compiler allows.  Each result matches
+//	columnMajorMatrix::operator* up to rounding.
+//
+///////////////////////////////////////////////////
+
+#ifndef _TRANSFORM_KERNELS_H
+#define _TRANSFORM_KERNELS_H
+
+#include "Homogeneous4.h"
+#include "Matrix4.h"
+
+// out[i] = matrix * in[i] for count homogeneous points or vectors
+// in and out may be the same array
+void TransformHomogeneous(const columnMajorMatrix &matrix, const Homogeneous4 *in, Homogeneous4 *out, long count);
+
+// transforms count normal vectors by the upper 3x3 of the matrix only, so that
+// translation is skipped, and sets each w to 0
+// in and out may be the same array
+void TransformNormals(const columnMajorMatrix &matrix, const Homogeneous4 *in, Homogeneous4 *out, long count);
+
+// transforms count points held as separate x, y and z arrays, with w taken as 1
+// the matrix must be affine, as model and view matrices are, so w stays 1
+void TransformPointsSoA(const columnMajorMatrix &matrix, const float *xs, const float *ys, const float *zs,
+						float *outXs, float *outYs, float *outZs, long count);
+
+// name of the instruction set the kernels were compiled for
+const char *TransformKernelName();
+
+#endif
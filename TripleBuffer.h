@@ -0,0 +1,77 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	TripleBuffer.h
+//	------------------------
+//
+//	Hands values from one writing thread to one
+//	reading thread without locks.  There are three
+//	copies: the writer fills one, the reader reads
+//	another, and the third holds the newest one
+//	published.  Publishing and acquiring each swap
+//	with the middle copy in one atomic exchange, so
+//	neither side ever waits for the other.  The
+//	reader always gets the newest value; any the
+//	writer published in between are skipped.
+//
+///////////////////////////////////////////////////
+
+#ifndef _TRIPLE_BUFFER_H
+#define _TRIPLE_BUFFER_H
+
+#include <atomic>
+
+template <class T> class TripleBuffer
+	{ // class TripleBuffer
+	public:
+	// constructor will initialise to three default values, none of them published
+	TripleBuffer()
+		: middle(1), writeIndex(0), readIndex(2)
+		{}
+
+	// the copy to fill, owned by the writer until the next Publish()
+	T &WriteBuffer()
+		{ return buffers[writeIndex]; }
+
+	// makes the write buffer the newest value and takes the middle one to fill next
+	// returns true if the value taken back was published but never acquired, in which
+	// case the reader skipped it and it still holds what it was published with
+	bool Publish()
+		{ // Publish()
+		// release, so that the reader sees everything written to the buffer
+		unsigned int previous = middle.exchange(writeIndex | FRESH_BIT, std::memory_order_acq_rel);
+		writeIndex = previous & INDEX_MASK;
+		return (previous & FRESH_BIT) != 0;
+		} // Publish()
+
+	// takes the newest value published, if there is one since the last Acquire()
+	// returns false, leaving the read buffer as it was, if there is nothing new
+	bool Acquire()
+		{ // Acquire()
+		if ((middle.load(std::memory_order_relaxed) & FRESH_BIT) == 0)
+			return false;
+		// acquire, so that everything the writer wrote before publishing is visible
+		readIndex = middle.exchange(readIndex, std::memory_order_acq_rel) & INDEX_MASK;
+		return true;
+		} // Acquire()
+
+	// the copy last acquired, owned by the reader until the next Acquire()
+	const T &ReadBuffer() const
+		{ return buffers[readIndex]; }
+
+	private:
+	// the low bits of middle are its index, and this bit is set while it is unread
+	static const unsigned int INDEX_MASK = 3;
+	static const unsigned int FRESH_BIT = 4;
+
+	// no copying: the indices belong to two threads
+	TripleBuffer(const TripleBuffer &);
+	TripleBuffer &operator =(const TripleBuffer &);
+
+	T buffers[3];
+	std::atomic<unsigned int> middle;
+	// each owned by one side only
+	unsigned int writeIndex, readIndex;
+	}; // class TripleBuffer
+
+#endif
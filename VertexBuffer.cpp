@@ -0,0 +1,153 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	VertexBuffer.cpp
+//	------------------------
+//
+//	A thin wrapper around an OpenGL 1.5 buffer
+//	object, for meshes that are uploaded once and
+//	drawn many times.  Buffers may be destroyed on
+//	any thread: the GL name is queued, and deleted
+//	by DeleteReleased() on the thread that owns the
+//	context.
+//
+///////////////////////////////////////////////////
+
+#include "VertexBuffer.h"
+
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+// the buffer functions are core in 1.5, but only declared by glext.h
+#define GL_GLEXT_PROTOTYPES
+#ifdef __APPLE__
+#include <OpenGL/gl.h>
+#else
+#include <GL/gl.h>
+#include <GL/glext.h>
+#endif
+
+// set by SetEnabled(), so that the immediate mode paths can still be timed
+static bool retainedEnabled = true;
+
+// set once a context has reported version 1.5 or later
+static bool contextSupportsBuffers = false;
+
+// names of buffers destroyed since the last DeleteReleased()
+static std::mutex releasedMutex;
+static std::vector<unsigned int> releasedNames;
+
+// constructor will initialise to an empty buffer
+VertexBuffer::VertexBuffer(BufferContents Contents)
+	:
+	contents(Contents),
+	name(0),
+	bytes(0)
+	{ // constructor
+	} // constructor
+
+// copies start empty, since a buffer belongs to a single mesh
+VertexBuffer::VertexBuffer(const VertexBuffer &other)
+	:
+	contents(other.contents),
+	name(0),
+	bytes(0)
+	{ // copy constructor
+	} // copy constructor
+
+VertexBuffer &VertexBuffer::operator =(const VertexBuffer &other)
+	{ // assignment
+	if (this != &other)
+		{ // not self
+		Release();
+		contents = other.contents;
+		} // not self
+	return *this;
+	} // assignment
+
+// destructor releases the buffer
+VertexBuffer::~VertexBuffer()
+	{ // destructor
+	Release();
+	} // destructor
+
+// true if the current context has buffer objects and they have not been switched off
+bool VertexBuffer::Available()
+	{ // Available()
+	if (!retainedEnabled)
+		return false;
+	if (!contextSupportsBuffers)
+		{ // ask the context
+		// no current context gives NULL, and we ask again next time
+		const char *version = (const char *) glGetString(GL_VERSION);
+		int major = 0, minor = 0;
+		if (version == NULL || sscanf(version, "%d.%d", &major, &minor) != 2)
+			return false;
+		contextSupportsBuffers = major > 1 || (major == 1 && minor >= 5);
+		} // ask the context
+	return contextSupportsBuffers;
+	} // Available()
+
+// switches retained rendering on or off, for comparison with immediate mode
+void VertexBuffer::SetEnabled(bool enabled)
+	{ // SetEnabled()
+	retainedEnabled = enabled;
+	} // SetEnabled()
+
+// deletes the buffers released since the last call
+void VertexBuffer::DeleteReleased()
+	{ // DeleteReleased()
+	std::vector<unsigned int> names;
+		{ // take the list
+		std::lock_guard<std::mutex> lock(releasedMutex);
+		names.swap(releasedNames);
+		} // take the list
+	if (!names.empty())
+		glDeleteBuffers(names.size(), names.data());
+	} // DeleteReleased()
+
+// creates the buffer with bytes of data, which are left undefined if data is NULL
+void VertexBuffer::Allocate(size_t Bytes, const void *data)
+	{ // Allocate()
+	if (name == 0)
+		glGenBuffers(1, &name);
+	bytes = Bytes;
+	Bind();
+	glBufferData(contents == INDEX_DATA ? GL_ELEMENT_ARRAY_BUFFER : GL_ARRAY_BUFFER, bytes, data, GL_STATIC_DRAW);
+	Unbind();
+	} // Allocate()
+
+// overwrites bytes of the buffer starting at offset
+void VertexBuffer::Update(size_t offset, size_t Bytes, const void *data)
+	{ // Update()
+	if (name == 0 || Bytes == 0 || offset + Bytes > bytes)
+		return;
+	Bind();
+	glBufferSubData(contents == INDEX_DATA ? GL_ELEMENT_ARRAY_BUFFER : GL_ARRAY_BUFFER, offset, Bytes, data);
+	Unbind();
+	} // Update()
+
+// binds the buffer for drawing
+void VertexBuffer::Bind() const
+	{ // Bind()
+	glBindBuffer(contents == INDEX_DATA ? GL_ELEMENT_ARRAY_BUFFER : GL_ARRAY_BUFFER, name);
+	} // Bind()
+
+// unbinds it, so that later client-side arrays are not read from the buffer
+void VertexBuffer::Unbind() const
+	{ // Unbind()
+	glBindBuffer(contents == INDEX_DATA ? GL_ELEMENT_ARRAY_BUFFER : GL_ARRAY_BUFFER, 0);
+	} // Unbind()
+
+// gives the buffer back: it is deleted by the next DeleteReleased()
+void VertexBuffer::Release()
+	{ // Release()
+	if (name != 0)
+		{ // queue the name
+		std::lock_guard<std::mutex> lock(releasedMutex);
+		releasedNames.push_back(name);
+		} // queue the name
+	name = 0;
+	bytes = 0;
+	} // Release()
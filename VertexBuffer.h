@@ -0,0 +1,71 @@
+///////////////////////////////////////////////////
+//
+//	------------------------
+//	VertexBuffer.h
+//	------------------------
+//
+//	A thin wrapper around an OpenGL 1.5 buffer
+//	object, for meshes that are uploaded once and
+//	drawn many times.  Buffers may be destroyed on
+//	any thread: the GL name is queued, and deleted
+//	by DeleteReleased() on the thread that owns the
+//	context.
+//
+///////////////////////////////////////////////////
+
+#ifndef _VERTEX_BUFFER_H
+#define _VERTEX_BUFFER_H
+
+#include <cstddef>
+
+class VertexBuffer
+	{ // class VertexBuffer
+	public:
+	// what the buffer holds, which decides where it is bound
+	enum BufferContents { VERTEX_DATA, INDEX_DATA };
+
+	// constructor will initialise to an empty buffer
+	explicit VertexBuffer(BufferContents Contents = VERTEX_DATA);
+	// copies start empty, since a buffer belongs to a single mesh
+	VertexBuffer(const VertexBuffer &other);
+	VertexBuffer &operator =(const VertexBuffer &other);
+	// destructor releases the buffer
+	~VertexBuffer();
+
+	// true if the current context has buffer objects and they have not been switched off
+	// returns false if there is no current context
+	static bool Available();
+
+	// switches retained rendering on or off, for comparison with immediate mode
+	static void SetEnabled(bool enabled);
+
+	// deletes the buffers released since the last call
+	// must be called on the thread that owns the context
+	static void DeleteReleased();
+
+	// true once Allocate() has been called
+	bool IsAllocated() const	{ return name != 0; }
+
+	// size of the buffer in bytes
+	size_t Bytes() const		{ return bytes; }
+
+	// creates the buffer with bytes of data, which are left undefined if data is NULL
+	void Allocate(size_t Bytes, const void *data);
+
+	// overwrites bytes of the buffer starting at offset
+	void Update(size_t offset, size_t Bytes, const void *data);
+
+	// binds the buffer for drawing, or unbinds it
+	void Bind() const;
+	void Unbind() const;
+
+	// gives the buffer back: it is deleted by the next DeleteReleased()
+	void Release();
+
+	private:
+	BufferContents contents;
+	unsigned int name;
+	size_t bytes;
+	}; // class VertexBuffer
+
+#endif
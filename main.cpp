@@ -12,11 +12,196 @@
 #include <QtWidgets/QApplication>
 #include "FlightSimulatorWidget.h"
 #include "SceneModel.h"
+#include "Benchmarks.h"
+#include "VertexBuffer.h"
+#include "InstanceBatch.h"
+#include "MeshOptimiser.h"
 #include <iostream>
 #include <string>
+#include <cstring>
+#include <cstdlib>
+
+// set by --benchmark-instances [count], for the window and for --headless
+static long benchmarkInstances = 0;
+
+// set by --capture directory [ppm|png], for the window and for --headless
+static const char *captureDirectory = NULL;
+static bool capturePNG = false;
+
+// cleared by --single-thread, to update the scene on the window's thread between frames
+static bool simulationThread = true;
+
+// argument index as a number, or a default if it is missing or is the next option
+static double NumberArgument(int argc, char **argv, int index, double defaultValue)
+	{ // NumberArgument()
+	if (index >= argc || strncmp(argv[index], "--", 2) == 0)
+		return defaultValue;
+	return atof(argv[index]);
+	} // NumberArgument()
+
+// runs a command-line tool instead of the simulator
+// returns true if one was requested, with its exit code in exitCode
+static bool RunCommandLineTool(int argc, char **argv, int &exitCode)
+	{ // RunCommandLineTool()
+	// --convert-dem in.dem out.hfb [xyScale]
+	if (argc >= 4 && strcmp(argv[1], "--convert-dem") == 0)
+		{ // convert a text terrain to the binary format
+		float xyScale = argc >= 5 ? atof(argv[4]) : 500.0f;
+		Terrain terrain;
+		if (!terrain.ReadHeightValues(argv[2], xyScale) || !terrain.WriteFileTerrainBinary(argv[3]))
+			{ // conversion failed
+			std::cout << "Unable to convert " << argv[2] << " to " << argv[3] << std::endl;
+			exitCode = 1;
+			} // conversion failed
+		else
+			exitCode = 0;
+		return true;
+		} // convert a text terrain to the binary format
+
+	// --tile-dem in.dem outDirectory [tileSize] [xyScale]
+	if (argc >= 4 && strcmp(argv[1], "--tile-dem") == 0)
+		{ // cut a terrain into streamed tiles
+		long tileSize = argc >= 5 ? atol(argv[4]) : 128;
+		float xyScale = argc >= 6 ? atof(argv[5]) : 500.0f;
+		if (!TerrainStreamer::WriteTiles(argv[2], xyScale, argv[3], tileSize))
+			{ // tiling failed
+			std::cout << "Unable to tile " << argv[2] << " into " << argv[3] << " (the tile size must be even)" << std::endl;
+			exitCode = 1;
+			} // tiling failed
+		else
+			exitCode = 0;
+		return true;
+		} // cut a terrain into streamed tiles
+
+	// --benchmark-terrain-load [file.dem] [repeats]
+	if (argc >= 2 && strcmp(argv[1], "--benchmark-terrain-load") == 0)
+		{ // terrain load benchmark
+		exitCode = BenchmarkTerrainLoad(argc >= 3 ? argv[2] : "./models/landscape.dem", argc >= 4 ? atoi(argv[3]) : 20);
+		return true;
+		} // terrain load benchmark
+
+	// --benchmark-terrain-height [gridSize] [queries]
+	if (argc >= 2 && strcmp(argv[1], "--benchmark-terrain-height") == 0)
+		{ // terrain height query benchmark
+		exitCode = BenchmarkTerrainHeight(argc >= 3 ? atol(argv[2]) : 4096, argc >= 4 ? atol(argv[3]) : 4000000);
+		return true;
+		} // terrain height query benchmark
+
+	// --benchmark-terrain-batch [file.dem] [points]
+	if (argc >= 2 && strcmp(argv[1], "--benchmark-terrain-batch") == 0)
+		{ // batched height query benchmark
+		exitCode = BenchmarkTerrainBatch(argc >= 3 ? argv[2] : "./models/landscape.dem", argc >= 4 ? atol(argv[3]) : 50000);
+		return true;
+		} // batched height query benchmark
+
+	// --benchmark-terrain-stream [gridSize] [tileSize] [frames]
+	if (argc >= 2 && strcmp(argv[1], "--benchmark-terrain-stream") == 0)
+		{ // streamed terrain benchmark
+		exitCode = BenchmarkTerrainStreaming(argc >= 3 ? atol(argv[2]) : 4096, argc >= 4 ? atol(argv[3]) : 128, argc >= 5 ? atol(argv[4]) : 1000);
+		return true;
+		} // streamed terrain benchmark
+
+	// --benchmark-terrain-build [gridSize] [threads]
+	if (argc >= 2 && strcmp(argv[1], "--benchmark-terrain-build") == 0)
+		{ // parallel terrain build benchmark
+		exitCode = BenchmarkTerrainBuild(argc >= 3 ? atol(argv[2]) : 4096, argc >= 4 ? atoi(argv[3]) : 0);
+		return true;
+		} // parallel terrain build benchmark
+
+	// --benchmark-terrain-rays [gridSize] [rays]
+	if (argc >= 2 && strcmp(argv[1], "--benchmark-terrain-rays") == 0)
+		{ // ray query benchmark
+		exitCode = BenchmarkTerrainRays(argc >= 3 ? atol(argv[2]) : 2048, argc >= 4 ? atol(argv[3]) : 10000);
+		return true;
+		} // ray query benchmark
+
+	// --benchmark-transform [vertices]
+	if (argc >= 2 && strcmp(argv[1], "--benchmark-transform") == 0)
+		{ // vertex transform benchmark
+		exitCode = BenchmarkTransform(argc >= 3 ? atol(argv[2]) : 1000000);
+		return true;
+		} // vertex transform benchmark
+
+	// --benchmark-particles [particles] [frames]
+	if (argc >= 2 && strcmp(argv[1], "--benchmark-particles") == 0)
+		{ // particle system benchmark
+		exitCode = BenchmarkParticles(argc >= 3 ? atol(argv[2]) : 100000, argc >= 4 ? atol(argv[3]) : 100);
+		return true;
+		} // particle system benchmark
+
+	// --benchmark-collisions [largest] [frames]
+	if (argc >= 2 && strcmp(argv[1], "--benchmark-collisions") == 0)
+		{ // collision broadphase benchmark
+		exitCode = BenchmarkCollisions(argc >= 3 ? atol(argv[2]) : 100000, argc >= 4 ? atol(argv[3]) : 10);
+		return true;
+		} // collision broadphase benchmark
+
+	// --benchmark-particle-threads [particles] [frames] [maxThreads]
+	if (argc >= 2 && strcmp(argv[1], "--benchmark-particle-threads") == 0)
+		{ // parallel particle step benchmark
+		exitCode = BenchmarkParticleThreads(argc >= 3 ? atol(argv[2]) : 100000, argc >= 4 ? atol(argv[3]) : 20, argc >= 5 ? atoi(argv[4]) : 16);
+		return true;
+		} // parallel particle step benchmark
+
+	// --benchmark-vertex-cache [file.dem] [model.tri ...]
+	if (argc >= 2 && strcmp(argv[1], "--benchmark-vertex-cache") == 0)
+		{ // vertex cache report
+		static const char *defaultModels[2] = { "./models/planeModel.tri", "./models/lavaBombModel.tri" };
+		bool modelsGiven = argc >= 4 && strncmp(argv[3], "--", 2) != 0;
+		exitCode = BenchmarkVertexCache(argc >= 3 ? argv[2] : "./models/landscape.dem",
+			modelsGiven ? (const char *const *) (argv + 3) : defaultModels, modelsGiven ? argc - 3 : 2);
+		return true;
+		} // vertex cache report
+
+	// --headless [frames] [width] [height] [deltaTime]
+	if (argc >= 2 && strcmp(argv[1], "--headless") == 0)
+		{ // offscreen frame benchmark
+		// the numbers stop at the first option, such as --benchmark-instances
+		int numbers = 2;
+		while (numbers < argc && strncmp(argv[numbers], "--", 2) != 0)
+			numbers++;
+		exitCode = BenchmarkFrames((long) NumberArgument(numbers, argv, 2, 600), (int) NumberArgument(numbers, argv, 3, 600),
+			(int) NumberArgument(numbers, argv, 4, 600), (float) NumberArgument(numbers, argv, 5, 1.0 / 60.0), benchmarkInstances,
+			captureDirectory, capturePNG);
+		return true;
+		} // offscreen frame benchmark
+
+	// nothing we recognise, so run the simulator
+	return false;
+	} // RunCommandLineTool()
 
 int main(int argc, char **argv)
 	{ // main()
+	// --immediate-mode draws without vertex buffers, and --no-instancing draws
+	// one copy of a model at a time, for comparison
+	// --benchmark-instances [count] fills the sky with lava bombs and times drawing them
+	// --capture directory [ppm|png] saves every frame into an existing directory
+	// these apply to --headless as well as the window
+	// --no-cache-optimisation leaves the meshes in file order, for comparison
+	// --single-thread updates the window's scene between frames instead of on a thread of
+	// its own; --headless always steps between frames, so that its runs repeat exactly
+	for (int arg = 1; arg < argc; arg++)
+		if (strcmp(argv[arg], "--immediate-mode") == 0)
+			VertexBuffer::SetEnabled(false);
+		else if (strcmp(argv[arg], "--no-instancing") == 0)
+			InstanceBatch::SetInstancingEnabled(false);
+		else if (strcmp(argv[arg], "--benchmark-instances") == 0)
+			benchmarkInstances = (long) NumberArgument(argc, argv, arg + 1, 10000);
+		else if (strcmp(argv[arg], "--single-thread") == 0)
+			simulationThread = false;
+		else if (strcmp(argv[arg], "--no-cache-optimisation") == 0)
+			SetMeshOptimisationEnabled(false);
+		else if (strcmp(argv[arg], "--capture") == 0 && arg + 1 < argc)
+			{ // capture
+			captureDirectory = argv[arg + 1];
+			capturePNG = arg + 2 < argc && strcmp(argv[arg + 2], "png") == 0;
+			} // capture
+
+	// tools and benchmarks run without a window
+	int toolExitCode = 0;
+	if (RunCommandLineTool(argc, argv, toolExitCode))
+		return toolExitCode;
+
 	// initialize QT
 	QApplication app(argc, argv);
 
@@ -26,9 +211,16 @@ int main(int argc, char **argv)
 		// we want a single instance of the scene model
 		//38500, 2000, -4000 is near volcano
 		SceneModel theScene(0,4000,0);
+		if (benchmarkInstances > 0)
+			theScene.StartInstanceBenchmark(benchmarkInstances);
+		// the simulation steps at 60 Hz whatever the frame rate
+		if (simulationThread)
+			theScene.StartSimulationThread(60.0f);
 		
 		// create the widget with no parent
 		FlightSimulatorWidget flightWindow(NULL, &theScene);
+		if (captureDirectory != NULL)
+			flightWindow.StartCapture(captureDirectory, capturePNG ? FrameCapture::PNG_IMAGES : FrameCapture::PPM_IMAGES);
 		
 		// 	set the initial size
 		flightWindow.resize(600, 600);